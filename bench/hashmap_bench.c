@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Hash map stress check and lookup benchmark. Built with
+// -DBM_BUILD_BENCHMARKS=ON and run by ctest.
+//
+// The check drives a string keyed and an integer keyed map through random
+// inserts, removes and finds, comparing every result against a flat
+// reference table. The benchmark times hashmap_find and hashmap_find_int
+// against a strcmp scan of the same keys, which is what small name lookups
+// used before the hash map.
+
+#include "core/hashmap.h"
+#include "core/logger.h"
+#include "core/memory.h"
+
+#include "platform/platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define CHECK_KEYS 2048
+#define CHECK_OPS 500000
+#define KEY_MAX 16
+
+#define BENCH_MAX_KEYS 1024
+#define BENCH_LOOKUPS 1000000
+
+typedef struct ref_entry_s {
+	bool present;
+	void* elem;
+} ref_entry_t;
+
+static char keys[CHECK_KEYS][KEY_MAX];
+static ref_entry_t ref_str[CHECK_KEYS];
+static ref_entry_t ref_int[CHECK_KEYS];
+
+static volatile uintptr_t bench_sink;
+
+// xorshift64, deterministic so failures reproduce
+static u64 rng_state = 0x9e3779b97f4a7c15ULL;
+
+static u64 rng_next(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+// spread integer keys so they don't share low bits
+static u64 int_key(size_t idx)
+{
+	return (u64)idx * 0x100000001b3ULL + 1;
+}
+
+static bool check_find(hashmap_t* str_map, hashmap_t* int_map, size_t idx)
+{
+	void* elem = NULL;
+	bool found = hashmap_find(str_map, keys[idx], &elem);
+	if (found != ref_str[idx].present ||
+	    (found && elem != ref_str[idx].elem)) {
+		logger(LOG_ERROR, "hashmap_find mismatch for key %s\n",
+		       keys[idx]);
+		return false;
+	}
+
+	elem = NULL;
+	found = hashmap_find_int(int_map, int_key(idx), &elem);
+	if (found != ref_int[idx].present ||
+	    (found && elem != ref_int[idx].elem)) {
+		logger(LOG_ERROR, "hashmap_find_int mismatch for key %zu\n",
+		       idx);
+		return false;
+	}
+
+	return true;
+}
+
+static bool run_check(void)
+{
+	hashmap_t str_map;
+	hashmap_t int_map;
+	hashmap_init(&str_map, kHashmapKeyString, NULL, kMemTagGeneral);
+	hashmap_init(&int_map, kHashmapKeyInt, NULL, kMemTagGeneral);
+
+	for (size_t i = 0; i < CHECK_KEYS; i++)
+		snprintf(keys[i], KEY_MAX, "key_%zu", i);
+
+	bool ok = true;
+	size_t num_str = 0;
+	size_t num_int = 0;
+	for (u32 op = 0; op < CHECK_OPS && ok; op++) {
+		const u64 r = rng_next();
+		const size_t idx = (size_t)(r >> 8) % CHECK_KEYS;
+		void* elem = (void*)(uintptr_t)(r | 1);
+		switch (r % 4) {
+		case 0:
+		case 1:
+			hashmap_insert(&str_map, keys[idx], elem);
+			hashmap_insert_int(&int_map, int_key(idx), elem);
+			num_str += !ref_str[idx].present;
+			num_int += !ref_int[idx].present;
+			ref_str[idx].present = ref_int[idx].present = true;
+			ref_str[idx].elem = ref_int[idx].elem = elem;
+			break;
+		case 2:
+			hashmap_remove(&str_map, keys[idx]);
+			hashmap_remove_int(&int_map, int_key(idx));
+			num_str -= ref_str[idx].present;
+			num_int -= ref_int[idx].present;
+			ref_str[idx].present = ref_int[idx].present = false;
+			break;
+		case 3:
+			ok = check_find(&str_map, &int_map, idx);
+			break;
+		}
+
+		if (str_map.count != num_str || int_map.count != num_int) {
+			logger(LOG_ERROR,
+			       "hashmap count mismatch after op %u: %zu/%zu, "
+			       "expected %zu/%zu\n",
+			       op, str_map.count, int_map.count, num_str,
+			       num_int);
+			ok = false;
+		}
+
+		// the map has to be usable again after a clear
+		if (op == CHECK_OPS / 2) {
+			hashmap_clear(&str_map);
+			hashmap_clear(&int_map);
+			memset(ref_str, 0, sizeof(ref_str));
+			memset(ref_int, 0, sizeof(ref_int));
+			num_str = num_int = 0;
+		}
+	}
+
+	for (size_t i = 0; i < CHECK_KEYS && ok; i++)
+		ok = check_find(&str_map, &int_map, i);
+
+	hashmap_destroy(&str_map);
+	hashmap_destroy(&int_map);
+
+	printf("hashmap check: %u ops over %d keys %s\n", CHECK_OPS,
+	       CHECK_KEYS, ok ? "passed" : "FAILED");
+
+	return ok;
+}
+
+static f64 ns_per_lookup(u64 start_ns)
+{
+	return (f64)(os_get_time_ns() - start_ns) / BENCH_LOOKUPS;
+}
+
+static void run_bench(size_t num_keys)
+{
+	static u32 order[BENCH_LOOKUPS];
+	static const char* key_list[BENCH_MAX_KEYS];
+
+	hashmap_t str_map;
+	hashmap_t int_map;
+	hashmap_init(&str_map, kHashmapKeyString, NULL, kMemTagGeneral);
+	hashmap_init(&int_map, kHashmapKeyInt, NULL, kMemTagGeneral);
+	for (size_t i = 0; i < num_keys; i++) {
+		key_list[i] = keys[i];
+		hashmap_insert(&str_map, keys[i], (void*)(uintptr_t)(i + 1));
+		hashmap_insert_int(&int_map, int_key(i),
+				   (void*)(uintptr_t)(i + 1));
+	}
+
+	// the same random key order for every method
+	for (u32 i = 0; i < BENCH_LOOKUPS; i++)
+		order[i] = (u32)(rng_next() % num_keys);
+
+	uintptr_t sum = 0;
+	u64 start_ns = os_get_time_ns();
+	for (u32 i = 0; i < BENCH_LOOKUPS; i++) {
+		const char* key = keys[order[i]];
+		for (size_t k = 0; k < num_keys; k++) {
+			if (!strcmp(key_list[k], key)) {
+				sum += k + 1;
+				break;
+			}
+		}
+	}
+	const f64 scan_ns = ns_per_lookup(start_ns);
+
+	start_ns = os_get_time_ns();
+	for (u32 i = 0; i < BENCH_LOOKUPS; i++) {
+		void* elem = NULL;
+		if (hashmap_find(&str_map, keys[order[i]], &elem))
+			sum += (uintptr_t)elem;
+	}
+	const f64 find_ns = ns_per_lookup(start_ns);
+
+	start_ns = os_get_time_ns();
+	for (u32 i = 0; i < BENCH_LOOKUPS; i++) {
+		void* elem = NULL;
+		if (hashmap_find_int(&int_map, int_key(order[i]), &elem))
+			sum += (uintptr_t)elem;
+	}
+	const f64 find_int_ns = ns_per_lookup(start_ns);
+	bench_sink = sum;
+
+	printf("%6zu keys: strcmp scan %8.1fns, hashmap_find %6.1fns, "
+	       "hashmap_find_int %6.1fns\n",
+	       num_keys, scan_ns, find_ns, find_int_ns);
+
+	hashmap_destroy(&str_map);
+	hashmap_destroy(&int_map);
+}
+
+int main(int argc, char** argv)
+{
+	if (!run_check())
+		return 1;
+
+	printf("lookup cost, %d random lookups of present keys\n",
+	       BENCH_LOOKUPS);
+	for (size_t n = 16; n <= BENCH_MAX_KEYS; n *= 2)
+		run_bench(n);
+
+	return 0;
+}
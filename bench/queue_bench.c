@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Queue stress checks and throughput. Built with -DBM_BUILD_BENCHMARKS=ON
+// and run by ctest.
+//
+// The SPSC check streams a counter from one producer thread through a
+// small ring, through both the copying and the in place calls, and the
+// consumer fails on the first value out of order. The MPMC check runs
+// every producer and consumer count up to QUEUE_MAX_THREADS, tags each
+// value with its producer, and checks that every value arrived exactly
+// once. The same runs report throughput.
+
+#include "core/logger.h"
+#include "core/queue.h"
+
+#include "platform/platform.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define QUEUE_CAPACITY 1024
+#define QUEUE_MAX_THREADS 4
+
+#define SPSC_VALUES 2000000L
+#define MPMC_VALUES_PER_PRODUCER 250000L
+
+typedef struct bench_elem_s {
+	long value;
+	long producer;
+} bench_elem_t;
+
+static u8 spsc_backing[SPSC_QUEUE_BACKING_SIZE(sizeof(bench_elem_t),
+					       QUEUE_CAPACITY)];
+static u8 mpmc_backing[MPMC_QUEUE_BACKING_SIZE(sizeof(bench_elem_t),
+					       QUEUE_CAPACITY)];
+static spsc_queue_t spsc;
+static mpmc_queue_t mpmc;
+
+// one counter per produced value, each must end at exactly 1
+static volatile s32 mpmc_seen[QUEUE_MAX_THREADS][MPMC_VALUES_PER_PRODUCER];
+static volatile long mpmc_popped;
+static volatile long mpmc_bad;
+static long mpmc_total;
+
+static s32 spsc_producer(void* param)
+{
+	for (long i = 0; i < SPSC_VALUES; i++) {
+		bench_elem_t elem = {i, 0};
+		if (i & 1) {
+			bench_elem_t* slot;
+			while ((slot = spsc_queue_push_begin(&spsc)) == NULL)
+				os_thread_yield();
+			*slot = elem;
+			spsc_queue_push_commit(&spsc);
+		} else {
+			while (!spsc_queue_push(&spsc, &elem))
+				os_thread_yield();
+		}
+	}
+
+	return 0;
+}
+
+static bool run_spsc(void)
+{
+	if (!spsc_queue_init(&spsc, spsc_backing, sizeof(spsc_backing),
+			     sizeof(bench_elem_t)))
+		return false;
+
+	const u64 start_ns = os_get_time_ns();
+	os_thread_t* producer = os_thread_create(spsc_producer, NULL);
+	if (producer == NULL)
+		return false;
+
+	bool ok = true;
+	for (long expected = 0; expected < SPSC_VALUES; expected++) {
+		bench_elem_t elem;
+		if (expected & 2) {
+			bench_elem_t* slot;
+			while ((slot = spsc_queue_pop_begin(&spsc)) == NULL)
+				os_thread_yield();
+			elem = *slot;
+			spsc_queue_pop_commit(&spsc);
+		} else {
+			while (!spsc_queue_pop(&spsc, &elem))
+				os_thread_yield();
+		}
+		if (ok && elem.value != expected) {
+			logger(LOG_ERROR, "spsc: got %ld, expected %ld\n",
+			       elem.value, expected);
+			ok = false;
+		}
+	}
+	os_thread_join(producer);
+	const u64 elapsed_ns = os_get_time_ns() - start_ns;
+
+	if (spsc_queue_count(&spsc) != 0) {
+		logger(LOG_ERROR, "spsc: queue not empty after the run\n");
+		ok = false;
+	}
+
+	printf("spsc 1x1: %ld values, %.1f Mops/s %s\n", SPSC_VALUES,
+	       (f64)SPSC_VALUES * 1000.0 / (f64)elapsed_ns,
+	       ok ? "passed" : "FAILED");
+
+	return ok;
+}
+
+static s32 mpmc_producer(void* param)
+{
+	const long producer = (long)(intptr_t)param;
+	for (long i = 0; i < MPMC_VALUES_PER_PRODUCER; i++) {
+		bench_elem_t elem = {i, producer};
+		if (i & 1) {
+			long ticket;
+			bench_elem_t* slot;
+			while ((slot = mpmc_queue_push_begin(&mpmc, &ticket)) ==
+			       NULL)
+				os_thread_yield();
+			*slot = elem;
+			mpmc_queue_push_commit(&mpmc, ticket);
+		} else {
+			while (!mpmc_queue_push(&mpmc, &elem))
+				os_thread_yield();
+		}
+	}
+
+	return 0;
+}
+
+static s32 mpmc_consumer(void* param)
+{
+	while (os_atomic_load_long(&mpmc_popped) < mpmc_total) {
+		bench_elem_t elem;
+		if (!mpmc_queue_pop(&mpmc, &elem)) {
+			os_thread_yield();
+			continue;
+		}
+		if (elem.producer < 0 || elem.producer >= QUEUE_MAX_THREADS ||
+		    elem.value < 0 || elem.value >= MPMC_VALUES_PER_PRODUCER) {
+			os_atomic_inc_long(&mpmc_bad);
+		} else {
+			os_atomic_add_s32(&mpmc_seen[elem.producer][elem.value],
+					  1);
+		}
+		os_atomic_inc_long(&mpmc_popped);
+	}
+
+	return 0;
+}
+
+static bool run_mpmc(long num_producers, long num_consumers)
+{
+	if (!mpmc_queue_init(&mpmc, mpmc_backing, sizeof(mpmc_backing),
+			     sizeof(bench_elem_t)))
+		return false;
+
+	memset((void*)mpmc_seen, 0, sizeof(mpmc_seen));
+	mpmc_popped = 0;
+	mpmc_bad = 0;
+	mpmc_total = num_producers * MPMC_VALUES_PER_PRODUCER;
+
+	os_thread_t* threads[QUEUE_MAX_THREADS * 2];
+	s32 num_threads = 0;
+	const u64 start_ns = os_get_time_ns();
+	for (long c = 0; c < num_consumers; c++)
+		threads[num_threads++] = os_thread_create(mpmc_consumer, NULL);
+	for (long p = 0; p < num_producers; p++)
+		threads[num_threads++] =
+			os_thread_create(mpmc_producer, (void*)(intptr_t)p);
+	for (s32 t = 0; t < num_threads; t++) {
+		if (threads[t] != NULL)
+			os_thread_join(threads[t]);
+	}
+	const u64 elapsed_ns = os_get_time_ns() - start_ns;
+
+	bool ok = mpmc_bad == 0 && mpmc_queue_count(&mpmc) == 0;
+	for (long p = 0; p < num_producers && ok; p++) {
+		for (long i = 0; i < MPMC_VALUES_PER_PRODUCER; i++) {
+			if (mpmc_seen[p][i] != 1) {
+				logger(LOG_ERROR,
+				       "mpmc %ldx%ld: value %ld from producer "
+				       "%ld seen %d times\n",
+				       num_producers, num_consumers, i, p,
+				       mpmc_seen[p][i]);
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	printf("mpmc %ldx%ld: %ld values, %.1f Mops/s %s\n", num_producers,
+	       num_consumers, mpmc_total,
+	       (f64)mpmc_total * 1000.0 / (f64)elapsed_ns,
+	       ok ? "passed" : "FAILED");
+
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	bool ok = run_spsc();
+	for (long p = 1; p <= QUEUE_MAX_THREADS; p++) {
+		for (long c = 1; c <= QUEUE_MAX_THREADS; c++)
+			ok &= run_mpmc(p, c);
+	}
+
+	return ok ? 0 : 1;
+}
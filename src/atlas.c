@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "atlas.h"
+#include "sprite.h"
+
+#include "core/logger.h"
+#include "core/memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ATLAS_BYTES_PER_PIXEL 4
+
+void atlas_init(texture_atlas_t* atlas)
+{
+	memset(atlas, 0, sizeof(texture_atlas_t));
+	array_atlas_sprite_init(&atlas->sprites,
+				array_allocator_heap(kMemTagRender));
+}
+
+bool atlas_add_sprite(texture_atlas_t* atlas, sprite_t* sprite)
+{
+	if (atlas == NULL || sprite == NULL)
+		return false;
+
+	return array_atlas_sprite_push(&atlas->sprites, sprite) != NULL;
+}
+
+static bool atlas_page_init(atlas_page_t* page, s32 width, s32 height)
+{
+	const size_t sz_pixels =
+		(size_t)width * (size_t)height * ATLAS_BYTES_PER_PIXEL;
+	page->pixels = (u8*)bm_malloc_tagged(sz_pixels, kMemTagRender);
+	if (page->pixels == NULL)
+		return false;
+	memset(page->pixels, 0, sz_pixels);
+
+	page->width = width;
+	page->height = height;
+	page->texture = NULL;
+	page->nodes[0].x = 0;
+	page->nodes[0].y = 0;
+	page->nodes[0].w = width;
+	page->num_nodes = 1;
+
+	return true;
+}
+
+// Lowest y a w*h rect can sit at when its left edge is on skyline node idx,
+// or -1 if it runs off the right or bottom of the page.
+static s32 skyline_fit(const atlas_page_t* page, size_t idx, s32 w, s32 h)
+{
+	const skyline_node_t* node = &page->nodes[idx];
+	if (node->x + w > page->width)
+		return -1;
+
+	s32 y = node->y;
+	s32 width_left = w;
+	while (width_left > 0) {
+		if (idx >= page->num_nodes)
+			return -1;
+		if (page->nodes[idx].y > y)
+			y = page->nodes[idx].y;
+		if (y + h > page->height)
+			return -1;
+		width_left -= page->nodes[idx].w;
+		idx++;
+	}
+
+	return y;
+}
+
+static void skyline_add_level(atlas_page_t* page, size_t idx, s32 x, s32 y,
+			      s32 w, s32 h)
+{
+	if (page->num_nodes >= MAX_SKYLINE_NODES)
+		return;
+
+	memmove(&page->nodes[idx + 1], &page->nodes[idx],
+		sizeof(skyline_node_t) * (page->num_nodes - idx));
+	page->nodes[idx].x = x;
+	page->nodes[idx].y = y + h;
+	page->nodes[idx].w = w;
+	page->num_nodes++;
+
+	// trim or remove the nodes now covered by the new level
+	for (size_t i = idx + 1; i < page->num_nodes; i++) {
+		skyline_node_t* prev = &page->nodes[i - 1];
+		skyline_node_t* node = &page->nodes[i];
+		if (node->x >= prev->x + prev->w)
+			break;
+
+		s32 shrink = prev->x + prev->w - node->x;
+		node->x += shrink;
+		node->w -= shrink;
+		if (node->w > 0)
+			break;
+
+		memmove(&page->nodes[i], &page->nodes[i + 1],
+			sizeof(skyline_node_t) * (page->num_nodes - i - 1));
+		page->num_nodes--;
+		i--;
+	}
+
+	// merge neighbouring nodes sitting at the same height
+	for (size_t i = 0; i + 1 < page->num_nodes; i++) {
+		if (page->nodes[i].y == page->nodes[i + 1].y) {
+			page->nodes[i].w += page->nodes[i + 1].w;
+			memmove(&page->nodes[i + 1], &page->nodes[i + 2],
+				sizeof(skyline_node_t) *
+					(page->num_nodes - i - 2));
+			page->num_nodes--;
+			i--;
+		}
+	}
+}
+
+// Skyline bottom-left: place the rect where its top edge ends up lowest,
+// preferring the narrowest node on ties to limit wasted space.
+static bool skyline_insert(atlas_page_t* page, s32 w, s32 h, rect_t* out)
+{
+	s32 best_top = page->height + 1;
+	s32 best_width = page->width + 1;
+	s32 best_y = 0;
+	size_t best_idx = page->num_nodes;
+
+	for (size_t i = 0; i < page->num_nodes; i++) {
+		s32 y = skyline_fit(page, i, w, h);
+		if (y < 0)
+			continue;
+		if (y + h < best_top ||
+		    (y + h == best_top && page->nodes[i].w < best_width)) {
+			best_top = y + h;
+			best_width = page->nodes[i].w;
+			best_y = y;
+			best_idx = i;
+		}
+	}
+
+	if (best_idx == page->num_nodes)
+		return false;
+
+	out->x = page->nodes[best_idx].x;
+	out->y = best_y;
+	out->w = w;
+	out->h = h;
+	skyline_add_level(page, best_idx, out->x, out->y, w, h);
+
+	return true;
+}
+
+// Copy BGR24/BGRA32 sprite pixels into the BGRA32 page
+static void atlas_blit_sprite(atlas_page_t* page, const sprite_t* sprite,
+			      const rect_t* dst)
+{
+	const s32 src_bpp = sprite->has_alpha ? 4 : 3;
+	const s32 src_stride = sprite->surface->pitch;
+	const s32 dst_stride = page->width * ATLAS_BYTES_PER_PIXEL;
+
+	for (s32 y = 0; y < dst->h; y++) {
+		const u8* src_row = sprite->data + (size_t)y * src_stride;
+		u8* dst_row = page->pixels + (size_t)(dst->y + y) * dst_stride +
+			      (size_t)dst->x * ATLAS_BYTES_PER_PIXEL;
+		if (src_bpp == ATLAS_BYTES_PER_PIXEL) {
+			memcpy(dst_row, src_row,
+			       (size_t)dst->w * ATLAS_BYTES_PER_PIXEL);
+			continue;
+		}
+		for (s32 x = 0; x < dst->w; x++) {
+			dst_row[x * 4 + 0] = src_row[x * 3 + 0];
+			dst_row[x * 4 + 1] = src_row[x * 3 + 1];
+			dst_row[x * 4 + 2] = src_row[x * 3 + 2];
+			dst_row[x * 4 + 3] = 0xff;
+		}
+	}
+}
+
+static int sprite_height_desc(const void* a, const void* b)
+{
+	const sprite_t* sa = *(const sprite_t**)a;
+	const sprite_t* sb = *(const sprite_t**)b;
+	if (sa->surface->h != sb->surface->h)
+		return sb->surface->h - sa->surface->h;
+	return sb->surface->w - sa->surface->w;
+}
+
+static bool atlas_packable(const sprite_t* sprite)
+{
+	return sprite->type == IMG_TYPE_TARGA && sprite->surface != NULL &&
+	       (sprite->pix_fmt == BGR24 || sprite->pix_fmt == BGRA32) &&
+	       sprite->surface->w + ATLAS_PADDING <= ATLAS_PAGE_WIDTH &&
+	       sprite->surface->h + ATLAS_PADDING <= ATLAS_PAGE_HEIGHT;
+}
+
+static bool atlas_pack_sprite(texture_atlas_t* atlas, sprite_t* sprite)
+{
+	const s32 w = sprite->surface->w;
+	const s32 h = sprite->surface->h;
+	rect_t slot = {0, 0, 0, 0};
+
+	for (size_t pdx = 0; pdx <= atlas->num_pages; pdx++) {
+		if (pdx == MAX_ATLAS_PAGES)
+			return false;
+
+		atlas_page_t* page = &atlas->pages[pdx];
+		if (pdx == atlas->num_pages) {
+			if (!atlas_page_init(page, ATLAS_PAGE_WIDTH,
+					     ATLAS_PAGE_HEIGHT))
+				return false;
+			atlas->num_pages++;
+		}
+
+		if (skyline_insert(page, w + ATLAS_PADDING, h + ATLAS_PADDING,
+				   &slot)) {
+			slot.w = w;
+			slot.h = h;
+			atlas_blit_sprite(page, sprite, &slot);
+			sprite->atlas_rect = slot;
+			sprite->atlas_page = (s32)pdx;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool atlas_build(texture_atlas_t* atlas, SDL_Renderer* ren)
+{
+	if (atlas == NULL || ren == NULL)
+		return false;
+
+	u64 sprites_packed = 0;
+
+	// tallest first keeps the skyline flat
+	qsort(atlas->sprites.data, atlas->sprites.num_elems, sizeof(sprite_t*),
+	      sprite_height_desc);
+
+	for (size_t sdx = 0; sdx < atlas->sprites.num_elems; sdx++) {
+		sprite_t* sprite = atlas->sprites.data[sdx];
+		if (atlas_packable(sprite) && atlas_pack_sprite(atlas, sprite)) {
+			sprites_packed++;
+			continue;
+		}
+
+		// doesn't fit, give the sprite a texture of its own
+		logger(LOG_WARNING,
+		       "atlas_build - sprite %zu not packed, using standalone texture\n",
+		       sdx);
+		if (!sprite_create_texture(ren, sprite))
+			return false;
+	}
+
+	for (size_t pdx = 0; pdx < atlas->num_pages; pdx++) {
+		atlas_page_t* page = &atlas->pages[pdx];
+		page->texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_BGRA32,
+						  SDL_TEXTUREACCESS_STATIC,
+						  page->width, page->height);
+		if (page->texture == NULL) {
+			logger(LOG_ERROR,
+			       "atlas_build - error creating page texture: %s\n",
+			       SDL_GetError());
+			return false;
+		}
+
+		SDL_UpdateTexture(page->texture, NULL, page->pixels,
+				  page->width * ATLAS_BYTES_PER_PIXEL);
+		SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+
+		bm_free(page->pixels);
+		page->pixels = NULL;
+	}
+
+	for (size_t sdx = 0; sdx < atlas->sprites.num_elems; sdx++) {
+		sprite_t* sprite = atlas->sprites.data[sdx];
+		if (sprite->atlas_page >= 0)
+			sprite->texture = atlas->pages[sprite->atlas_page].texture;
+	}
+
+	logger(LOG_INFO, "atlas_build - packed %llu/%zu sprites into %zu page(s)\n",
+	       sprites_packed, atlas->sprites.num_elems, atlas->num_pages);
+
+	return true;
+}
+
+void atlas_shutdown(texture_atlas_t* atlas)
+{
+	if (atlas == NULL)
+		return;
+
+	for (size_t pdx = 0; pdx < atlas->num_pages; pdx++) {
+		atlas_page_t* page = &atlas->pages[pdx];
+		if (page->pixels != NULL) {
+			bm_free(page->pixels);
+			page->pixels = NULL;
+		}
+		if (page->texture != NULL) {
+			SDL_DestroyTexture(page->texture);
+			page->texture = NULL;
+		}
+	}
+	atlas->num_pages = 0;
+	array_atlas_sprite_free(&atlas->sprites);
+}
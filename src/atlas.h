@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/array.h"
+#include "core/types.h"
+
+#include <SDL.h>
+
+typedef struct sprite_s sprite_t;
+
+// Atlas pages are BGRA32 so 24-bit and 32-bit TGAs can share a texture
+#define ATLAS_PAGE_WIDTH 1024
+#define ATLAS_PAGE_HEIGHT 1024
+#define ATLAS_PADDING 1
+#define MAX_ATLAS_PAGES 4
+#define ATLAS_INLINE_SPRITES 256 // registered sprites before the list spills
+#define MAX_SKYLINE_NODES ATLAS_PAGE_WIDTH
+
+typedef struct skyline_node_s {
+	s32 x;
+	s32 y;
+	s32 w;
+} skyline_node_t;
+
+typedef struct atlas_page_s {
+	s32 width;
+	s32 height;
+	u8* pixels; // staging pixels, released once the texture is uploaded
+	SDL_Texture* texture;
+	skyline_node_t nodes[MAX_SKYLINE_NODES];
+	size_t num_nodes;
+} atlas_page_t;
+
+BM_ARRAY_DEFINE(atlas_sprite, sprite_t*, ATLAS_INLINE_SPRITES)
+
+// Every registered sprite is either packed into a page or, when it can't
+// be packed, given a standalone texture by atlas_build.
+typedef struct texture_atlas_s {
+	atlas_page_t pages[MAX_ATLAS_PAGES];
+	size_t num_pages;
+	BM_ARRAY(atlas_sprite) sprites;
+} texture_atlas_t;
+
+void atlas_init(texture_atlas_t* atlas);
+bool atlas_add_sprite(texture_atlas_t* atlas, sprite_t* sprite);
+bool atlas_build(texture_atlas_t* atlas, SDL_Renderer* ren);
+void atlas_shutdown(texture_atlas_t* atlas);
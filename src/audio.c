@@ -2,11 +2,27 @@
 
 #include "core/logger.h"
 #include "core/memory.h"
+#include "core/pool.h"
 
 #include <stdio.h>
 
 #include <SDL_mixer.h>
 
+// Voices are freed from the mixer's channel finished callback, which runs on
+// the audio thread, so the pool is locked.
+static pool_t voice_pool;
+static void* voice_channels[BM_AUDIO_MAX_VOICES];
+
+static void audio_channel_finished(int channel)
+{
+	if (channel < 0 || channel >= BM_AUDIO_MAX_VOICES)
+		return;
+
+	void* voice = SDL_AtomicSetPtr(&voice_channels[channel], NULL);
+	if (voice)
+		pool_free(&voice_pool, voice);
+}
+
 bool audio_init(s32 num_channels, s32 sample_rate, s32 chunk_size)
 {
 	// if (Mix_OpenAudioDevice(48000, MIX_DEFAULT_FORMAT, MIX_DEFAULT_CHANNELS, 1024,
@@ -14,7 +30,16 @@ bool audio_init(s32 num_channels, s32 sample_rate, s32 chunk_size)
 	if (Mix_OpenAudio(sample_rate, MIX_DEFAULT_FORMAT, num_channels,
 			  chunk_size) == -1)
 		return false;
-	Mix_AllocateChannels(32);
+	Mix_AllocateChannels(BM_AUDIO_MAX_VOICES);
+
+	const size_t sz_voices = sizeof(audio_voice_t) * BM_AUDIO_MAX_VOICES;
+	void* voices = arena_alloc_tagged(&g_mem_arena, sz_voices,
+					  DEFAULT_ALIGNMENT, kMemTagAudio);
+	if (!pool_init(&voice_pool, voices, sz_voices, sizeof(audio_voice_t),
+		       DEFAULT_ALIGNMENT, kPoolLocked))
+		return false;
+	Mix_ChannelFinished(audio_channel_finished);
+
 	logger(LOG_INFO,
 	       "Initialized audio: Channels: %d | Sample rate %d | Chunk Size: %d",
 	       num_channels, sample_rate, chunk_size);
@@ -28,8 +53,9 @@ bool audio_load_sound(const char* path, audio_chunk_t** data)
 	Mix_Chunk* wav_file = Mix_LoadWAV(path);
 	if (!wav_file)
 		return false;
-	audio_chunk_t* chunk = (audio_chunk_t*)arena_alloc(
-		&g_mem_arena, sizeof(audio_chunk_t), DEFAULT_ALIGNMENT);
+	audio_chunk_t* chunk = (audio_chunk_t*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(audio_chunk_t), DEFAULT_ALIGNMENT,
+		kMemTagAudio);
 	// audio_chunk_t* chunk = (audio_chunk_t*)malloc(sizeof(audio_chunk_t));
 	chunk->allocated = (bool)wav_file->allocated;
 	chunk->data = wav_file->abuf;
@@ -39,7 +65,35 @@ bool audio_load_sound(const char* path, audio_chunk_t** data)
 	return true;
 }
 
+audio_voice_t* audio_play_sound(const audio_chunk_t* chunk, s32 volume)
+{
+	audio_voice_t* voice = pool_alloc_type(&voice_pool, audio_voice_t);
+	if (voice == NULL)
+		return NULL;
+
+	voice->chunk = chunk;
+	voice->volume = (u8)volume;
+	voice->channel = Mix_PlayChannel(-1, (Mix_Chunk*)chunk, 0);
+	if (voice->channel < 0 || voice->channel >= BM_AUDIO_MAX_VOICES) {
+		pool_free(&voice_pool, voice);
+		return NULL;
+	}
+
+	// volume is per channel so instances of one chunk don't share it
+	Mix_Volume(voice->channel, volume);
+
+	// a very short sound may already have finished, and freed nothing
+	void* stale = SDL_AtomicSetPtr(&voice_channels[voice->channel], voice);
+	if (stale)
+		pool_free(&voice_pool, stale);
+
+	return voice;
+}
+
 void audio_shutdown()
 {
+	Mix_HaltChannel(-1);
+	Mix_ChannelFinished(NULL);
+	pool_log_stats(&voice_pool, "audio voices");
 	Mix_CloseAudio();
 }
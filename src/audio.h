@@ -5,6 +5,7 @@
 #define BM_NUM_AUDIO_CHANNELS 2
 #define BM_AUDIO_SAMPLE_RATE 44100
 #define BM_AUDIO_CHUNK_SIZE 4096
+#define BM_AUDIO_MAX_VOICES 32 // mixer channels
 
 typedef struct audio_chunk_s {
 	bool allocated;
@@ -13,6 +14,13 @@ typedef struct audio_chunk_s {
 	u8 volume; /* Per-sample volume, 0-128 */
 } audio_chunk_t;
 
+// A playing instance of a sound effect, alive until its channel finishes
+typedef struct audio_voice_s {
+	const audio_chunk_t* chunk;
+	s32 channel;
+	u8 volume;
+} audio_voice_t;
+
 typedef struct audio_state_s {
 	void* sfx;
 	void* music;
@@ -22,4 +30,5 @@ typedef struct audio_state_s {
 
 bool audio_init(s32 num_channels, s32 sample_rate, s32 chunk_size);
 bool audio_load_sound(const char* path, audio_chunk_t** data);
+audio_voice_t* audio_play_sound(const audio_chunk_t* chunk, s32 volume);
 void audio_shutdown();
@@ -90,21 +90,20 @@ void cmd_refresh(engine_t* eng)
 	// toggle fullscreen
 	static bool fullscreen = false;
 	cmd_toggle_bool(eng->inputs, kCommandToggleFullscreen, &fullscreen);
-	if (fullscreen != eng->fullscreen) {
-		eng->fullscreen = fullscreen;
+	if (fullscreen != (SDL_AtomicGet(&eng->fullscreen) != 0)) {
+		SDL_AtomicSet(&eng->fullscreen, fullscreen);
 		logger(LOG_DEBUG, "Fullscreen toggled: %d", fullscreen);
 	}
-	eng_toggle_fullscreen(eng, eng->fullscreen);
 
 	// toggle console
 	cmd_toggle_bool(eng->inputs, kCommandConsole, &eng->console);
 	if (eng->console) {
-		eng->mode = kEngineModeConsole;
+		SDL_AtomicSet(&eng->mode, kEngineModeConsole);
 		eng->inputs->mode = kInputModeConsole;
 	}
 
 	if (cmd_get_state(eng->inputs, kCommandQuit))
-		eng->mode = kEngineModeQuit;
+		SDL_AtomicSet(&eng->mode, kEngineModeQuit);
 	if (cmd_get_state(eng->inputs, kCommandSetFpsHigh) == true)
 		eng->target_frametime = FRAME_TIME(eng->target_fps);
 	if (cmd_get_state(eng->inputs, kCommandSetFpsLow) == true)
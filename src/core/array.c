@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/array.h"
+#include "core/logger.h"
+#include "math/utils.h"
+
+#define ARRAY_MIN_CAPACITY 8
+
+bool array_grow(void** data, size_t* capacity, size_t num_elems,
+		size_t elem_size, size_t align, size_t min_capacity,
+		const void* inline_elems, const array_allocator_t* alloc)
+{
+	size_t new_cap = MAX(*capacity * 2, ARRAY_MIN_CAPACITY);
+	new_cap = MAX(new_cap, min_capacity);
+
+	const size_t old_size = elem_size * (*capacity);
+	const size_t new_size = elem_size * new_cap;
+	const bool is_inline = *data == NULL || *data == inline_elems;
+
+	void* ptr = NULL;
+	if (alloc->arena) {
+		// the inline buffer isn't arena memory, never resize it
+		ptr = arena_resize(alloc->arena, is_inline ? NULL : *data,
+				   is_inline ? 0 : old_size, new_size, align,
+				   alloc->tag);
+		if (ptr && is_inline && num_elems)
+			memcpy(ptr, *data, elem_size * num_elems);
+	} else if (is_inline) {
+		ptr = bm_malloc_tagged(new_size, alloc->tag);
+		if (ptr && num_elems)
+			memcpy(ptr, *data, elem_size * num_elems);
+	} else {
+		ptr = bm_realloc(*data, new_size);
+	}
+
+	if (ptr == NULL) {
+		logger(LOG_ERROR, "array_grow - failed to grow to %zu bytes\n",
+		       new_size);
+		return false;
+	}
+
+	*data = ptr;
+	*capacity = new_cap;
+
+	return true;
+}
+
+void array_release(void* data, const void* inline_elems,
+		   const array_allocator_t* alloc)
+{
+	// arena memory goes away with its arena
+	if (data && data != inline_elems && alloc->arena == NULL)
+		bm_free(data);
+}
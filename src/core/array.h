@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+#include "core/memory.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Typed dynamic arrays, generated per element type:
+//
+//     BM_ARRAY_DEFINE(entity_handle, entity_handle_t, 8)
+//
+//     BM_ARRAY(entity_handle) handles;
+//     array_entity_handle_init(&handles, array_allocator_heap(kMemTagEntities));
+//     array_entity_handle_push(&handles, h);
+//     ...
+//     array_entity_handle_free(&handles);
+//
+// The first inline_cap elements live inside the array itself and never touch
+// an allocator, so an array must not be copied by value once initialized.
+// Growth doubles the capacity through bm_realloc, or grows in place when the
+// array is the most recent allocation in its arena.
+
+typedef struct array_allocator_s {
+	arena_t* arena; // NULL for the heap
+	mem_tag_t tag;
+} array_allocator_t;
+
+static inline array_allocator_t array_allocator_heap(mem_tag_t tag)
+{
+	array_allocator_t alloc = {NULL, tag};
+	return alloc;
+}
+
+static inline array_allocator_t array_allocator_arena(arena_t* arena,
+						      mem_tag_t tag)
+{
+	array_allocator_t alloc = {arena, tag};
+	return alloc;
+}
+
+// Per-frame scratch, only valid on the sim thread until the next frame
+static inline array_allocator_t array_allocator_scratch(void)
+{
+	array_allocator_t alloc = {&g_frame_arena, kMemTagScratch};
+	return alloc;
+}
+
+bool array_grow(void** data, size_t* capacity, size_t num_elems,
+		size_t elem_size, size_t align, size_t min_capacity,
+		const void* inline_elems, const array_allocator_t* alloc);
+void array_release(void* data, const void* inline_elems,
+		   const array_allocator_t* alloc);
+
+#define BM_ARRAY(name) array_##name##_t
+
+#define BM_ARRAY_INLINE_SLOTS(inline_cap) ((inline_cap) > 0 ? (inline_cap) : 1)
+
+#define BM_ARRAY_DEFINE(name, type, inline_cap)                               \
+	typedef struct array_##name##_s {                                     \
+		type* data;                                                   \
+		size_t num_elems;                                             \
+		size_t capacity;                                              \
+		array_allocator_t alloc;                                      \
+		type inline_elems[BM_ARRAY_INLINE_SLOTS(inline_cap)];         \
+	} array_##name##_t;                                                   \
+                                                                              \
+	static inline void array_##name##_init(array_##name##_t* arr,         \
+					       array_allocator_t alloc)       \
+	{                                                                     \
+		arr->data = (inline_cap) > 0 ? arr->inline_elems : NULL;      \
+		arr->num_elems = 0;                                           \
+		arr->capacity = (inline_cap);                                 \
+		arr->alloc = alloc;                                           \
+	}                                                                     \
+                                                                              \
+	static inline void array_##name##_free(array_##name##_t* arr)         \
+	{                                                                     \
+		array_release(arr->data, arr->inline_elems, &arr->alloc);     \
+		array_##name##_init(arr, arr->alloc);                         \
+	}                                                                     \
+                                                                              \
+	static inline bool array_##name##_reserve(array_##name##_t* arr,      \
+						  size_t capacity)            \
+	{                                                                     \
+		if (capacity <= arr->capacity)                                \
+			return true;                                          \
+		return array_grow((void**)&arr->data, &arr->capacity,         \
+				  arr->num_elems, sizeof(type),               \
+				  _Alignof(type), capacity,                   \
+				  arr->inline_elems, &arr->alloc);            \
+	}                                                                     \
+                                                                              \
+	static inline type* array_##name##_push(array_##name##_t* arr,        \
+						type value)                   \
+	{                                                                     \
+		if (arr->num_elems == arr->capacity &&                        \
+		    !array_##name##_reserve(arr, arr->num_elems + 1))         \
+			return NULL;                                          \
+		arr->data[arr->num_elems] = value;                            \
+		return &arr->data[arr->num_elems++];                          \
+	}                                                                     \
+                                                                              \
+	static inline type array_##name##_pop(array_##name##_t* arr)          \
+	{                                                                     \
+		assert(arr->num_elems > 0);                                   \
+		return arr->data[--arr->num_elems];                           \
+	}                                                                     \
+                                                                              \
+	static inline type* array_##name##_at(const array_##name##_t* arr,    \
+					      size_t index)                   \
+	{                                                                     \
+		assert(index < arr->num_elems);                               \
+		return &arr->data[index];                                     \
+	}                                                                     \
+                                                                              \
+	static inline void array_##name##_remove_swap(array_##name##_t* arr,  \
+						      size_t index)           \
+	{                                                                     \
+		assert(index < arr->num_elems);                               \
+		arr->data[index] = arr->data[--arr->num_elems];               \
+	}                                                                     \
+                                                                              \
+	static inline void array_##name##_clear(array_##name##_t* arr)        \
+	{                                                                     \
+		arr->num_elems = 0;                                           \
+	}
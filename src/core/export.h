@@ -4,9 +4,13 @@
 #ifdef _MSC_VER
 #define BM_EXPORT __declspec(dllexport)
 #define BM_FORCE_INLINE __forceinline
+#define BM_THREAD_LOCAL __declspec(thread)
+#define BM_NOINLINE __declspec(noinline)
 #else
 #define BM_EXPORT
 #define BM_FORCE_INLINE inline __attribute__((always_inline))
+#define BM_THREAD_LOCAL __thread
+#define BM_NOINLINE __attribute__((noinline))
 #endif
 
 #endif
@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/hashmap.h"
+#include "core/memory.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+	(defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HASHMAP_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define HASHMAP_MIN_CAPACITY HASHMAP_GROUP_SIZE
+
+// control bytes, full slots hold the low 7 bits of the hash
+#define CTRL_EMPTY ((u8)0x80)
+#define CTRL_DELETED ((u8)0xfe)
+
+// FNV-1a
+u32 hashmap_hash_string(const char* key)
+{
+	u32 hash = 2166136261u;
+	while (*key) {
+		hash ^= (u8)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// FNV-1a's low bits are poor, spread them before splitting into h1/h2
+static inline u32 hashmap_mix(u64 x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return (u32)x;
+}
+
+static inline u8 hashmap_h2(u32 hash)
+{
+	return (u8)(hash & 0x7f);
+}
+
+static inline size_t hashmap_h1(u32 hash)
+{
+	return (size_t)(hash >> 7);
+}
+
+static inline u32 hashmap_ctz(u32 mask)
+{
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, mask);
+	return (u32)idx;
+#else
+	return (u32)__builtin_ctz(mask);
+#endif
+}
+
+// bit i set when group byte i equals value
+static inline u32 group_match(const u8* group, u8 value)
+{
+#if defined(HASHMAP_SSE2)
+	const __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (u32)_mm_movemask_epi8(
+		_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)value)));
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASHMAP_GROUP_SIZE; i++)
+		mask |= (u32)(group[i] == value) << i;
+	return mask;
+#endif
+}
+
+// bit i set when group byte i is empty or deleted (high bit set)
+static inline u32 group_match_free(const u8* group)
+{
+#if defined(HASHMAP_SSE2)
+	const __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+	return (u32)_mm_movemask_epi8(ctrl);
+#else
+	u32 mask = 0;
+	for (u32 i = 0; i < HASHMAP_GROUP_SIZE; i++)
+		mask |= (u32)(group[i] >> 7) << i;
+	return mask;
+#endif
+}
+
+static inline bool hashmap_key_equal(const hashmap_t* map,
+				     const hashmap_entry_t* entry, u64 key)
+{
+	if (entry->key == key)
+		return true;
+	return map->key_kind == kHashmapKeyString &&
+	       !strcmp((const char*)(uintptr_t)entry->key,
+		       (const char*)(uintptr_t)key);
+}
+
+static inline size_t hashmap_max_load(size_t capacity)
+{
+	return capacity - capacity / 8; // 7/8
+}
+
+void hashmap_init(hashmap_t* map, hashmap_key_t key_kind, arena_t* arena,
+		  mem_tag_t tag)
+{
+	memset(map, 0, sizeof(hashmap_t));
+	map->key_kind = key_kind;
+	map->arena = arena;
+	map->tag = tag;
+}
+
+void hashmap_create(hashmap_t* map)
+{
+	hashmap_init(map, kHashmapKeyString, NULL, kMemTagGeneral);
+}
+
+static void hashmap_free_storage(hashmap_t* map)
+{
+	// arena storage is reclaimed with the arena
+	if (map->arena == NULL)
+		bm_free(map->ctrl);
+	map->ctrl = NULL;
+	map->entries = NULL;
+}
+
+void hashmap_destroy(hashmap_t* map)
+{
+	hashmap_free_storage(map);
+	map->capacity = 0;
+	map->count = 0;
+	map->growth_left = 0;
+}
+
+void hashmap_clear(hashmap_t* map)
+{
+	if (map->capacity == 0)
+		return;
+	memset(map->ctrl, CTRL_EMPTY, map->capacity);
+	map->count = 0;
+	map->growth_left = hashmap_max_load(map->capacity);
+}
+
+// Probe groups until one has a free slot, which is where hash is inserted
+static size_t hashmap_find_free(const hashmap_t* map, u32 hash)
+{
+	const size_t group_mask = map->capacity / HASHMAP_GROUP_SIZE - 1;
+	size_t group = hashmap_h1(hash) & group_mask;
+	for (size_t step = 1;; step++) {
+		const u8* ctrl = map->ctrl + group * HASHMAP_GROUP_SIZE;
+		const u32 free_mask = group_match_free(ctrl);
+		if (free_mask)
+			return group * HASHMAP_GROUP_SIZE + hashmap_ctz(free_mask);
+		// triangular steps visit every group of a power of two table
+		group = (group + step) & group_mask;
+	}
+}
+
+static bool hashmap_resize(hashmap_t* map, size_t capacity)
+{
+	u8* old_ctrl = map->ctrl;
+	hashmap_entry_t* old_entries = map->entries;
+	const size_t old_capacity = map->capacity;
+
+	const size_t sz_ctrl = capacity;
+	const size_t sz_block = sz_ctrl + sizeof(hashmap_entry_t) * capacity;
+	u8* block = map->arena ? (u8*)arena_alloc_tagged(map->arena, sz_block,
+							  DEFAULT_ALIGNMENT,
+							  map->tag)
+			       : (u8*)bm_malloc_tagged(sz_block, map->tag);
+	if (block == NULL)
+		return false;
+
+	map->ctrl = block;
+	map->entries = (hashmap_entry_t*)(block + sz_ctrl);
+	map->capacity = capacity;
+	memset(map->ctrl, CTRL_EMPTY, capacity);
+
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old_ctrl[i] & 0x80)
+			continue; // empty or deleted
+		const hashmap_entry_t* entry = &old_entries[i];
+		const size_t idx = hashmap_find_free(map, entry->hash);
+		map->ctrl[idx] = hashmap_h2(entry->hash);
+		map->entries[idx] = *entry;
+	}
+	map->growth_left = hashmap_max_load(capacity) - map->count;
+
+	if (old_ctrl && map->arena == NULL)
+		bm_free(old_ctrl);
+
+	return true;
+}
+
+static hashmap_entry_t* hashmap_lookup(const hashmap_t* map, u64 key,
+				       u32 hash)
+{
+	if (map->count == 0)
+		return NULL;
+
+	const u8 h2 = hashmap_h2(hash);
+	const size_t group_mask = map->capacity / HASHMAP_GROUP_SIZE - 1;
+	size_t group = hashmap_h1(hash) & group_mask;
+	for (size_t step = 1;; step++) {
+		const size_t base = group * HASHMAP_GROUP_SIZE;
+		const u8* ctrl = map->ctrl + base;
+		for (u32 match = group_match(ctrl, h2); match;
+		     match &= match - 1) {
+			hashmap_entry_t* entry =
+				&map->entries[base + hashmap_ctz(match)];
+			if (entry->hash == hash &&
+			    hashmap_key_equal(map, entry, key))
+				return entry;
+		}
+		// a group with an empty slot ends every probe through it
+		if (group_match(ctrl, CTRL_EMPTY))
+			return NULL;
+		group = (group + step) & group_mask;
+	}
+}
+
+static void hashmap_insert_hashed(hashmap_t* map, u64 key, u32 hash,
+				  void* elem)
+{
+	hashmap_entry_t* entry = hashmap_lookup(map, key, hash);
+	if (entry) {
+		entry->elem = elem;
+		return;
+	}
+
+	if (map->capacity == 0 &&
+	    !hashmap_resize(map, HASHMAP_MIN_CAPACITY))
+		return;
+
+	size_t idx = hashmap_find_free(map, hash);
+	if (map->ctrl[idx] == CTRL_EMPTY && map->growth_left == 0) {
+		// mostly tombstones: rebuild at the same size, else grow
+		const size_t capacity =
+			map->count * 2 < hashmap_max_load(map->capacity)
+				? map->capacity
+				: map->capacity * 2;
+		if (!hashmap_resize(map, capacity))
+			return;
+		idx = hashmap_find_free(map, hash);
+	}
+
+	if (map->ctrl[idx] == CTRL_EMPTY)
+		map->growth_left--;
+	map->ctrl[idx] = hashmap_h2(hash);
+	map->entries[idx].key = key;
+	map->entries[idx].elem = elem;
+	map->entries[idx].hash = hash;
+	map->count++;
+}
+
+static void hashmap_erase(hashmap_t* map, hashmap_entry_t* entry)
+{
+	const size_t idx = (size_t)(entry - map->entries);
+	const u8* group =
+		map->ctrl + (idx & ~(size_t)(HASHMAP_GROUP_SIZE - 1));
+
+	// A group that still has an empty slot has never been full, so no
+	// probe ever continued past it and the slot can simply be emptied.
+	if (group_match(group, CTRL_EMPTY)) {
+		map->ctrl[idx] = CTRL_EMPTY;
+		map->growth_left++;
+	} else {
+		map->ctrl[idx] = CTRL_DELETED;
+	}
+	map->count--;
+}
+
+void hashmap_insert(hashmap_t* map, const char* key, void* elem)
+{
+	assert(map->key_kind == kHashmapKeyString);
+	hashmap_insert_hashed(map, (u64)(uintptr_t)key,
+			      hashmap_mix(hashmap_hash_string(key)), elem);
+}
+
+void hashmap_remove(hashmap_t* map, const char* key)
+{
+	assert(map->key_kind == kHashmapKeyString);
+	hashmap_entry_t* entry =
+		hashmap_lookup(map, (u64)(uintptr_t)key,
+			       hashmap_mix(hashmap_hash_string(key)));
+	if (entry)
+		hashmap_erase(map, entry);
+}
+
+bool hashmap_find_hashed(hashmap_t* map, const char* key, u32 hash,
+			 void** elem)
+{
+	assert(map->key_kind == kHashmapKeyString);
+	const hashmap_entry_t* entry =
+		hashmap_lookup(map, (u64)(uintptr_t)key, hashmap_mix(hash));
+	if (entry == NULL)
+		return false;
+
+	if (elem)
+		*elem = entry->elem;
+
+	return true;
+}
+
+bool hashmap_find(hashmap_t* map, const char* key, void** elem)
+{
+	return hashmap_find_hashed(map, key, hashmap_hash_string(key), elem);
+}
+
+void hashmap_insert_int(hashmap_t* map, u64 key, void* elem)
+{
+	assert(map->key_kind == kHashmapKeyInt);
+	hashmap_insert_hashed(map, key, hashmap_mix(key), elem);
+}
+
+void hashmap_remove_int(hashmap_t* map, u64 key)
+{
+	assert(map->key_kind == kHashmapKeyInt);
+	hashmap_entry_t* entry = hashmap_lookup(map, key, hashmap_mix(key));
+	if (entry)
+		hashmap_erase(map, entry);
+}
+
+bool hashmap_find_int(hashmap_t* map, u64 key, void** elem)
+{
+	assert(map->key_kind == kHashmapKeyInt);
+	const hashmap_entry_t* entry =
+		hashmap_lookup(map, key, hashmap_mix(key));
+	if (entry == NULL)
+		return false;
+
+	if (elem)
+		*elem = entry->elem;
+
+	return true;
+}
@@ -1,12 +1,61 @@
 #ifndef H_BM_HASHMAP
 #define H_BM_HASHMAP
 
-typedef struct hashmap hashmap_t;
+#include "core/types.h"
+#include "core/memory.h"
 
+// Swiss table style open addressing hash map. Every slot has a control byte
+// holding 7 bits of its key's hash, and lookups compare a whole group of 16
+// control bytes at once (SSE2 where available), only touching keys whose
+// hash bits match.
+//
+// Keys are either C strings, which are not copied and must outlive the map,
+// or 64-bit integers such as interned string ids. Deleting from a group that
+// still has an empty slot frees the slot outright; only groups that have
+// filled up need a tombstone, and those are cleared the next time the table
+// is rebuilt.
+
+#define HASHMAP_GROUP_SIZE 16
+
+typedef enum {
+	kHashmapKeyString,
+	kHashmapKeyInt,
+} hashmap_key_t;
+
+typedef struct hashmap_entry_s {
+	u64 key; // string pointer or integer
+	void* elem;
+	u32 hash;
+} hashmap_entry_t;
+
+typedef struct hashmap {
+	u8* ctrl;
+	hashmap_entry_t* entries;
+	size_t capacity; // power of two, at least one group
+	size_t count;
+	size_t growth_left; // empty slots that may be filled before a rebuild
+	hashmap_key_t key_kind;
+	arena_t* arena; // NULL for the heap
+	mem_tag_t tag;
+} hashmap_t;
+
+u32 hashmap_hash_string(const char* key);
+
+// heap backed, string keys
 void hashmap_create(hashmap_t* map);
+void hashmap_init(hashmap_t* map, hashmap_key_t key_kind, arena_t* arena,
+		  mem_tag_t tag);
 void hashmap_destroy(hashmap_t* map);
+void hashmap_clear(hashmap_t* map);
+
 void hashmap_insert(hashmap_t* map, const char* key, void* elem);
 void hashmap_remove(hashmap_t* map, const char* key);
-void hashmap_find(hashmap_t* map, const char* key, void** elem);
+bool hashmap_find(hashmap_t* map, const char* key, void** elem);
+bool hashmap_find_hashed(hashmap_t* map, const char* key, u32 hash,
+			 void** elem);
+
+void hashmap_insert_int(hashmap_t* map, u64 key, void* elem);
+void hashmap_remove_int(hashmap_t* map, u64 key);
+bool hashmap_find_int(hashmap_t* map, u64 key, void** elem);
 
 #endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/intern.h"
+#include "core/hashmap.h"
+#include "core/logger.h"
+#include "core/memory.h"
+#include "platform/platform.h"
+
+#include <string.h>
+
+typedef struct intern_table_s {
+	arena_t strings; // string bytes, never moves
+	arena_t ids; // id -> string pointer, never moves
+	const char** lookup;
+	volatile long count;
+	hashmap_t map; // string -> id
+	volatile long lock;
+} intern_table_t;
+
+static intern_table_t g_intern = {0};
+
+static void intern_lock(void)
+{
+	while (!os_atomic_compare_swap_long(&g_intern.lock, 0, 1))
+		;
+}
+
+static void intern_unlock(void)
+{
+	os_atomic_set_long(&g_intern.lock, 0);
+}
+
+bool intern_init(void)
+{
+	if (g_intern.lookup != NULL)
+		return true;
+
+	if (!arena_init_virtual(&g_intern.strings, INTERN_MAX_BYTES,
+				kArenaFlagsNone))
+		return false;
+	if (!arena_init_virtual(&g_intern.ids,
+				sizeof(const char*) * INTERN_MAX_STRINGS,
+				kArenaFlagsNone)) {
+		arena_release(&g_intern.strings);
+		return false;
+	}
+	// shared between threads under the intern lock
+	g_intern.strings.owner = 0;
+	g_intern.ids.owner = 0;
+
+	g_intern.lookup = (const char**)g_intern.ids.buffer;
+	hashmap_init(&g_intern.map, kHashmapKeyString, NULL, kMemTagGeneral);
+
+	// id 0 is the empty string
+	const char** slot = (const char**)arena_alloc_tagged(
+		&g_intern.ids, sizeof(const char*), sizeof(const char*),
+		kMemTagGeneral);
+	*slot = "";
+	g_intern.count = 1;
+
+	return true;
+}
+
+void intern_shutdown(void)
+{
+	logger(LOG_INFO, "intern_shutdown - %ld strings, %zu bytes\n",
+	       g_intern.count, g_intern.strings.curr_offset);
+	hashmap_destroy(&g_intern.map);
+	arena_release(&g_intern.ids);
+	arena_release(&g_intern.strings);
+	memset(&g_intern, 0, sizeof(intern_table_t));
+}
+
+str_id_t intern(const char* str)
+{
+	if (str == NULL || *str == '\0')
+		return STR_ID_NONE;
+
+	const u32 hash = hashmap_hash_string(str);
+
+	intern_lock();
+	void* elem = NULL;
+	if (hashmap_find_hashed(&g_intern.map, str, hash, &elem)) {
+		intern_unlock();
+		return (str_id_t)(uintptr_t)elem;
+	}
+
+	const size_t len = strlen(str) + 1;
+	char* copy = (char*)arena_alloc_tagged(&g_intern.strings, len, 1,
+					       kMemTagGeneral);
+	const char** slot = (const char**)arena_alloc_tagged(
+		&g_intern.ids, sizeof(const char*), sizeof(const char*),
+		kMemTagGeneral);
+	if (copy == NULL || slot == NULL) {
+		intern_unlock();
+		logger(LOG_ERROR, "intern - table is full\n");
+		return STR_ID_NONE;
+	}
+	memcpy(copy, str, len);
+	*slot = copy;
+
+	const str_id_t id = (str_id_t)g_intern.count;
+	hashmap_insert(&g_intern.map, copy, (void*)(uintptr_t)id);
+	// publish after the slot is written so intern_str needs no lock
+	os_atomic_inc_long(&g_intern.count);
+	intern_unlock();
+
+	return id;
+}
+
+str_id_t intern_find(const char* str)
+{
+	if (str == NULL || *str == '\0')
+		return STR_ID_NONE;
+
+	intern_lock();
+	void* elem = NULL;
+	const bool found = hashmap_find(&g_intern.map, str, &elem);
+	intern_unlock();
+
+	return found ? (str_id_t)(uintptr_t)elem : STR_ID_NONE;
+}
+
+const char* intern_str(str_id_t id)
+{
+	if (id >= (str_id_t)os_atomic_load_long(&g_intern.count))
+		return "";
+	return g_intern.lookup[id];
+}
+
+u32 intern_count(void)
+{
+	return (u32)os_atomic_load_long(&g_intern.count);
+}
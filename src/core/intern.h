@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+// Global string intern table. Each distinct string gets a stable 32-bit id,
+// so names can be stored and compared as integers. Interned strings are
+// never freed and their pointers stay valid until intern_shutdown.
+//
+// intern and intern_find are safe from any thread; intern_str is lock free.
+
+typedef u32 str_id_t;
+
+#define STR_ID_NONE 0 // the empty string / no name
+#define INTERN_MAX_STRINGS 1048576
+#define INTERN_MAX_BYTES 67108864 // 64MiB of address space
+
+bool intern_init(void);
+void intern_shutdown(void);
+
+// Interns str and returns its id, STR_ID_NONE for NULL or ""
+str_id_t intern(const char* str);
+// Returns the id of str if it was interned, STR_ID_NONE otherwise
+str_id_t intern_find(const char* str);
+const char* intern_str(str_id_t id);
+u32 intern_count(void);
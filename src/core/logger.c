@@ -1,8 +1,65 @@
 #include "core/logger.h"
+#include "core/queue.h"
+#include "core/types.h"
+
+#include "platform/platform.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+// Messages are queued in a bounded MPMC queue as level, timestamp, format
+// pointer and the raw argument bytes. A background thread formats and
+// writes them, so callers never touch stdio once the logger is running.
+// Arguments that can't be packed are formatted by the caller and queued
+// as text, truncated to fit a record. When the ring is full the caller
+// waits for the writer, so a thread's messages keep their order.
+
+#define LOG_RING_SIZE 1024 // must be a power of two
+#define LOG_ARGS_SIZE 240
+#define LOG_MSG_MAX 4096
+#define LOG_IDLE_SLEEP_MS 2
+#define LOG_TRUNCATED "..."
+
+typedef enum {
+	kLogArgNone,
+	kLogArgInt,
+	kLogArgLong,
+	kLogArgLongLong,
+	kLogArgSize,
+	kLogArgIntMax,
+	kLogArgPtrDiff,
+	kLogArgDouble,
+	kLogArgLongDouble,
+	kLogArgPointer,
+	kLogArgString,
+	kLogArgUnsupported,
+} log_arg_kind_t;
+
+typedef struct log_spec_s {
+	const char* start; // the '%'
+	size_t len;
+	bool star_width;
+	bool star_precision;
+	log_arg_kind_t kind;
+} log_spec_t;
+
+typedef struct log_record_s {
+	enum LOG_LEVEL level;
+	u64 timestamp_ns;
+	const char* fmt; // NULL when args holds the preformatted message
+	size_t args_size;
+	u8 args[LOG_ARGS_SIZE];
+} log_record_t;
+
+static u8 log_ring[MPMC_QUEUE_BACKING_SIZE(sizeof(log_record_t),
+					  LOG_RING_SIZE)];
+static mpmc_queue_t log_queue;
+static volatile long log_written = 0;
+static volatile long log_running = 0;
+static os_thread_t* log_thread = NULL;
+static volatile s64 log_thread_id = 0;
+static u64 log_start_ns = 0;
+
 static void* g_log_param = NULL;
 
 static void default_log_handler(enum LOG_LEVEL level, const char* fmt,
@@ -10,38 +67,534 @@ static void default_log_handler(enum LOG_LEVEL level, const char* fmt,
 {
 	(void)param;
 
-	char msg[4096];
+	char msg[LOG_MSG_MAX];
 	vsnprintf(msg, sizeof(msg), fmt, args);
 	switch (level) {
 	case LOG_DEBUG:
-#ifdef BM_DEBUG
 		fprintf(stdout, "debug: %s\n", msg);
-		fflush(stdout);
-#endif
 		break;
 	case LOG_INFO:
 		fprintf(stdout, "info: %s\n", msg);
-		fflush(stdout);
 		break;
 	case LOG_WARNING:
 		fprintf(stdout, "warning: %s\n", msg);
-		fflush(stdout);
 		break;
 	case LOG_ERROR:
 		fprintf(stdout, "error: %s\n", msg);
-		fflush(stdout);
 		break;
 	}
 }
 
 static log_handler_t g_log_handler = default_log_handler;
 
-void log_va(enum LOG_LEVEL level, const char* fmt, va_list args)
+void get_log_handler(log_handler_t* handler, void** params)
+{
+	if (handler)
+		*handler = g_log_handler;
+	if (params)
+		*params = g_log_param;
+}
+
+void set_log_handler(log_handler_t* handler, void* param)
 {
+	g_log_handler = handler ? *handler : default_log_handler;
+	g_log_param = param;
+}
+
+static void log_dispatch(enum LOG_LEVEL level, const char* fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
 	g_log_handler(level, fmt, args, g_log_param);
+	va_end(args);
+}
+
+// Parses one conversion spec, p points just past the '%'
+static const char* log_parse_spec(const char* p, log_spec_t* spec)
+{
+	spec->start = p - 1;
+	spec->star_width = false;
+	spec->star_precision = false;
+	spec->kind = kLogArgUnsupported;
+
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+		p++;
+	if (*p == '*') {
+		spec->star_width = true;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9')
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			spec->star_precision = true;
+			p++;
+		}
+		while (*p >= '0' && *p <= '9')
+			p++;
+	}
+
+	log_arg_kind_t int_kind = kLogArgInt;
+	bool long_double = false;
+	bool wide = false;
+	switch (*p) {
+	case 'h':
+		p++;
+		if (*p == 'h')
+			p++;
+		break;
+	case 'l':
+		p++;
+		int_kind = kLogArgLong;
+		wide = true;
+		if (*p == 'l') {
+			p++;
+			int_kind = kLogArgLongLong;
+		}
+		break;
+	case 'z':
+		p++;
+		int_kind = kLogArgSize;
+		break;
+	case 'j':
+		p++;
+		int_kind = kLogArgIntMax;
+		break;
+	case 't':
+		p++;
+		int_kind = kLogArgPtrDiff;
+		break;
+	case 'L':
+		p++;
+		long_double = true;
+		break;
+	}
+
+	switch (*p) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		spec->kind = int_kind;
+		break;
+	case 'c':
+		spec->kind = wide ? kLogArgUnsupported : kLogArgInt;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		spec->kind = long_double ? kLogArgLongDouble : kLogArgDouble;
+		break;
+	case 'p':
+		spec->kind = kLogArgPointer;
+		break;
+	case 's':
+		spec->kind = wide ? kLogArgUnsupported : kLogArgString;
+		break;
+	case '%':
+		spec->kind = kLogArgNone;
+		break;
+	}
+
+	if (*p != '\0')
+		p++;
+	spec->len = (size_t)(p - spec->start);
+
+	return p;
+}
+
+#define LOG_PACK(type, value)                                      \
+	do {                                                       \
+		type v_ = (value);                                 \
+		if (size + sizeof(type) > LOG_ARGS_SIZE)           \
+			return false;                              \
+		memcpy(&rec->args[size], &v_, sizeof(type));       \
+		size += sizeof(type);                              \
+	} while (0)
+
+// Copies the arguments the format string consumes into the record.
+// Returns false if they don't fit or use an unsupported conversion.
+static bool log_pack_args(log_record_t* rec, const char* fmt, va_list args)
+{
+	size_t size = 0;
+	log_spec_t spec;
+	for (const char* p = fmt; *p != '\0';) {
+		if (*p++ != '%')
+			continue;
+		p = log_parse_spec(p, &spec);
+		if (spec.kind == kLogArgUnsupported)
+			return false;
+		if (spec.star_width)
+			LOG_PACK(int, va_arg(args, int));
+		if (spec.star_precision)
+			LOG_PACK(int, va_arg(args, int));
+
+		switch (spec.kind) {
+		case kLogArgInt:
+			LOG_PACK(int, va_arg(args, int));
+			break;
+		case kLogArgLong:
+			LOG_PACK(long, va_arg(args, long));
+			break;
+		case kLogArgLongLong:
+			LOG_PACK(long long, va_arg(args, long long));
+			break;
+		case kLogArgSize:
+			LOG_PACK(size_t, va_arg(args, size_t));
+			break;
+		case kLogArgIntMax:
+			LOG_PACK(intmax_t, va_arg(args, intmax_t));
+			break;
+		case kLogArgPtrDiff:
+			LOG_PACK(ptrdiff_t, va_arg(args, ptrdiff_t));
+			break;
+		case kLogArgDouble:
+			LOG_PACK(double, va_arg(args, double));
+			break;
+		case kLogArgLongDouble:
+			LOG_PACK(long double, va_arg(args, long double));
+			break;
+		case kLogArgPointer:
+			LOG_PACK(void*, va_arg(args, void*));
+			break;
+		case kLogArgString: {
+			// the caller's string may not outlive the call, copy it
+			const char* str = va_arg(args, const char*);
+			if (str == NULL)
+				str = "(null)";
+			const size_t len = strlen(str) + 1;
+			if (size + len > LOG_ARGS_SIZE)
+				return false;
+			memcpy(&rec->args[size], str, len);
+			size += len;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	rec->args_size = size;
+
+	return true;
+}
+
+#define LOG_UNPACK(type, out)                                \
+	do {                                                 \
+		memcpy(&(out), &rec->args[size], sizeof(type)); \
+		size += sizeof(type);                        \
+	} while (0)
+
+// Re-walks the format string and prints one conversion at a time with
+// the matching unpacked argument.
+static void log_format(const log_record_t* rec, char* msg, size_t msg_size)
+{
+	size_t size = 0;
+	size_t out = 0;
+	log_spec_t spec;
+	for (const char* p = rec->fmt; *p != '\0' && out + 1 < msg_size;) {
+		if (*p != '%') {
+			msg[out++] = *p++;
+			continue;
+		}
+		p = log_parse_spec(p + 1, &spec);
+
+		// rebuild the spec with '*' replaced by the packed values
+		char spec_fmt[64];
+		size_t spec_len = 0;
+		for (size_t i = 0;
+		     i < spec.len && spec_len + 12 < sizeof(spec_fmt); i++) {
+			if (spec.start[i] == '*') {
+				int star = 0;
+				LOG_UNPACK(int, star);
+				spec_len += snprintf(&spec_fmt[spec_len],
+						     sizeof(spec_fmt) - spec_len,
+						     "%d", star);
+			} else {
+				spec_fmt[spec_len++] = spec.start[i];
+			}
+		}
+		spec_fmt[spec_len] = '\0';
+
+		char* dst = &msg[out];
+		const size_t avail = msg_size - out;
+		int written = 0;
+		switch (spec.kind) {
+		case kLogArgNone:
+			written = snprintf(dst, avail, "%%");
+			break;
+		case kLogArgInt: {
+			int v;
+			LOG_UNPACK(int, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgLong: {
+			long v;
+			LOG_UNPACK(long, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgLongLong: {
+			long long v;
+			LOG_UNPACK(long long, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgSize: {
+			size_t v;
+			LOG_UNPACK(size_t, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgIntMax: {
+			intmax_t v;
+			LOG_UNPACK(intmax_t, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgPtrDiff: {
+			ptrdiff_t v;
+			LOG_UNPACK(ptrdiff_t, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgDouble: {
+			double v;
+			LOG_UNPACK(double, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgLongDouble: {
+			long double v;
+			LOG_UNPACK(long double, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgPointer: {
+			void* v;
+			LOG_UNPACK(void*, v);
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		case kLogArgString: {
+			const char* v = (const char*)&rec->args[size];
+			size += strlen(v) + 1;
+			written = snprintf(dst, avail, spec_fmt, v);
+			break;
+		}
+		default:
+			break;
+		}
+
+		if (written > 0)
+			out += (size_t)written < avail ? (size_t)written
+						       : avail - 1;
+	}
+	msg[out] = '\0';
+}
+
+static void log_write_text(enum LOG_LEVEL level, u64 timestamp_ns,
+			   const char* text)
+{
+	const f64 elapsed = (f64)(timestamp_ns - log_start_ns) / 1000000000.0;
+	log_dispatch(level, "[%10.6f] %s", elapsed, text);
+}
+
+static void log_write_record(const log_record_t* rec)
+{
+	char msg[LOG_MSG_MAX];
+	const char* text = (const char*)rec->args;
+	if (rec->fmt != NULL) {
+		log_format(rec, msg, sizeof(msg));
+		text = msg;
+	}
+
+	log_write_text(rec->level, rec->timestamp_ns, text);
+}
+
+static bool log_dequeue(void)
+{
+	long ticket = 0;
+	log_record_t* rec =
+		(log_record_t*)mpmc_queue_pop_begin(&log_queue, &ticket);
+	if (rec == NULL)
+		return false;
+
+	log_write_record(rec);
+
+	mpmc_queue_pop_commit(&log_queue, ticket);
+	os_atomic_inc_long(&log_written);
+
+	return true;
+}
+
+static s32 log_thread_main(void* param)
+{
+	(void)param;
+
+	os_thread_set_name("logger");
+	os_atomic_store_s64(&log_thread_id, (s64)os_thread_id());
+
+	while (os_atomic_load_long(&log_running)) {
+		bool wrote = false;
+		while (log_dequeue())
+			wrote = true;
+		if (wrote)
+			fflush(stdout);
+		else
+			os_sleep_ms(LOG_IDLE_SLEEP_MS);
+	}
+
+	while (log_dequeue())
+		;
+	fflush(stdout);
+
+	return 0;
+}
+
+void logger_init(void)
+{
+	if (os_atomic_load_long(&log_running))
+		return;
+
+	if (!mpmc_queue_init(&log_queue, log_ring, sizeof(log_ring),
+			     sizeof(log_record_t)))
+		return;
+	log_written = 0;
+	log_start_ns = os_get_time_ns();
+
+	os_atomic_set_long(&log_running, 1);
+	log_thread = os_thread_create(log_thread_main, NULL);
+	if (log_thread == NULL) {
+		os_atomic_set_long(&log_running, 0);
+		return;
+	}
+
+	atexit(logger_shutdown);
+}
+
+void logger_shutdown(void)
+{
+	if (!os_atomic_load_long(&log_running))
+		return;
+
+	os_atomic_set_long(&log_running, 0);
+	os_thread_join(log_thread);
+	log_thread = NULL;
+}
+
+void logger_flush(void)
+{
+	if (!os_atomic_load_long(&log_running)) {
+		fflush(stdout);
+		return;
+	}
+
+	// wait for the writer to get through everything queued so far
+	const long target = mpmc_queue_pushed(&log_queue);
+	while (os_atomic_load_long(&log_written) - target < 0)
+		os_sleep_ms(1);
+}
+
+void log_va(enum LOG_LEVEL level, const char* fmt, va_list args)
+{
+	if (!os_atomic_load_long(&log_running)) {
+		g_log_handler(level, fmt, args, g_log_param);
+		fflush(stdout);
+		return;
+	}
+
+	// packed on the stack so a full ring can be retried
+	log_record_t rec;
+	rec.level = level;
+	rec.timestamp_ns = os_get_time_ns();
+	rec.fmt = fmt;
+
+	va_list args_copy;
+	va_copy(args_copy, args);
+	const bool packed = log_pack_args(&rec, fmt, args_copy);
+	va_end(args_copy);
+	if (!packed) {
+		// too large or unsupported, format now and queue the text
+		const int len = vsnprintf((char*)rec.args, LOG_ARGS_SIZE, fmt,
+					  args);
+		if (len < 0) {
+			snprintf((char*)rec.args, LOG_ARGS_SIZE,
+				 "(bad log format) %s", fmt);
+		} else if (len >= LOG_ARGS_SIZE) {
+			memcpy(&rec.args[LOG_ARGS_SIZE - sizeof(LOG_TRUNCATED)],
+			       LOG_TRUNCATED, sizeof(LOG_TRUNCATED));
+		}
+		rec.args_size = strlen((const char*)rec.args) + 1;
+		rec.fmt = NULL;
+	}
+
+	// Ring is full, let the writer catch up rather than drop or write
+	// ahead of the queued messages. The writer itself (a handler that
+	// logs) and callers racing shutdown have nobody to wait for.
+	while (!mpmc_queue_push(&log_queue, &rec)) {
+		if (!os_atomic_load_long(&log_running) ||
+		    (u64)os_atomic_load_s64(&log_thread_id) == os_thread_id()) {
+			log_write_record(&rec);
+			return;
+		}
+		logger_flush();
+	}
+}
+
+bool log_site_sample(log_site_t* site, long first_n, long every_m,
+		     long* suppressed)
+{
+	const long n = os_atomic_inc_long(&site->count);
+	if (n <= first_n ||
+	    (every_m > 0 && (n - first_n) % every_m == 0)) {
+		*suppressed = os_atomic_exchange_long(&site->suppressed, 0);
+		return true;
+	}
+
+	os_atomic_inc_long(&site->suppressed);
+
+	return false;
+}
+
+bool log_site_rate_limit(log_site_t* site, long max_per_sec,
+			 long* suppressed)
+{
+	// one second windows, whoever moves the window resets the count
+	const long now = (long)(os_get_time_ns() / 1000000000ULL);
+	const long window = os_atomic_load_long(&site->window);
+	if (window != now &&
+	    os_atomic_compare_swap_long(&site->window, window, now))
+		os_atomic_set_long(&site->count, 0);
+
+	if (os_atomic_inc_long(&site->count) <= max_per_sec) {
+		*suppressed = os_atomic_exchange_long(&site->suppressed, 0);
+		return true;
+	}
+
+	os_atomic_inc_long(&site->suppressed);
+
+	return false;
+}
+
+void log_suppressed(enum LOG_LEVEL level, const char* file, int line,
+		    long suppressed)
+{
+	log_msg(level, "(%ld similar messages from %s:%d suppressed)\n",
+		suppressed, file, line);
 }
 
-void logger(enum LOG_LEVEL level, const char* fmt, ...)
+void log_msg(enum LOG_LEVEL level, const char* fmt, ...)
 {
 	va_list args;
 
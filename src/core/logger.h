@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdarg.h>
+#include <stdbool.h>
 
 enum LOG_LEVEL {
 	LOG_ERROR = 100,
@@ -9,12 +10,78 @@ enum LOG_LEVEL {
 	LOG_DEBUG = 400
 };
 
+// Messages above this level are compiled out entirely
+#ifndef BM_LOG_LEVEL
+#ifdef BM_DEBUG
+#define BM_LOG_LEVEL LOG_DEBUG
+#else
+#define BM_LOG_LEVEL LOG_INFO
+#endif
+#endif
+
 typedef void (*log_handler_t)(enum LOG_LEVEL level, const char* fmt,
 			      va_list args, void* param);
 
 void get_log_handler(log_handler_t* handler, void** params);
 void set_log_handler(log_handler_t* handler, void* param);
 
+// Start/stop the background writer. Before logger_init and after
+// logger_shutdown messages are written synchronously.
+void logger_init(void);
+void logger_shutdown(void);
+// Blocks until every queued message has been written
+void logger_flush(void);
+
 void log_va(enum LOG_LEVEL level, const char* fmt, va_list args);
+void log_msg(enum LOG_LEVEL level, const char* fmt, ...);
+
+#define logger(level, ...)                            \
+	do {                                          \
+		if ((level) <= BM_LOG_LEVEL)          \
+			log_msg((level), __VA_ARGS__); \
+	} while (0)
+
+// Per call site state for the sampled and rate limited loggers below
+typedef struct log_site_s {
+	volatile long count;
+	volatile long suppressed;
+	volatile long window;
+} log_site_t;
+
+bool log_site_sample(log_site_t* site, long first_n, long every_m,
+		     long* suppressed);
+bool log_site_rate_limit(log_site_t* site, long max_per_sec,
+			 long* suppressed);
+void log_suppressed(enum LOG_LEVEL level, const char* file, int line,
+		    long suppressed);
+
+// Logs the first first_n messages from this call site, then one in every
+// every_m. A sampled message is preceded by a count of what was skipped.
+#define logger_sampled(level, first_n, every_m, ...)                        \
+	do {                                                                \
+		static log_site_t log_site_ = {0, 0, 0};                    \
+		long log_suppressed_ = 0;                                   \
+		if ((level) <= BM_LOG_LEVEL &&                              \
+		    log_site_sample(&log_site_, (first_n), (every_m),       \
+				    &log_suppressed_)) {                    \
+			if (log_suppressed_ > 0)                            \
+				log_suppressed((level), __FILE__, __LINE__, \
+					       log_suppressed_);            \
+			log_msg((level), __VA_ARGS__);                      \
+		}                                                           \
+	} while (0)
 
-void logger(enum LOG_LEVEL level, const char* fmt, ...);
+// Logs at most max_per_sec messages per second from this call site
+#define logger_ratelimited(level, max_per_sec, ...)                         \
+	do {                                                                \
+		static log_site_t log_site_ = {0, 0, 0};                    \
+		long log_suppressed_ = 0;                                   \
+		if ((level) <= BM_LOG_LEVEL &&                              \
+		    log_site_rate_limit(&log_site_, (max_per_sec),          \
+					&log_suppressed_)) {                \
+			if (log_suppressed_ > 0)                            \
+				log_suppressed((level), __FILE__, __LINE__, \
+					       log_suppressed_);            \
+			log_msg((level), __VA_ARGS__);                      \
+		}                                                           \
+	} while (0)
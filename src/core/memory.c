@@ -16,44 +16,168 @@
 #include "core/logger.h"
 #include "core/memory.h"
 #include "core/mem_align.h"
+#include "math/utils.h"
 #include "platform/platform.h"
 
 #include <assert.h>
+#include <stdio.h>
+
+// Heap allocations carry a header recording their size and tag so frees
+// can be counted against the right tag
+typedef struct mem_header_s {
+	size_t size;
+	mem_tag_t tag;
+} mem_header_t;
+
+#define MEM_HEADER_BYTES DEFAULT_ALIGNMENT
 
-static uint64_t g_num_allocations = 0;
-static uint64_t g_bytes_allocated = 0;
 static struct memory_allocator gAllocator = { malloc, realloc, free };
+static mem_tag_stats_t g_mem_tags[kMemTagCount];
+
+static const char* kMemTagNames[kMemTagCount] = {
+	"general", "entities", "assets", "audio", "render", "scratch",
+};
 
 size_t arena_allocated_bytes = 0;
-u8* arena_buf = NULL;
-arena_t g_mem_arena = {NULL, 0, 0, 0};
+arena_t g_mem_arena = {NULL, 0, 0, 0, 0, kArenaFlagsNone};
+arena_t g_frame_arena = {NULL, 0, 0, 0, 0, kArenaFlagsNone};
+
+static BM_THREAD_LOCAL arena_t tl_scratch_arena;
+
+static void mem_update_peak(volatile long* peak, long bytes)
+{
+	long curr = os_atomic_load_long(peak);
+	while (bytes > curr) {
+		if (os_atomic_compare_swap_long(peak, curr, bytes))
+			break;
+		curr = os_atomic_load_long(peak);
+	}
+}
 
+static void mem_track_heap(mem_tag_t tag, long bytes)
+{
+	mem_tag_stats_t* stats = &g_mem_tags[tag];
+	long live = os_atomic_add_long(&stats->heap_bytes, bytes);
+	if (bytes > 0)
+		mem_update_peak(&stats->heap_peak, live);
+}
+
+static void mem_track_arena(mem_tag_t tag, long bytes)
+{
+	mem_tag_stats_t* stats = &g_mem_tags[tag];
+	long live = os_atomic_add_long(&stats->arena_bytes, bytes);
+	if (bytes > 0)
+		mem_update_peak(&stats->arena_peak, live);
+}
+
+// The system allocator is thread safe and the tag counters are atomic, so
+// bm_malloc/bm_realloc/bm_free may be called from any thread.
 void* bm_malloc(size_t size)
 {
-	void* ptr = gAllocator.malloc(size);
-	os_atomic_set_long(&g_bytes_allocated, g_bytes_allocated + size);
-	os_atomic_inc_long(&g_num_allocations);
-	return ptr;
+	return bm_malloc_tagged(size, kMemTagGeneral);
+}
+
+void* bm_malloc_tagged(size_t size, mem_tag_t tag)
+{
+	assert(sizeof(mem_header_t) <= MEM_HEADER_BYTES);
+	assert(tag < kMemTagCount);
+
+	u8* block = (u8*)gAllocator.malloc(size + MEM_HEADER_BYTES);
+	if (block == NULL)
+		return NULL;
+
+	mem_header_t* header = (mem_header_t*)block;
+	header->size = size;
+	header->tag = tag;
+	mem_track_heap(tag, (long)size);
+	os_atomic_inc_long(&g_mem_tags[tag].heap_allocs);
+
+	return block + MEM_HEADER_BYTES;
 }
 
 void* bm_realloc(void* ptr, size_t size)
+{
+	if (ptr == NULL)
+		return bm_malloc(size);
+
+	mem_header_t* header = (mem_header_t*)((u8*)ptr - MEM_HEADER_BYTES);
+	const size_t old_size = header->size;
+	const mem_tag_t tag = header->tag;
+
+	u8* block = (u8*)gAllocator.realloc(header, size + MEM_HEADER_BYTES);
+	if (block == NULL)
+		return NULL; // ptr is still valid
+
+	header = (mem_header_t*)block;
+	header->size = size;
+	mem_track_heap(tag, (long)size - (long)old_size);
+
+	return block + MEM_HEADER_BYTES;
+}
+
+void bm_free(void* ptr)
 {
 	if (ptr) {
-		realloc(ptr, size);
-		size_t bytes_allocated = g_bytes_allocated + size;
-		os_atomic_set_long(&g_bytes_allocated, bytes_allocated);
-		os_atomic_inc_long(&g_num_allocations);
+		mem_header_t* header =
+			(mem_header_t*)((u8*)ptr - MEM_HEADER_BYTES);
+		mem_track_heap(header->tag, -(long)header->size);
+		gAllocator.free(header);
 	}
 }
 
-void  bm_free(void* ptr)
+const char* mem_tag_name(mem_tag_t tag)
 {
-	if (ptr) {
-		gAllocator.free(ptr);
-		os_atomic_dec_long(&g_num_allocations);
+	return tag < kMemTagCount ? kMemTagNames[tag] : "unknown";
+}
+
+void mem_get_tag_stats(mem_tag_t tag, mem_tag_stats_t* stats)
+{
+	mem_tag_stats_t* src = &g_mem_tags[tag];
+	stats->heap_bytes = os_atomic_load_long(&src->heap_bytes);
+	stats->heap_peak = os_atomic_load_long(&src->heap_peak);
+	stats->heap_allocs = os_atomic_load_long(&src->heap_allocs);
+	stats->arena_bytes = os_atomic_load_long(&src->arena_bytes);
+	stats->arena_peak = os_atomic_load_long(&src->arena_peak);
+}
+
+void mem_log_stats(void)
+{
+	for (s32 t = 0; t < kMemTagCount; t++) {
+		mem_tag_stats_t stats;
+		mem_get_tag_stats((mem_tag_t)t, &stats);
+		logger(LOG_INFO,
+		       "mem %-8s - heap: %ld bytes (peak %ld, %ld allocs) | arena: %ld bytes (peak %ld)\n",
+		       mem_tag_name((mem_tag_t)t), stats.heap_bytes,
+		       stats.heap_peak, stats.heap_allocs, stats.arena_bytes,
+		       stats.arena_peak);
 	}
 }
 
+bool mem_write_json(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		logger(LOG_ERROR, "mem_write_json - error opening %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"arena_reserved\": %zu,\n", g_mem_arena.sz_buffer);
+	fprintf(file, "\t\"arena_committed\": %zu,\n", g_mem_arena.sz_committed);
+	fprintf(file, "\t\"tags\": {\n");
+	for (s32 t = 0; t < kMemTagCount; t++) {
+		mem_tag_stats_t stats;
+		mem_get_tag_stats((mem_tag_t)t, &stats);
+		fprintf(file,
+			"\t\t\"%s\": {\"heap_bytes\": %ld, \"heap_peak\": %ld, \"heap_allocs\": %ld, \"arena_bytes\": %ld, \"arena_peak\": %ld}%s\n",
+			mem_tag_name((mem_tag_t)t), stats.heap_bytes,
+			stats.heap_peak, stats.heap_allocs, stats.arena_bytes,
+			stats.arena_peak, t + 1 < kMemTagCount ? "," : "");
+	}
+	fprintf(file, "\t}\n}\n");
+	fclose(file);
+
+	return true;
+}
 
 //
 // memory arena
@@ -64,16 +188,135 @@ void arena_init(arena_t* arena, void* backing_buffer, size_t sz_backing)
 	arena->sz_buffer = sz_backing;
 	arena->curr_offset = 0;
 	arena->prev_offset = 0;
+	arena->sz_committed = sz_backing;
+	arena->flags = kArenaFlagsNone;
+	memset(arena->tag_bytes, 0, sizeof(arena->tag_bytes));
+	arena->owner = os_thread_id();
+}
+
+void arena_set_owner(arena_t* arena)
+{
+	arena->owner = os_thread_id();
+}
+
+#if defined(BM_DEBUG)
+static void arena_check_owner(const arena_t* arena, const char* func)
+{
+	if (arena->owner != 0 && arena->owner != os_thread_id())
+		logger_ratelimited(
+			LOG_ERROR, 1,
+			"%s - arena %p used off its owning thread %llu by %llu\n",
+			func, (const void*)arena,
+			(unsigned long long)arena->owner,
+			(unsigned long long)os_thread_id());
+}
+#define ARENA_CHECK_OWNER(arena) arena_check_owner((arena), __func__)
+#else
+#define ARENA_CHECK_OWNER(arena)
+#endif
+
+// Drop the arena's tagged bytes back down to keep[] (NULL for all)
+static void arena_untrack(arena_t* arena, const size_t* keep)
+{
+	for (s32 t = 0; t < kMemTagCount; t++) {
+		const size_t bytes = keep ? keep[t] : 0;
+		if (arena->tag_bytes[t] > bytes) {
+			if (!(arena->flags & kArenaNested))
+				mem_track_arena((mem_tag_t)t,
+						-(long)(arena->tag_bytes[t] -
+							bytes));
+			arena->tag_bytes[t] = bytes;
+		}
+	}
+}
+
+static size_t arena_commit_granularity(const arena_t* arena)
+{
+	size_t granularity = (arena->flags & kArenaHugePages)
+				     ? ARENA_HUGE_PAGE_BYTES
+				     : ARENA_COMMIT_BYTES;
+	return MAX(granularity, os_get_page_size());
+}
+
+bool arena_init_virtual(arena_t* arena, size_t sz_reserve, u32 flags)
+{
+	memset(arena, 0, sizeof(arena_t));
+	arena->flags = flags | kArenaVirtual;
+	arena->owner = os_thread_id();
+
+	const size_t granularity = arena_commit_granularity(arena);
+	sz_reserve = (size_t)align_forward((uintptr_t)sz_reserve, granularity);
+
+	arena->buffer = (u8*)os_mem_reserve(
+		sz_reserve, (arena->flags & kArenaHugePages) != 0);
+	if (arena->buffer == NULL) {
+		logger(LOG_ERROR,
+		       "arena_init_virtual - failed to reserve %zu bytes\n",
+		       sz_reserve);
+		return false;
+	}
+	arena->sz_buffer = sz_reserve;
+
+	return true;
+}
+
+void arena_release(arena_t* arena)
+{
+	arena_untrack(arena, NULL);
+	if (arena->buffer && (arena->flags & kArenaVirtual))
+		os_mem_release(arena->buffer, arena->sz_buffer);
+
+	memset(arena, 0, sizeof(arena_t));
+}
+
+static bool arena_commit(arena_t* arena, size_t sz_needed)
+{
+	const size_t granularity = arena_commit_granularity(arena);
+	size_t sz_commit = (size_t)align_forward((uintptr_t)sz_needed,
+						 granularity);
+	sz_commit = MIN(sz_commit, arena->sz_buffer);
+
+	if (!os_mem_commit(arena->buffer + arena->sz_committed,
+			   sz_commit - arena->sz_committed,
+			   (arena->flags & kArenaHugePages) != 0)) {
+		logger(LOG_ERROR, "arena_commit - failed to commit %zu bytes\n",
+		       sz_commit - arena->sz_committed);
+		return false;
+	}
+	arena->sz_committed = sz_commit;
+
+	return true;
 }
 
 void arena_free_all(arena_t* arena)
 {
+	ARENA_CHECK_OWNER(arena);
 	arena->curr_offset = 0;
 	arena->prev_offset = 0;
+	arena_untrack(arena, NULL);
+
+	// keep the first chunk so a reset arena doesn't fault straight away
+	if ((arena->flags & kArenaVirtual) &&
+	    (arena->flags & kArenaDecommitOnReset)) {
+		const size_t granularity = arena_commit_granularity(arena);
+		if (arena->sz_committed > granularity) {
+			os_mem_decommit(arena->buffer + granularity,
+					arena->sz_committed - granularity);
+			arena->sz_committed = granularity;
+		}
+	}
 }
 
 void* arena_alloc(arena_t* arena, size_t size, size_t align)
 {
+	return arena_alloc_tagged(arena, size, align, kMemTagGeneral);
+}
+
+void* arena_alloc_tagged(arena_t* arena, size_t size, size_t align,
+			 mem_tag_t tag)
+{
+	ARENA_CHECK_OWNER(arena);
+
 	uintptr_t curr_ptr =
 		(uintptr_t)arena->buffer + (uintptr_t)arena->curr_offset;
 	uintptr_t offset = align_forward(curr_ptr, align);
@@ -82,20 +325,32 @@ void* arena_alloc(arena_t* arena, size_t size, size_t align)
 
 	offset -= (uintptr_t)arena->buffer;
 
-	if (offset + size <= arena->sz_buffer) {
+	if (offset + size > arena->sz_committed &&
+	    offset + size <= arena->sz_buffer &&
+	    (arena->flags & kArenaVirtual)) {
+		if (!arena_commit(arena, offset + size))
+			return NULL;
+	}
+
+	if (offset + size <= arena->sz_committed) {
 		void* ptr = &arena->buffer[offset];
 		arena->prev_offset = offset;
 		arena->curr_offset = offset + size;
 		memset(ptr, 0, size);
 
-		arena_allocated_bytes = arena->curr_offset;
+		arena->tag_bytes[tag] += size;
+		if (!(arena->flags & kArenaNested))
+			mem_track_arena(tag, (long)size);
 
-		logger(LOG_DEBUG,
-		       "arena_alloc - this: %zu bytes | used: %zu bytes | remain: %zu bytes | arena size: %zu bytes\n",
-		       arena->curr_offset - arena->prev_offset,
-		       arena_allocated_bytes,
-		       (size_t)ARENA_TOTAL_BYTES - arena_allocated_bytes,
-		       (size_t)ARENA_TOTAL_BYTES);
+		// scratch arenas churn every frame, only trace the global one
+		if (arena == &g_mem_arena) {
+			arena_allocated_bytes = arena->curr_offset;
+			logger(LOG_DEBUG,
+			       "arena_alloc - this: %zu bytes | used: %zu bytes | committed: %zu bytes | arena size: %zu bytes\n",
+			       arena->curr_offset - arena->prev_offset,
+			       arena_allocated_bytes, arena->sz_committed,
+			       arena->sz_buffer);
+		}
 		return ptr;
 	} else {
 		logger(LOG_ERROR, "Out of arena memory!\n");
@@ -103,3 +358,115 @@ void* arena_alloc(arena_t* arena, size_t size, size_t align)
 
 	return NULL;
 }
+
+void* arena_resize(arena_t* arena, void* old_mem, size_t old_size,
+		   size_t new_size, size_t align, mem_tag_t tag)
+{
+	u8* old = (u8*)old_mem;
+	if (old == NULL || old_size == 0)
+		return arena_alloc_tagged(arena, new_size, align, tag);
+
+	ARENA_CHECK_OWNER(arena);
+
+	if (old == arena->buffer + arena->prev_offset &&
+	    old_size == arena->curr_offset - arena->prev_offset) {
+		const size_t end = arena->prev_offset + new_size;
+		if (end > arena->sz_committed && end <= arena->sz_buffer &&
+		    (arena->flags & kArenaVirtual))
+			arena_commit(arena, end);
+
+		if (end <= arena->sz_committed) {
+			if (new_size > old_size) {
+				memset(old + old_size, 0, new_size - old_size);
+				arena->tag_bytes[tag] += new_size - old_size;
+				if (!(arena->flags & kArenaNested))
+					mem_track_arena(
+						tag, (long)(new_size - old_size));
+			} else if (new_size < old_size) {
+				size_t shrunk = old_size - new_size;
+				shrunk = MIN(shrunk, arena->tag_bytes[tag]);
+				arena->tag_bytes[tag] -= shrunk;
+				if (!(arena->flags & kArenaNested))
+					mem_track_arena(tag, -(long)shrunk);
+			}
+			arena->curr_offset = end;
+			return old;
+		}
+	}
+
+	void* ptr = arena_alloc_tagged(arena, new_size, align, tag);
+	if (ptr)
+		memcpy(ptr, old, MIN(old_size, new_size));
+
+	return ptr;
+}
+
+size_t arena_remaining(const arena_t* arena)
+{
+	return arena->sz_buffer - arena->curr_offset;
+}
+
+arena_temp_t arena_temp_begin(arena_t* arena)
+{
+	ARENA_CHECK_OWNER(arena);
+
+	arena_temp_t temp;
+	temp.arena = arena;
+	temp.prev_offset = arena->prev_offset;
+	temp.curr_offset = arena->curr_offset;
+	memcpy(temp.tag_bytes, arena->tag_bytes, sizeof(temp.tag_bytes));
+	return temp;
+}
+
+void arena_temp_end(arena_temp_t temp)
+{
+	ARENA_CHECK_OWNER(temp.arena);
+	assert(temp.curr_offset <= temp.arena->curr_offset);
+	temp.arena->prev_offset = temp.prev_offset;
+	temp.arena->curr_offset = temp.curr_offset;
+	arena_untrack(temp.arena, temp.tag_bytes);
+}
+
+bool arena_thread_init(size_t sz_scratch)
+{
+	if (tl_scratch_arena.buffer != NULL)
+		return true;
+
+	return arena_init_virtual(&tl_scratch_arena, sz_scratch,
+				  kArenaDecommitOnReset);
+}
+
+void arena_thread_shutdown(void)
+{
+	arena_release(&tl_scratch_arena);
+}
+
+arena_t* arena_thread_scratch(void)
+{
+	return tl_scratch_arena.buffer ? &tl_scratch_arena : NULL;
+}
+
+char* arena_vprintf(arena_t* arena, const char* fmt, va_list args)
+{
+	va_list args_copy;
+	va_copy(args_copy, args);
+	int len = vsnprintf(NULL, 0, fmt, args_copy);
+	va_end(args_copy);
+	if (len < 0)
+		return NULL;
+
+	char* str = (char*)arena_alloc(arena, (size_t)len + 1, 1);
+	if (str)
+		vsnprintf(str, (size_t)len + 1, fmt, args);
+
+	return str;
+}
+
+char* arena_printf(arena_t* arena, const char* fmt, ...)
+{
+	va_list args;
+	va_start(args, fmt);
+	char* str = arena_vprintf(arena, fmt, args);
+	va_end(args);
+	return str;
+}
@@ -19,16 +19,43 @@
 #include "core/types.h"
 #include "core/export.h"
 
+#include <stdarg.h>
+
 struct memory_allocator {
 	void *(*malloc)(size_t);
 	void *(*realloc)(void *, size_t);
 	void (*free)(void *);
 };
 
+// Allocation tags, every heap and arena allocation is counted against one
+typedef enum {
+	kMemTagGeneral,
+	kMemTagEntities,
+	kMemTagAssets,
+	kMemTagAudio,
+	kMemTagRender,
+	kMemTagScratch,
+	kMemTagCount,
+} mem_tag_t;
+
+typedef struct mem_tag_stats_s {
+	long heap_bytes;
+	long heap_peak;
+	long heap_allocs;
+	long arena_bytes;
+	long arena_peak;
+} mem_tag_stats_t;
+
 BM_EXPORT void* bm_malloc(size_t size);
+BM_EXPORT void* bm_malloc_tagged(size_t size, mem_tag_t tag);
 BM_EXPORT void* bm_realloc(void* ptr, size_t size);
 BM_EXPORT void  bm_free(void* ptr);
 
+BM_EXPORT const char* mem_tag_name(mem_tag_t tag);
+BM_EXPORT void mem_get_tag_stats(mem_tag_t tag, mem_tag_stats_t* stats);
+BM_EXPORT void mem_log_stats(void);
+BM_EXPORT bool mem_write_json(const char* path);
+
 // Basic linear allocator
 // https://www.gingerbill.org/article/2019/02/08/memory-allocation-strategies-002/
 
@@ -36,19 +63,73 @@ BM_EXPORT void  bm_free(void* ptr);
 #define DEFAULT_ALIGNMENT (2 * sizeof(void*))
 #endif
 
-#define ARENA_TOTAL_BYTES 16777216 // 16MiB
+#define ARENA_RESERVE_BYTES 1073741824 // 1GiB of address space
+#define ARENA_COMMIT_BYTES 65536 // 64KiB
+#define ARENA_HUGE_PAGE_BYTES 2097152 // 2MiB
+#define FRAME_ARENA_BYTES 1048576 // 1MiB
+
+enum arena_flags {
+	kArenaFlagsNone = 0,
+	kArenaVirtual = 1 << 0, // set by arena_init_virtual
+	kArenaHugePages = 1 << 1, // commit in huge page sized chunks
+	kArenaDecommitOnReset = 1 << 2, // return pages on arena_free_all
+	kArenaNested = 1 << 3, // carved from another arena, not counted twice
+};
 
+// Virtual arenas reserve sz_buffer bytes of address space up front and
+// commit pages as curr_offset grows past sz_committed.
 typedef struct arena_s {
 	u8* buffer;
 	size_t sz_buffer;
 	size_t prev_offset;
 	size_t curr_offset;
+	size_t sz_committed;
+	u32 flags;
+	size_t tag_bytes[kMemTagCount];
+	u64 owner; // os_thread_id of the only thread allowed to use it
 } arena_t;
 
+// Saved arena offsets. Everything allocated between arena_temp_begin and
+// arena_temp_end is released at once when the scope ends.
+typedef struct arena_temp_s {
+	arena_t* arena;
+	size_t prev_offset;
+	size_t curr_offset;
+	size_t tag_bytes[kMemTagCount];
+} arena_temp_t;
+
 extern size_t arena_allocated_bytes;
-extern u8* arena_buf;
 extern arena_t g_mem_arena;
+// Scratch arena owned by the sim thread, reset at the top of every frame.
+// Nothing allocated from it may outlive the frame.
+extern arena_t g_frame_arena;
+
+// Arenas are not thread safe. Each one belongs to the thread that initialized
+// it until handed over with arena_set_owner; debug builds log any use from
+// another thread. Heap allocations through bm_malloc are safe from any thread.
+#define THREAD_SCRATCH_BYTES 67108864 // 64MiB of address space per thread
 
 void arena_init(arena_t* arena, void* backing_buffer, size_t sz_backing);
+bool arena_init_virtual(arena_t* arena, size_t sz_reserve, u32 flags);
+void arena_release(arena_t* arena);
 void arena_free_all(arena_t* arena);
 void* arena_alloc(arena_t* arena, size_t size, size_t align);
+void* arena_alloc_tagged(arena_t* arena, size_t size, size_t align,
+			 mem_tag_t tag);
+// Grows or shrinks old_mem in place when it was the last allocation made,
+// otherwise allocates a new block and copies the old contents over.
+void* arena_resize(arena_t* arena, void* old_mem, size_t old_size,
+		   size_t new_size, size_t align, mem_tag_t tag);
+size_t arena_remaining(const arena_t* arena);
+void arena_set_owner(arena_t* arena);
+
+// Per-thread arenas. arena_thread_init gives the calling thread its own
+// scratch arena for temp scopes; arena_thread_scratch is NULL on threads
+// that don't have one.
+bool arena_thread_init(size_t sz_scratch);
+void arena_thread_shutdown(void);
+arena_t* arena_thread_scratch(void);
+arena_temp_t arena_temp_begin(arena_t* arena);
+void arena_temp_end(arena_temp_t temp);
+char* arena_vprintf(arena_t* arena, const char* fmt, va_list args);
+char* arena_printf(arena_t* arena, const char* fmt, ...);
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/pool.h"
+#include "core/logger.h"
+#include "core/mem_align.h"
+#include "math/utils.h"
+#include "platform/platform.h"
+
+#include <assert.h>
+#include <string.h>
+
+static inline void pool_lock(pool_t* pool)
+{
+	if (pool->flags & kPoolLocked) {
+		while (!os_atomic_compare_swap_long(&pool->lock, 0, 1))
+			;
+	}
+}
+
+static inline void pool_unlock(pool_t* pool)
+{
+	if (pool->flags & kPoolLocked)
+		os_atomic_set_long(&pool->lock, 0);
+}
+
+bool pool_init(pool_t* pool, void* backing_buffer, size_t sz_backing,
+	       size_t sz_slot, size_t align, u32 flags)
+{
+	if (pool == NULL || backing_buffer == NULL)
+		return false;
+
+	memset(pool, 0, sizeof(pool_t));
+
+	uintptr_t start = align_forward((uintptr_t)backing_buffer, align);
+	if (start == 0)
+		return false;
+	sz_slot = MAX(sz_slot, sizeof(void*));
+	sz_slot = (size_t)align_forward((uintptr_t)sz_slot, align);
+	sz_backing -= (size_t)(start - (uintptr_t)backing_buffer);
+
+	pool->buffer = (u8*)start;
+	pool->sz_slot = sz_slot;
+	pool->num_slots = sz_backing / sz_slot;
+	pool->flags = flags;
+	if (pool->num_slots == 0) {
+		logger(LOG_ERROR, "pool_init - backing buffer too small\n");
+		return false;
+	}
+
+	pool_free_all(pool);
+
+	return true;
+}
+
+void* pool_alloc(pool_t* pool)
+{
+	pool_lock(pool);
+	void* ptr = pool->free_list;
+	if (ptr) {
+		pool->free_list = *(void**)ptr;
+		pool->num_used++;
+		pool->num_allocs++;
+		pool->high_water = MAX(pool->high_water, pool->num_used);
+	} else {
+		pool->num_failed++;
+	}
+	pool_unlock(pool);
+
+	return ptr;
+}
+
+void pool_free(pool_t* pool, void* ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	assert(pool_owns(pool, ptr));
+
+	pool_lock(pool);
+	*(void**)ptr = pool->free_list;
+	pool->free_list = ptr;
+	pool->num_used--;
+	pool_unlock(pool);
+}
+
+void pool_free_all(pool_t* pool)
+{
+	pool_lock(pool);
+	// thread the list back to front so slots are handed out in order
+	pool->free_list = NULL;
+	for (size_t i = pool->num_slots; i > 0; i--) {
+		void* slot = &pool->buffer[(i - 1) * pool->sz_slot];
+		*(void**)slot = pool->free_list;
+		pool->free_list = slot;
+	}
+	pool->num_used = 0;
+	pool_unlock(pool);
+}
+
+bool pool_owns(const pool_t* pool, const void* ptr)
+{
+	const u8* p = (const u8*)ptr;
+	const u8* end = pool->buffer + pool->num_slots * pool->sz_slot;
+	return p >= pool->buffer && p < end &&
+	       (size_t)(p - pool->buffer) % pool->sz_slot == 0;
+}
+
+size_t pool_index(const pool_t* pool, const void* ptr)
+{
+	return (size_t)((const u8*)ptr - pool->buffer) / pool->sz_slot;
+}
+
+void* pool_at(const pool_t* pool, size_t index)
+{
+	if (index >= pool->num_slots)
+		return NULL;
+	return &pool->buffer[index * pool->sz_slot];
+}
+
+void pool_log_stats(const pool_t* pool, const char* name)
+{
+	logger(LOG_INFO,
+	       "pool %s - slots: %zu x %zu bytes | used: %zu | peak: %zu | allocs: %llu | failed: %llu\n",
+	       name, pool->num_slots, pool->sz_slot, pool->num_used,
+	       pool->high_water, (unsigned long long)pool->num_allocs,
+	       (unsigned long long)pool->num_failed);
+}
+
+//
+// per-thread slot cache
+//
+void pool_cache_init(pool_cache_t* cache, pool_t* pool)
+{
+	cache->pool = pool;
+	cache->count = 0;
+}
+
+void* pool_cache_alloc(pool_cache_t* cache)
+{
+	if (cache->count == 0) {
+		// refill half the cache under a single lock
+		pool_t* pool = cache->pool;
+		pool_lock(pool);
+		while (cache->count < POOL_CACHE_SLOTS / 2 && pool->free_list) {
+			void* ptr = pool->free_list;
+			pool->free_list = *(void**)ptr;
+			cache->slots[cache->count++] = ptr;
+		}
+		pool->num_used += cache->count;
+		pool->num_allocs += cache->count;
+		pool->high_water = MAX(pool->high_water, pool->num_used);
+		if (cache->count == 0)
+			pool->num_failed++;
+		pool_unlock(pool);
+
+		if (cache->count == 0)
+			return NULL;
+	}
+
+	return cache->slots[--cache->count];
+}
+
+static void pool_cache_release(pool_cache_t* cache, u32 keep)
+{
+	pool_t* pool = cache->pool;
+	pool_lock(pool);
+	while (cache->count > keep) {
+		void* ptr = cache->slots[--cache->count];
+		*(void**)ptr = pool->free_list;
+		pool->free_list = ptr;
+		pool->num_used--;
+	}
+	pool_unlock(pool);
+}
+
+void pool_cache_free(pool_cache_t* cache, void* ptr)
+{
+	if (ptr == NULL)
+		return;
+
+	assert(pool_owns(cache->pool, ptr));
+
+	if (cache->count == POOL_CACHE_SLOTS)
+		pool_cache_release(cache, POOL_CACHE_SLOTS / 2);
+
+	cache->slots[cache->count++] = ptr;
+}
+
+void pool_cache_flush(pool_cache_t* cache)
+{
+	pool_cache_release(cache, 0);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+// Fixed size slot allocator with O(1) alloc and free. Free slots hold the
+// next pointer of an intrusive free list, so a slot's first pointer-sized
+// bytes are clobbered when it is freed. The backing memory is owned by the
+// caller, usually an arena block.
+//
+// Pools are single threaded unless initialized with kPoolLocked, in which
+// case alloc/free take a spinlock. Threads hammering a locked pool can go
+// through a pool_cache_t to move slots in batches instead.
+
+#define POOL_CACHE_SLOTS 32
+
+enum pool_flags {
+	kPoolFlagsNone = 0,
+	kPoolLocked = 1 << 0,
+};
+
+typedef struct pool_s {
+	u8* buffer;
+	size_t sz_slot;
+	size_t num_slots;
+	void* free_list;
+	volatile long lock;
+	u32 flags;
+
+	// stats
+	size_t num_used;
+	size_t high_water;
+	u64 num_allocs;
+	u64 num_failed;
+} pool_t;
+
+typedef struct pool_cache_s {
+	pool_t* pool;
+	void* slots[POOL_CACHE_SLOTS];
+	u32 count;
+} pool_cache_t;
+
+bool pool_init(pool_t* pool, void* backing_buffer, size_t sz_backing,
+	       size_t sz_slot, size_t align, u32 flags);
+void* pool_alloc(pool_t* pool);
+void pool_free(pool_t* pool, void* ptr);
+void pool_free_all(pool_t* pool);
+bool pool_owns(const pool_t* pool, const void* ptr);
+size_t pool_index(const pool_t* pool, const void* ptr);
+void* pool_at(const pool_t* pool, size_t index);
+void pool_log_stats(const pool_t* pool, const char* name);
+
+#define pool_alloc_type(pool, type) ((type*)pool_alloc((pool)))
+
+void pool_cache_init(pool_cache_t* cache, pool_t* pool);
+void* pool_cache_alloc(pool_cache_t* cache);
+void pool_cache_free(pool_cache_t* cache, void* ptr);
+void pool_cache_flush(pool_cache_t* cache);
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/profiler.h"
+
+#if defined(BM_PROFILE)
+
+#include "core/logger.h"
+#include "core/memory.h"
+
+#include "platform/platform.h"
+
+// Timestamps are raw os_get_cycles ticks, converted when the trace is
+// written
+typedef struct profile_event_s {
+	const char* name;
+	u64 start;
+	u64 end;
+} profile_event_t;
+
+typedef struct profile_thread_s {
+	profile_event_t* events;
+	u64 num_events; // total recorded, the ring keeps the newest
+	const char* stack_names[PROFILER_MAX_DEPTH];
+	u64 stack_start[PROFILER_MAX_DEPTH];
+	s32 depth;
+	const char* name;
+	s32 tid;
+} profile_thread_t;
+
+static profile_thread_t* profile_threads[PROFILER_MAX_THREADS];
+static volatile long num_profile_threads = 0;
+
+static BM_THREAD_LOCAL profile_thread_t* thread_profile = NULL;
+static BM_THREAD_LOCAL bool thread_profile_failed = false;
+
+static profile_thread_t* profiler_thread(void)
+{
+	if (thread_profile != NULL || thread_profile_failed)
+		return thread_profile;
+
+	const long idx = os_atomic_inc_long(&num_profile_threads) - 1;
+	if (idx >= PROFILER_MAX_THREADS) {
+		thread_profile_failed = true;
+		return NULL;
+	}
+
+	profile_thread_t* pt =
+		(profile_thread_t*)bm_malloc(sizeof(profile_thread_t));
+	memset(pt, 0, sizeof(profile_thread_t));
+	pt->events = (profile_event_t*)bm_malloc(sizeof(profile_event_t) *
+						 PROFILER_MAX_EVENTS);
+	pt->tid = (s32)idx + 1;
+
+	profile_threads[idx] = pt;
+	thread_profile = pt;
+
+	return pt;
+}
+
+void profiler_set_thread_name(const char* name)
+{
+	profile_thread_t* pt = profiler_thread();
+	if (pt)
+		pt->name = name;
+}
+
+bool profiler_begin(const char* name)
+{
+	profile_thread_t* pt = profiler_thread();
+	if (pt == NULL)
+		return true;
+
+	// past the max depth only keep count so begin/end stay paired
+	if (pt->depth < PROFILER_MAX_DEPTH) {
+		pt->stack_names[pt->depth] = name;
+		pt->stack_start[pt->depth] = os_get_cycles();
+	}
+	pt->depth++;
+
+	return true;
+}
+
+bool profiler_end(void)
+{
+	profile_thread_t* pt = thread_profile;
+	if (pt == NULL || pt->depth == 0)
+		return true;
+
+	pt->depth--;
+	if (pt->depth < PROFILER_MAX_DEPTH) {
+		profile_event_t* ev =
+			&pt->events[pt->num_events % PROFILER_MAX_EVENTS];
+		ev->name = pt->stack_names[pt->depth];
+		ev->start = pt->stack_start[pt->depth];
+		ev->end = os_get_cycles();
+		pt->num_events++;
+	}
+
+	return true;
+}
+
+// Threads must be done recording, call this after worker threads exit.
+bool profiler_write_trace(const char* path)
+{
+	FILE* file = os_fopen(path, "w");
+	if (file == NULL) {
+		logger(LOG_ERROR, "Error opening profiler trace %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	const f64 us_per_cycle = 1000000.0 / (f64)os_get_cycles_per_sec();
+	bool first = true;
+	u64 total_events = 0;
+	const long num_threads = num_profile_threads < PROFILER_MAX_THREADS
+					 ? num_profile_threads
+					 : PROFILER_MAX_THREADS;
+	for (long t = 0; t < num_threads; t++) {
+		const profile_thread_t* pt = profile_threads[t];
+		if (pt == NULL)
+			continue;
+
+		if (pt->name) {
+			fprintf(file,
+				"%s{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":1,\"tid\":%d,"
+				"\"args\":{\"name\":\"%s\"}}",
+				first ? "" : ",\n", pt->tid, pt->name);
+			first = false;
+		}
+
+		const u64 begin = pt->num_events > PROFILER_MAX_EVENTS
+					  ? pt->num_events - PROFILER_MAX_EVENTS
+					  : 0;
+		for (u64 i = begin; i < pt->num_events; i++) {
+			const profile_event_t* ev =
+				&pt->events[i % PROFILER_MAX_EVENTS];
+			fprintf(file,
+				"%s{\"name\":\"%s\",\"cat\":\"bm\",\"ph\":\"X\","
+				"\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+				first ? "" : ",\n", ev->name,
+				(f64)ev->start * us_per_cycle,
+				(f64)(ev->end - ev->start) * us_per_cycle,
+				pt->tid);
+			first = false;
+		}
+		total_events += pt->num_events - begin;
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	logger(LOG_INFO, "Wrote %llu profiler events to %s\n",
+	       (unsigned long long)total_events, path);
+
+	return true;
+}
+
+void profiler_shutdown(void)
+{
+	const long num_threads = num_profile_threads < PROFILER_MAX_THREADS
+					 ? num_profile_threads
+					 : PROFILER_MAX_THREADS;
+	for (long t = 0; t < num_threads; t++) {
+		profile_thread_t* pt = profile_threads[t];
+		if (pt == NULL)
+			continue;
+		bm_free(pt->events);
+		bm_free(pt);
+		profile_threads[t] = NULL;
+	}
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/export.h"
+#include "core/types.h"
+
+// Scoped CPU profiler, compiled in only when BM_PROFILE is defined.
+//
+//     BM_PROFILE_SCOPE("ent_refresh") {
+//             ...
+//     }
+//
+// Leaving a scope block with return, break or goto skips its end marker,
+// use BM_PROFILE_BEGIN/BM_PROFILE_END around code with early exits.
+// Names must be string literals, only the pointer is recorded.
+// Each thread records into its own ring buffer and BM_PROFILE_DUMP writes
+// every thread's events as Chrome trace_event JSON, which chrome://tracing
+// and ui.perfetto.dev can both open.
+
+#define PROFILER_MAX_THREADS 32
+#define PROFILER_MAX_EVENTS (1 << 18) // per thread, oldest are overwritten
+#define PROFILER_MAX_DEPTH 64
+
+#if defined(BM_PROFILE)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+BM_EXPORT void profiler_set_thread_name(const char* name);
+BM_EXPORT bool profiler_begin(const char* name);
+BM_EXPORT bool profiler_end(void);
+BM_EXPORT bool profiler_write_trace(const char* path);
+BM_EXPORT void profiler_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define BM_PROFILE_CONCAT_(a, b) a##b
+#define BM_PROFILE_CONCAT(a, b) BM_PROFILE_CONCAT_(a, b)
+
+#define BM_PROFILE_SCOPE(name)                                               \
+	for (bool BM_PROFILE_CONCAT(prof_scope_, __LINE__) =                 \
+		     profiler_begin(name);                                   \
+	     BM_PROFILE_CONCAT(prof_scope_, __LINE__);                       \
+	     BM_PROFILE_CONCAT(prof_scope_, __LINE__) = !profiler_end())
+#define BM_PROFILE_BEGIN(name) profiler_begin(name)
+#define BM_PROFILE_END() profiler_end()
+#define BM_PROFILE_THREAD(name) profiler_set_thread_name(name)
+#define BM_PROFILE_DUMP(path) profiler_write_trace(path)
+#define BM_PROFILE_SHUTDOWN() profiler_shutdown()
+
+#else
+
+#define BM_PROFILE_SCOPE(name)
+#define BM_PROFILE_BEGIN(name) ((void)0)
+#define BM_PROFILE_END() ((void)0)
+#define BM_PROFILE_THREAD(name) ((void)0)
+#define BM_PROFILE_DUMP(path) ((void)0)
+#define BM_PROFILE_SHUTDOWN() ((void)0)
+
+#endif
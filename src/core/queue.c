@@ -0,0 +1,331 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/queue.h"
+#include "core/logger.h"
+#include "core/mem_align.h"
+#include "platform/platform.h"
+
+#include <string.h>
+
+// Acquire/release orderings are all the queues need. GCC and Clang get
+// them from the __atomic builtins; MSVC goes through the Interlocked
+// wrappers, which are full barriers.
+#if defined(_MSC_VER)
+static inline long queue_load_relaxed(const volatile long* ptr)
+{
+	return *ptr;
+}
+
+static inline long queue_load_acquire(const volatile long* ptr)
+{
+	return os_atomic_load_long(ptr);
+}
+
+static inline void queue_store_release(volatile long* ptr, long val)
+{
+	os_atomic_set_long(ptr, val);
+}
+
+static inline bool queue_cas(volatile long* ptr, long* expected, long val)
+{
+	if (os_atomic_compare_swap_long(ptr, *expected, val))
+		return true;
+	*expected = os_atomic_load_long(ptr);
+	return false;
+}
+#else
+static inline long queue_load_relaxed(const volatile long* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+static inline long queue_load_acquire(const volatile long* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+static inline void queue_store_release(volatile long* ptr, long val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_RELEASE);
+}
+
+static inline bool queue_cas(volatile long* ptr, long* expected, long val)
+{
+	return __atomic_compare_exchange_n(ptr, expected, val, true,
+					   __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+#endif
+
+// Positions are free running counters, compare them with wrapping math
+static inline long queue_diff(long a, long b)
+{
+	return (long)((unsigned long)a - (unsigned long)b);
+}
+
+static inline long queue_add(long pos, size_t n)
+{
+	return (long)((unsigned long)pos + (unsigned long)n);
+}
+
+static size_t queue_setup(u8** buffer, void* backing_buffer,
+			  size_t sz_backing, size_t sz_cell)
+{
+	if (backing_buffer == NULL || sz_cell == 0)
+		return 0;
+
+	uintptr_t start = align_forward((uintptr_t)backing_buffer, QUEUE_ALIGN);
+	const size_t skip = (size_t)(start - (uintptr_t)backing_buffer);
+	if (skip >= sz_backing)
+		return 0;
+
+	const size_t num_cells = (sz_backing - skip) / sz_cell;
+	size_t capacity = 1;
+	while (capacity * 2 <= num_cells)
+		capacity *= 2;
+	if (capacity > num_cells)
+		return 0;
+
+	*buffer = (u8*)start;
+
+	return capacity;
+}
+
+bool spsc_queue_init(spsc_queue_t* queue, void* backing_buffer,
+		     size_t sz_backing, size_t sz_elem)
+{
+	if (queue == NULL)
+		return false;
+
+	memset(queue, 0, sizeof(spsc_queue_t));
+
+	queue->sz_elem = sz_elem;
+	queue->stride = QUEUE_STRIDE(sz_elem);
+	queue->capacity = queue_setup(&queue->buffer, backing_buffer,
+				      sz_backing, queue->stride);
+	if (queue->capacity < 2) {
+		logger(LOG_ERROR,
+		       "spsc_queue_init - backing buffer too small\n");
+		return false;
+	}
+
+	return true;
+}
+
+static inline u8* spsc_cell(const spsc_queue_t* queue, long pos)
+{
+	const size_t idx = (size_t)pos & (queue->capacity - 1);
+	return &queue->buffer[idx * queue->stride];
+}
+
+void* spsc_queue_push_begin(spsc_queue_t* queue)
+{
+	// only the producer writes head
+	const long head = queue->head;
+	if (queue_diff(head, queue->cached_tail) >= (long)queue->capacity) {
+		queue->cached_tail = queue_load_acquire(&queue->tail);
+		if (queue_diff(head, queue->cached_tail) >=
+		    (long)queue->capacity)
+			return NULL;
+	}
+
+	return spsc_cell(queue, head);
+}
+
+void spsc_queue_push_commit(spsc_queue_t* queue)
+{
+	queue_store_release(&queue->head, queue_add(queue->head, 1));
+}
+
+void* spsc_queue_pop_begin(spsc_queue_t* queue)
+{
+	// only the consumer writes tail
+	const long tail = queue->tail;
+	if (tail == queue->cached_head) {
+		queue->cached_head = queue_load_acquire(&queue->head);
+		if (tail == queue->cached_head)
+			return NULL;
+	}
+
+	return spsc_cell(queue, tail);
+}
+
+void spsc_queue_pop_commit(spsc_queue_t* queue)
+{
+	queue_store_release(&queue->tail, queue_add(queue->tail, 1));
+}
+
+bool spsc_queue_push(spsc_queue_t* queue, const void* elem)
+{
+	void* cell = spsc_queue_push_begin(queue);
+	if (cell == NULL)
+		return false;
+
+	memcpy(cell, elem, queue->sz_elem);
+	spsc_queue_push_commit(queue);
+
+	return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t* queue, void* elem)
+{
+	void* cell = spsc_queue_pop_begin(queue);
+	if (cell == NULL)
+		return false;
+
+	memcpy(elem, cell, queue->sz_elem);
+	spsc_queue_pop_commit(queue);
+
+	return true;
+}
+
+size_t spsc_queue_count(const spsc_queue_t* queue)
+{
+	const long tail = queue_load_acquire(&queue->tail);
+	const long head = queue_load_acquire(&queue->head);
+	const long count = queue_diff(head, tail);
+	if (count < 0)
+		return 0;
+
+	return (size_t)count;
+}
+
+// Each cell is a sequence number padded out to QUEUE_ALIGN, then the element
+static inline volatile long* mpmc_cell(const mpmc_queue_t* queue, long pos)
+{
+	const size_t idx = (size_t)pos & (queue->capacity - 1);
+	return (volatile long*)&queue->buffer[idx * queue->stride];
+}
+
+bool mpmc_queue_init(mpmc_queue_t* queue, void* backing_buffer,
+		     size_t sz_backing, size_t sz_elem)
+{
+	if (queue == NULL)
+		return false;
+
+	memset(queue, 0, sizeof(mpmc_queue_t));
+
+	queue->sz_elem = sz_elem;
+	queue->stride = QUEUE_ALIGN + QUEUE_STRIDE(sz_elem);
+	queue->capacity = queue_setup(&queue->buffer, backing_buffer,
+				      sz_backing, queue->stride);
+	if (queue->capacity < 2) {
+		logger(LOG_ERROR,
+		       "mpmc_queue_init - backing buffer too small\n");
+		return false;
+	}
+
+	for (size_t i = 0; i < queue->capacity; i++)
+		*mpmc_cell(queue, (long)i) = (long)i;
+
+	return true;
+}
+
+void* mpmc_queue_push_begin(mpmc_queue_t* queue, long* ticket)
+{
+	long pos = queue_load_relaxed(&queue->enqueue_pos);
+	for (;;) {
+		volatile long* cell = mpmc_cell(queue, pos);
+		const long diff = queue_diff(queue_load_acquire(cell), pos);
+		if (diff == 0) {
+			if (queue_cas(&queue->enqueue_pos, &pos,
+				      queue_add(pos, 1))) {
+				*ticket = pos;
+				return (u8*)cell + QUEUE_ALIGN;
+			}
+		} else if (diff < 0) {
+			return NULL; // full
+		} else {
+			pos = queue_load_relaxed(&queue->enqueue_pos);
+		}
+	}
+}
+
+void mpmc_queue_push_commit(mpmc_queue_t* queue, long ticket)
+{
+	queue_store_release(mpmc_cell(queue, ticket), queue_add(ticket, 1));
+}
+
+void* mpmc_queue_pop_begin(mpmc_queue_t* queue, long* ticket)
+{
+	long pos = queue_load_relaxed(&queue->dequeue_pos);
+	for (;;) {
+		volatile long* cell = mpmc_cell(queue, pos);
+		const long diff = queue_diff(queue_load_acquire(cell),
+					     queue_add(pos, 1));
+		if (diff == 0) {
+			if (queue_cas(&queue->dequeue_pos, &pos,
+				      queue_add(pos, 1))) {
+				*ticket = pos;
+				return (u8*)cell + QUEUE_ALIGN;
+			}
+		} else if (diff < 0) {
+			return NULL; // empty
+		} else {
+			pos = queue_load_relaxed(&queue->dequeue_pos);
+		}
+	}
+}
+
+void mpmc_queue_pop_commit(mpmc_queue_t* queue, long ticket)
+{
+	queue_store_release(mpmc_cell(queue, ticket),
+			    queue_add(ticket, queue->capacity));
+}
+
+bool mpmc_queue_push(mpmc_queue_t* queue, const void* elem)
+{
+	long ticket = 0;
+	void* cell = mpmc_queue_push_begin(queue, &ticket);
+	if (cell == NULL)
+		return false;
+
+	memcpy(cell, elem, queue->sz_elem);
+	mpmc_queue_push_commit(queue, ticket);
+
+	return true;
+}
+
+bool mpmc_queue_pop(mpmc_queue_t* queue, void* elem)
+{
+	long ticket = 0;
+	void* cell = mpmc_queue_pop_begin(queue, &ticket);
+	if (cell == NULL)
+		return false;
+
+	memcpy(elem, cell, queue->sz_elem);
+	mpmc_queue_pop_commit(queue, ticket);
+
+	return true;
+}
+
+long mpmc_queue_pushed(const mpmc_queue_t* queue)
+{
+	return queue_load_acquire(&queue->enqueue_pos);
+}
+
+size_t mpmc_queue_count(const mpmc_queue_t* queue)
+{
+	const long dequeue_pos = queue_load_acquire(&queue->dequeue_pos);
+	const long enqueue_pos = queue_load_acquire(&queue->enqueue_pos);
+	const long count = queue_diff(enqueue_pos, dequeue_pos);
+	if (count < 0)
+		return 0;
+	if ((size_t)count > queue->capacity)
+		return queue->capacity;
+
+	return (size_t)count;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+// Bounded lock-free queues of fixed size elements. Both keep head and tail
+// on separate cache lines so producers and consumers don't false share.
+//
+// spsc_queue_t is a ring for exactly one producer thread and one consumer
+// thread. Each side caches the other's index and only rereads it when the
+// ring looks full or empty.
+//
+// mpmc_queue_t is Vyukov's bounded queue for any number of producers and
+// consumers. Every cell carries a sequence number that says whether it is
+// free for a producer at a position or ready for a consumer, so claiming a
+// cell is a single CAS.
+//
+// Like pool_t the backing memory is owned by the caller. Capacity is the
+// largest power of two of elements that fits; the *_BACKING_SIZE macros
+// give the size needed for a given capacity.
+//
+// The *_begin/*_commit pairs hand out a pointer into the cell so large
+// elements can be built or consumed in place instead of copied.
+
+#define QUEUE_CACHE_LINE 64
+#define QUEUE_ALIGN 16
+
+#define QUEUE_STRIDE(sz_elem) \
+	(((sz_elem) + QUEUE_ALIGN - 1) & ~(size_t)(QUEUE_ALIGN - 1))
+#define SPSC_QUEUE_BACKING_SIZE(sz_elem, capacity) \
+	(QUEUE_STRIDE(sz_elem) * (capacity) + QUEUE_ALIGN)
+#define MPMC_QUEUE_BACKING_SIZE(sz_elem, capacity) \
+	((QUEUE_ALIGN + QUEUE_STRIDE(sz_elem)) * (capacity) + QUEUE_ALIGN)
+
+typedef struct spsc_queue_s {
+	u8* buffer;
+	size_t sz_elem;
+	size_t stride;
+	size_t capacity;
+	u8 pad0[QUEUE_CACHE_LINE];
+
+	// producer
+	volatile long head;
+	long cached_tail;
+	u8 pad1[QUEUE_CACHE_LINE - 2 * sizeof(long)];
+
+	// consumer
+	volatile long tail;
+	long cached_head;
+	u8 pad2[QUEUE_CACHE_LINE - 2 * sizeof(long)];
+} spsc_queue_t;
+
+typedef struct mpmc_queue_s {
+	u8* buffer;
+	size_t sz_elem;
+	size_t stride;
+	size_t capacity;
+	u8 pad0[QUEUE_CACHE_LINE];
+
+	volatile long enqueue_pos;
+	u8 pad1[QUEUE_CACHE_LINE - sizeof(long)];
+
+	volatile long dequeue_pos;
+	u8 pad2[QUEUE_CACHE_LINE - sizeof(long)];
+} mpmc_queue_t;
+
+bool spsc_queue_init(spsc_queue_t* queue, void* backing_buffer,
+		     size_t sz_backing, size_t sz_elem);
+bool spsc_queue_push(spsc_queue_t* queue, const void* elem);
+bool spsc_queue_pop(spsc_queue_t* queue, void* elem);
+void* spsc_queue_push_begin(spsc_queue_t* queue);
+void spsc_queue_push_commit(spsc_queue_t* queue);
+void* spsc_queue_pop_begin(spsc_queue_t* queue);
+void spsc_queue_pop_commit(spsc_queue_t* queue);
+// Approximate when called while the other side is running
+size_t spsc_queue_count(const spsc_queue_t* queue);
+
+bool mpmc_queue_init(mpmc_queue_t* queue, void* backing_buffer,
+		     size_t sz_backing, size_t sz_elem);
+bool mpmc_queue_push(mpmc_queue_t* queue, const void* elem);
+bool mpmc_queue_pop(mpmc_queue_t* queue, void* elem);
+// Claims a cell and returns it, or NULL when the queue is full/empty.
+// The ticket must be passed to the matching commit.
+void* mpmc_queue_push_begin(mpmc_queue_t* queue, long* ticket);
+void mpmc_queue_push_commit(mpmc_queue_t* queue, long ticket);
+void* mpmc_queue_pop_begin(mpmc_queue_t* queue, long* ticket);
+void mpmc_queue_pop_commit(mpmc_queue_t* queue, long ticket);
+// Number of pushes claimed so far, committed or not
+long mpmc_queue_pushed(const mpmc_queue_t* queue);
+// Approximate when called while other threads are running
+size_t mpmc_queue_count(const mpmc_queue_t* queue);
@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "core/task.h"
+#include "core/logger.h"
+#include "core/memory.h"
+#include "core/profiler.h"
+#include "core/queue.h"
+#include "math/utils.h"
+#include "platform/platform.h"
+
+// idle workers recheck the queues at least this often
+#define TASK_IDLE_TIMEOUT_NS 2000000ULL
+
+typedef struct task_job_s {
+	task_func_t func;
+	void* param;
+	task_counter_t* counter;
+} task_job_t;
+
+typedef struct task_fiber_s {
+	os_fiber_t* fiber;
+	struct task_fiber_s* next_waiter;
+	s32 wait_target;
+} task_fiber_t;
+
+typedef struct task_worker_s {
+	os_thread_t* thread;
+	os_fiber_t* thread_fiber;
+	task_fiber_t* current;
+	// Set just before a switch and handled by whichever fiber runs next,
+	// once the old fiber is off its stack
+	task_fiber_t* pending_free;
+	task_fiber_t* pending_wait;
+	task_counter_t* pending_counter;
+	s32 index;
+	u64 cpus; // affinity mask, 0 leaves the worker unpinned
+	char name[16];
+} task_worker_t;
+
+typedef struct task_system_s {
+	task_worker_t workers[TASK_MAX_WORKERS];
+	u32 num_workers;
+	task_fiber_t fibers[TASK_FIBER_COUNT];
+	mpmc_queue_t jobs;
+	mpmc_queue_t free_fibers;
+	mpmc_queue_t ready_fibers;
+	os_sem_t* work_sem;
+	volatile s32 idle;
+	volatile long running;
+	u64 reserved_cpus[TASK_RESERVED_CORES];
+} task_system_t;
+
+static task_system_t g_tasks;
+static u8 jobs_mem[MPMC_QUEUE_BACKING_SIZE(sizeof(task_job_t),
+					   TASK_QUEUE_SIZE)];
+static u8 free_fibers_mem[MPMC_QUEUE_BACKING_SIZE(sizeof(task_fiber_t*),
+						  TASK_FIBER_COUNT)];
+static u8 ready_fibers_mem[MPMC_QUEUE_BACKING_SIZE(sizeof(task_fiber_t*),
+						   TASK_FIBER_COUNT)];
+
+static BM_THREAD_LOCAL task_worker_t* tl_worker = NULL;
+
+// A fiber can come back from a switch on another thread, so the thread
+// local has to be reread afterwards instead of kept in a register.
+static BM_NOINLINE task_worker_t* task_current_worker(void)
+{
+	return tl_worker;
+}
+
+static inline void task_counter_lock(task_counter_t* counter)
+{
+	while (!os_atomic_compare_swap_long(&counter->lock, 0, 1))
+		os_thread_yield();
+}
+
+static inline void task_counter_unlock(task_counter_t* counter)
+{
+	os_atomic_set_long(&counter->lock, 0);
+}
+
+static void task_wake_workers(u32 count)
+{
+	// The locked add is a full barrier: either an idle worker sees the
+	// new work when it rechecks the queues, or we see it counted here.
+	const s32 idle = os_atomic_add_s32(&g_tasks.idle, 0);
+	if (idle > 0)
+		os_sem_post(g_tasks.work_sem, MIN(count, (u32)idle));
+}
+
+static void task_make_ready(task_fiber_t* fiber)
+{
+	// sized for every fiber, can't fill up
+	mpmc_queue_push(&g_tasks.ready_fibers, &fiber);
+	task_wake_workers(1);
+}
+
+static void task_counter_dec(task_counter_t* counter)
+{
+	task_counter_lock(counter);
+	const s32 value = os_atomic_add_s32(&counter->value, -1);
+	task_fiber_t** link = &counter->waiters;
+	while (*link != NULL) {
+		task_fiber_t* fiber = *link;
+		if (value <= fiber->wait_target) {
+			*link = fiber->next_waiter;
+			task_make_ready(fiber);
+		} else {
+			link = &fiber->next_waiter;
+		}
+	}
+	const bool wake_sleepers = os_atomic_load_s32(&counter->sleepers) > 0;
+	task_counter_unlock(counter);
+
+	// the waiter may already have freed the counter, but waking only
+	// uses the address as a key
+	if (wake_sleepers)
+		os_futex_wake_all(&counter->value);
+}
+
+static void task_execute(const task_job_t* job)
+{
+	job->func(job->param);
+	if (job->counter != NULL)
+		task_counter_dec(job->counter);
+}
+
+static void task_after_switch(void)
+{
+	task_worker_t* worker = task_current_worker();
+	if (worker->pending_free != NULL) {
+		mpmc_queue_push(&g_tasks.free_fibers, &worker->pending_free);
+		worker->pending_free = NULL;
+	}
+
+	if (worker->pending_wait != NULL) {
+		task_fiber_t* fiber = worker->pending_wait;
+		task_counter_t* counter = worker->pending_counter;
+		worker->pending_wait = NULL;
+		worker->pending_counter = NULL;
+
+		task_counter_lock(counter);
+		if (os_atomic_load_s32(&counter->value) <= fiber->wait_target) {
+			task_counter_unlock(counter);
+			task_make_ready(fiber);
+		} else {
+			fiber->next_waiter = counter->waiters;
+			counter->waiters = fiber;
+			task_counter_unlock(counter);
+		}
+	}
+}
+
+static void task_switch_to(task_worker_t* worker, task_fiber_t* next)
+{
+	task_fiber_t* prev = worker->current;
+	worker->current = next;
+	os_fiber_switch(prev->fiber, next->fiber);
+	task_after_switch();
+}
+
+static void task_idle(void)
+{
+	os_atomic_add_s32(&g_tasks.idle, 1);
+	if (os_atomic_load_long(&g_tasks.running) &&
+	    mpmc_queue_count(&g_tasks.jobs) == 0 &&
+	    mpmc_queue_count(&g_tasks.ready_fibers) == 0)
+		os_sem_wait(g_tasks.work_sem, TASK_IDLE_TIMEOUT_NS);
+	os_atomic_add_s32(&g_tasks.idle, -1);
+}
+
+static void task_fiber_main(void* param)
+{
+	(void)param;
+
+	task_after_switch();
+
+	for (;;) {
+		task_worker_t* worker = task_current_worker();
+		if (!os_atomic_load_long(&g_tasks.running)) {
+			// shutting down, this fiber is never resumed
+			os_fiber_switch(worker->current->fiber,
+					worker->thread_fiber);
+		}
+
+		task_fiber_t* ready = NULL;
+		if (mpmc_queue_pop(&g_tasks.ready_fibers, &ready)) {
+			worker->pending_free = worker->current;
+			task_switch_to(worker, ready);
+			continue;
+		}
+
+		task_job_t job;
+		if (mpmc_queue_pop(&g_tasks.jobs, &job)) {
+			task_execute(&job);
+			continue;
+		}
+
+		task_idle();
+	}
+}
+
+static s32 task_worker_main(void* param)
+{
+	task_worker_t* worker = (task_worker_t*)param;
+	tl_worker = worker;
+
+	os_thread_set_name(worker->name);
+	BM_PROFILE_THREAD(worker->name);
+	if (worker->cpus != 0 && !os_thread_set_affinity(worker->cpus))
+		logger(LOG_DEBUG, "%s could not be pinned\n", worker->name);
+	if (!arena_thread_init(TASK_SCRATCH_BYTES))
+		logger(LOG_WARNING, "%s has no scratch arena\n", worker->name);
+
+	task_fiber_t* first = NULL;
+	worker->thread_fiber = os_fiber_from_thread();
+	if (worker->thread_fiber == NULL ||
+	    !mpmc_queue_pop(&g_tasks.free_fibers, &first)) {
+		logger(LOG_ERROR, "%s could not start a fiber\n", worker->name);
+	} else {
+		worker->current = first;
+		os_fiber_switch(worker->thread_fiber, first->fiber);
+	}
+
+	// back on the thread's own stack at shutdown
+	os_fiber_to_thread(worker->thread_fiber);
+	worker->thread_fiber = NULL;
+	worker->current = NULL;
+	arena_thread_shutdown();
+	tl_worker = NULL;
+
+	return 0;
+}
+
+// Outside a fiber: run queued tasks on this stack, then sleep on the counter
+static void task_wait_blocking(task_counter_t* counter, s32 target)
+{
+	task_job_t job;
+	while (os_atomic_load_s32(&counter->value) > target &&
+	       mpmc_queue_pop(&g_tasks.jobs, &job))
+		task_execute(&job);
+
+	os_atomic_add_s32(&counter->sleepers, 1);
+	for (;;) {
+		const s32 value = os_atomic_load_s32(&counter->value);
+		if (value <= target)
+			break;
+		os_futex_wait(&counter->value, value, OS_WAIT_INFINITE);
+	}
+	os_atomic_add_s32(&counter->sleepers, -1);
+}
+
+static void task_wait_fiber(task_worker_t* worker, task_counter_t* counter,
+			    s32 target)
+{
+	for (;;) {
+		task_fiber_t* next = NULL;
+		if (mpmc_queue_pop(&g_tasks.ready_fibers, &next) ||
+		    mpmc_queue_pop(&g_tasks.free_fibers, &next)) {
+			task_fiber_t* self = worker->current;
+			self->wait_target = target;
+			worker->pending_wait = self;
+			worker->pending_counter = counter;
+			task_switch_to(worker, next);
+			return;
+		}
+
+		// Every fiber is parked. Sleeping here could stall the tasks
+		// that would free one, so make progress on this stack instead.
+		if (os_atomic_load_s32(&counter->value) <= target)
+			return;
+		task_job_t job;
+		if (mpmc_queue_pop(&g_tasks.jobs, &job))
+			task_execute(&job);
+		else
+			os_thread_yield();
+
+		// a nested wait in that task may have moved us to another thread
+		worker = task_current_worker();
+	}
+}
+
+// Keeps the first core, and another sharing its L3, for the main and sim
+// threads and gives every other physical core one worker. The reserved
+// cores' hyperthread siblings stay idle too, so a busy worker never
+// competes with the frame threads for a core.
+static u32 task_plan_workers(u64* worker_cpus)
+{
+	os_cpu_topology_t topo;
+	if (!os_get_cpu_topology(&topo))
+		logger(LOG_WARNING, "task_system_init - no cpu topology, "
+				    "assuming one core per cpu\n");
+	logger(LOG_INFO,
+	       "cpu topology: %u logical, %u cores, %u packages, %u L2, "
+	       "%u L3, %u numa nodes\n",
+	       topo.num_logical, topo.num_cores, topo.num_packages,
+	       topo.num_l2_groups, topo.num_l3_groups, topo.num_numa_nodes);
+
+	// too small to keep cores free, one unpinned worker
+	if (topo.num_cores <= TASK_RESERVED_CORES)
+		return 1;
+
+	const os_cpu_info_t* main_cpu = NULL;
+	u64 sim_core = 0;
+	for (u32 c = 0; c < OS_CPU_MAX; c++) {
+		if (!(topo.cpu_mask & (1ULL << c)))
+			continue;
+		const os_cpu_info_t* cpu = &topo.cpus[c];
+		if (main_cpu == NULL) {
+			main_cpu = cpu;
+		} else if (cpu->core != main_cpu->core) {
+			if (sim_core == 0 || cpu->l3 == main_cpu->l3)
+				sim_core = cpu->core;
+			if (cpu->l3 == main_cpu->l3)
+				break;
+		}
+	}
+	g_tasks.reserved_cpus[0] = main_cpu->core;
+	g_tasks.reserved_cpus[1] = sim_core;
+
+	u64 used = main_cpu->core | sim_core;
+	u32 count = 0;
+	for (u32 c = 0; c < OS_CPU_MAX && count < TASK_MAX_WORKERS; c++) {
+		if (!(topo.cpu_mask & (1ULL << c)) || (used & (1ULL << c)))
+			continue;
+		worker_cpus[count++] = topo.cpus[c].core;
+		used |= topo.cpus[c].core;
+	}
+
+	return count;
+}
+
+bool task_system_init(u32 num_workers)
+{
+	if (os_atomic_load_long(&g_tasks.running))
+		return true;
+
+	memset(&g_tasks, 0, sizeof(task_system_t));
+	u64 worker_cpus[TASK_MAX_WORKERS] = {0};
+	if (num_workers == TASK_WORKERS_AUTO)
+		num_workers = task_plan_workers(worker_cpus);
+	num_workers = MIN(num_workers, TASK_MAX_WORKERS);
+	if (num_workers == 0) {
+		logger(LOG_INFO, "task_system_init - no workers, tasks run "
+				 "inline\n");
+		return true;
+	}
+
+	if (!mpmc_queue_init(&g_tasks.jobs, jobs_mem, sizeof(jobs_mem),
+			     sizeof(task_job_t)) ||
+	    !mpmc_queue_init(&g_tasks.free_fibers, free_fibers_mem,
+			     sizeof(free_fibers_mem), sizeof(task_fiber_t*)) ||
+	    !mpmc_queue_init(&g_tasks.ready_fibers, ready_fibers_mem,
+			     sizeof(ready_fibers_mem), sizeof(task_fiber_t*)))
+		return false;
+
+	g_tasks.work_sem = os_sem_create(0);
+	if (g_tasks.work_sem == NULL) {
+		logger(LOG_ERROR, "task_system_init - error creating "
+				  "semaphore\n");
+		return false;
+	}
+
+	for (u32 i = 0; i < TASK_FIBER_COUNT; i++) {
+		task_fiber_t* fiber = &g_tasks.fibers[i];
+		fiber->fiber = os_fiber_create(TASK_FIBER_STACK_BYTES,
+					       task_fiber_main, fiber);
+		if (fiber->fiber == NULL) {
+			logger(LOG_ERROR, "task_system_init - error creating "
+					  "fiber %u\n", i);
+			task_system_shutdown();
+			return false;
+		}
+		mpmc_queue_push(&g_tasks.free_fibers, &fiber);
+	}
+
+	os_atomic_set_long(&g_tasks.running, 1);
+	for (u32 i = 0; i < num_workers; i++) {
+		task_worker_t* worker = &g_tasks.workers[i];
+		worker->index = (s32)i;
+		worker->cpus = worker_cpus[i];
+		snprintf(worker->name, sizeof(worker->name), "worker %u", i);
+		worker->thread = os_thread_create(task_worker_main, worker);
+		if (worker->thread == NULL) {
+			logger(LOG_ERROR, "task_system_init - error creating "
+					  "%s\n", worker->name);
+			task_system_shutdown();
+			return false;
+		}
+		g_tasks.num_workers = i + 1;
+	}
+
+	logger(LOG_INFO, "task_system_init OK - %u workers, %u fibers\n",
+	       num_workers, TASK_FIBER_COUNT);
+
+	return true;
+}
+
+void task_system_shutdown(void)
+{
+	os_atomic_set_long(&g_tasks.running, 0);
+	if (g_tasks.work_sem != NULL)
+		os_sem_post(g_tasks.work_sem, TASK_MAX_WORKERS);
+
+	for (u32 i = 0; i < g_tasks.num_workers; i++) {
+		task_worker_t* worker = &g_tasks.workers[i];
+		if (worker->thread != NULL)
+			os_thread_join(worker->thread);
+		worker->thread = NULL;
+	}
+	g_tasks.num_workers = 0;
+
+	for (u32 i = 0; i < TASK_FIBER_COUNT; i++) {
+		os_fiber_destroy(g_tasks.fibers[i].fiber);
+		g_tasks.fibers[i].fiber = NULL;
+	}
+
+	os_sem_destroy(g_tasks.work_sem);
+	g_tasks.work_sem = NULL;
+}
+
+u32 task_num_workers(void)
+{
+	return g_tasks.num_workers;
+}
+
+u64 task_reserved_cpus(u32 slot)
+{
+	return slot < TASK_RESERVED_CORES ? g_tasks.reserved_cpus[slot] : 0;
+}
+
+s32 task_worker_index(void)
+{
+	task_worker_t* worker = task_current_worker();
+	return worker ? worker->index : -1;
+}
+
+void task_run(const task_decl_t* decls, u32 count, task_counter_t* counter)
+{
+	if (counter != NULL)
+		os_atomic_add_s32(&counter->value, (s32)count);
+
+	const bool running = os_atomic_load_long(&g_tasks.running) != 0;
+	for (u32 i = 0; i < count; i++) {
+		task_job_t job = { decls[i].func, decls[i].param, counter };
+		// no workers or the queue is full, run it here
+		if (!running || !mpmc_queue_push(&g_tasks.jobs, &job))
+			task_execute(&job);
+	}
+
+	if (running)
+		task_wake_workers(count);
+}
+
+void task_wait(task_counter_t* counter, s32 target)
+{
+	if (os_atomic_load_s32(&counter->value) > target) {
+		task_worker_t* worker = task_current_worker();
+		if (worker != NULL && worker->current != NULL)
+			task_wait_fiber(worker, counter, target);
+		else
+			task_wait_blocking(counter, target);
+	}
+
+	// the last task may still be inside task_counter_dec, let it finish
+	// with the counter before the caller can free it
+	task_counter_lock(counter);
+	task_counter_unlock(counter);
+}
+
+void task_run_and_wait(const task_decl_t* decls, u32 count)
+{
+	task_counter_t counter = { 0, 0, 0, NULL };
+	task_run(decls, count, &counter);
+	task_wait(&counter, 0);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+// Fiber based task system. Worker threads pull tasks from a shared queue
+// and run them on fibers from a fixed pool. A task that waits on a counter
+// parks its fiber and the worker carries on with other work on a fresh
+// fiber; the parked fiber is resumed, possibly by another worker, once the
+// counter drops to the target.
+//
+// Threads outside the system (main, sim) can run and wait on tasks too.
+// They help by running queued tasks and then block on the counter.
+//
+// A task can resume on a different thread after task_wait, so don't keep
+// thread local state such as scratch arena temps or profiler scopes open
+// across a wait. Counters must outlive their tasks; waiting for zero
+// guarantees that.
+
+#define TASK_MAX_WORKERS 32
+#define TASK_QUEUE_SIZE 4096 // must be a power of two
+#define TASK_FIBER_COUNT 128
+#define TASK_FIBER_STACK_BYTES 262144 // 256KiB
+#define TASK_SCRATCH_BYTES 16777216 // 16MiB of address space per worker
+#define TASK_WORKERS_AUTO ((u32)-1) // size the pool from the CPU topology
+#define TASK_RESERVED_CORES 2 // kept free of workers for main and sim
+
+typedef void (*task_func_t)(void* param);
+
+typedef struct task_decl_s {
+	task_func_t func;
+	void* param;
+} task_decl_t;
+
+struct task_fiber_s;
+
+// Outstanding task count. Zero initialize before first use.
+typedef struct task_counter_s {
+	volatile s32 value;
+	volatile s32 sleepers;
+	volatile long lock;
+	struct task_fiber_s* waiters;
+} task_counter_t;
+
+// Before init (or with zero workers) task_run executes tasks inline.
+// TASK_WORKERS_AUTO pins one worker to every physical core except the
+// reserved ones; other counts leave workers unpinned.
+bool task_system_init(u32 num_workers);
+void task_system_shutdown(void);
+u32 task_num_workers(void);
+// Index of the calling worker thread, -1 outside the task system
+s32 task_worker_index(void);
+// CPUs of reserved core slot (0 main, 1 sim) for os_thread_set_affinity,
+// 0 when the pool was not sized from the topology
+u64 task_reserved_cpus(u32 slot);
+
+// Queues count tasks and adds count to counter, which may be NULL
+void task_run(const task_decl_t* decls, u32 count, task_counter_t* counter);
+// Returns once counter is at or below target
+void task_wait(task_counter_t* counter, s32 target);
+void task_run_and_wait(const task_decl_t* decls, u32 count);
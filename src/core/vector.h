@@ -1,5 +1,5 @@
-#ifndef H_BM_HASHMAP
-#define H_BM_HASHMAP
+#ifndef H_BM_VECTOR
+#define H_BM_VECTOR
 
 #include "core/types.h"
 #include "core/memory.h"
@@ -38,13 +38,9 @@ static inline void vector_ensure_capacity(struct vector* dst, size_t elem_size,
 	else
 		new_cap *= 2;
 
-	void *ptr = bm_malloc(elem_size * new_cap);
-	if (dst->elems) {
-		if (dst->capacity)
-			memcpy(ptr, dst->elems, elem_size * dst->capacity);
-
-		bm_free(dst->elems);
-	}
+	void *ptr = bm_realloc(dst->elems, elem_size * new_cap);
+	if (!ptr)
+		return;
 	dst->elems = ptr;
 	dst->capacity = new_cap;
 }
@@ -66,10 +62,14 @@ static inline size_t vector_size(const struct vector* vec, size_t elem_size)
 	return elem_size * vec->num_elems;
 }
 
-void vector_push_back(struct vector* dst, const void* elem, size_t elem_size)
+static inline bool vector_push_back(struct vector* dst, const void* elem, size_t elem_size)
 {
-	vector_ensure_capacity(dst, elem_size, ++dst->num_elems);
+	vector_ensure_capacity(dst, elem_size, dst->num_elems + 1);
+	if (dst->num_elems + 1 > dst->capacity)
+		return false;
+	dst->num_elems++;
 	memcpy(vector_end(dst, elem_size), elem, elem_size);
+	return true;
 }
 
 #endif
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "draw_list.h"
+#include "engine.h"
+#include "font.h"
+#include "tilemap.h"
+
+#include "core/logger.h"
+#include "core/memory.h"
+#include "core/profiler.h"
+
+#define DRAW_LIST_NEW 0x4
+
+// sort key layout, most significant first
+#define DRAW_KEY_LAYER_SHIFT 56   // 8 bits
+#define DRAW_KEY_TEXTURE_SHIFT 40 // 16 bits
+#define DRAW_KEY_BLEND_SHIFT 36   // 4 bits
+#define DRAW_KEY_DEPTH_SHIFT 12   // 24 bits
+#define DRAW_KEY_DEPTH_MAX 0xffffff
+
+static u64 draw_key(draw_layer_t layer, u16 texture_id, draw_blend_t blend,
+		    u32 depth)
+{
+	// UI keeps recording order, the stable sort leaves equal keys alone
+	if (layer == kDrawLayerUI)
+		return (u64)layer << DRAW_KEY_LAYER_SHIFT;
+
+	if (depth > DRAW_KEY_DEPTH_MAX)
+		depth = DRAW_KEY_DEPTH_MAX;
+
+	return ((u64)(layer & 0xff) << DRAW_KEY_LAYER_SHIFT) |
+	       ((u64)texture_id << DRAW_KEY_TEXTURE_SHIFT) |
+	       ((u64)(blend & 0xf) << DRAW_KEY_BLEND_SHIFT) |
+	       ((u64)depth << DRAW_KEY_DEPTH_SHIFT);
+}
+
+bool draw_list_init(draw_list_t* dl, size_t max_cmds, size_t max_text)
+{
+	dl->cmds = (draw_cmd_t*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(draw_cmd_t) * max_cmds, DEFAULT_ALIGNMENT,
+		kMemTagRender);
+	dl->text = (char*)arena_alloc_tagged(&g_mem_arena, max_text,
+					     DEFAULT_ALIGNMENT, kMemTagRender);
+	dl->sort_keys = (u64*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(u64) * max_cmds, DEFAULT_ALIGNMENT,
+		kMemTagRender);
+	dl->sort_keys_tmp = (u64*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(u64) * max_cmds, DEFAULT_ALIGNMENT,
+		kMemTagRender);
+	dl->sort_order = (u32*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(u32) * max_cmds, DEFAULT_ALIGNMENT,
+		kMemTagRender);
+	dl->sort_order_tmp = (u32*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(u32) * max_cmds, DEFAULT_ALIGNMENT,
+		kMemTagRender);
+	if (dl->cmds == NULL || dl->text == NULL || dl->sort_keys == NULL ||
+	    dl->sort_keys_tmp == NULL || dl->sort_order == NULL ||
+	    dl->sort_order_tmp == NULL)
+		return false;
+
+	dl->max_cmds = max_cmds;
+	dl->max_text = max_text;
+	draw_list_reset(dl);
+
+	return true;
+}
+
+void draw_list_reset(draw_list_t* dl)
+{
+	dl->num_cmds = 0;
+	dl->text_size = 0;
+	dl->num_textures = 0;
+}
+
+// Small per-list ids keep textures in 16 bits of the sort key. Ids are
+// only stable within one list, which is all the sort needs.
+static u16 draw_list_texture_id(draw_list_t* dl, SDL_Texture* texture)
+{
+	if (texture == NULL)
+		return 0;
+
+	for (size_t i = 0; i < dl->num_textures; i++) {
+		if (dl->textures[i] == texture)
+			return (u16)(i + 1);
+	}
+
+	// out of ids, the overflow textures share a key
+	if (dl->num_textures >= MAX_DRAW_TEXTURES)
+		return MAX_DRAW_TEXTURES + 1;
+
+	dl->textures[dl->num_textures++] = texture;
+
+	return (u16)dl->num_textures;
+}
+
+static draw_cmd_t* draw_list_push(draw_list_t* dl, draw_cmd_kind_t kind,
+				  u64 key)
+{
+	// list is full, drop the command
+	if (dl->num_cmds >= dl->max_cmds)
+		return NULL;
+
+	draw_cmd_t* cmd = &dl->cmds[dl->num_cmds++];
+	memset(cmd, 0, sizeof(draw_cmd_t));
+	cmd->kind = kind;
+	cmd->key = key;
+
+	return cmd;
+}
+
+void draw_list_clear(draw_list_t* dl, const rgba_t* color)
+{
+	draw_cmd_t* cmd = draw_list_push(
+		dl, kDrawCmdClear,
+		draw_key(kDrawLayerBackground, 0, kDrawBlendNone, 0));
+	if (cmd)
+		cmd->color = *color;
+}
+
+void draw_list_tilemap(draw_list_t* dl, const rect_t* camera)
+{
+	draw_cmd_t* cmd = draw_list_push(
+		dl, kDrawCmdTilemap,
+		draw_key(kDrawLayerBackground, 0, kDrawBlendNone, 1));
+	if (cmd)
+		cmd->dst = *camera;
+}
+
+void draw_list_texture(draw_list_t* dl, draw_layer_t layer, u32 depth,
+		       SDL_Texture* texture, const rect_t* src,
+		       const rect_t* dst, f32 angle, bool flip)
+{
+	const u16 texture_id = draw_list_texture_id(dl, texture);
+	draw_cmd_t* cmd = draw_list_push(
+		dl, kDrawCmdTexture,
+		draw_key(layer, texture_id, kDrawBlendAlpha, depth));
+	if (cmd) {
+		cmd->texture = texture;
+		cmd->src = *src;
+		cmd->dst = *dst;
+		cmd->angle = angle;
+		cmd->flip = flip;
+	}
+}
+
+// translucent rects blend, opaque ones skip the blend entirely
+static draw_blend_t draw_rect_blend(const rgba_t* color)
+{
+	return color->a < 0xff ? kDrawBlendAlpha : kDrawBlendNone;
+}
+
+void draw_list_rect_outline(draw_list_t* dl, draw_layer_t layer,
+			    const rect_t* rect, const rgba_t* color)
+{
+	draw_cmd_t* cmd =
+		draw_list_push(dl, kDrawCmdRectOutline,
+			       draw_key(layer, 0, draw_rect_blend(color), 0));
+	if (cmd) {
+		cmd->dst = *rect;
+		cmd->color = *color;
+	}
+}
+
+void draw_list_rect_solid(draw_list_t* dl, draw_layer_t layer,
+			  const rect_t* rect, const rgba_t* color)
+{
+	draw_cmd_t* cmd =
+		draw_list_push(dl, kDrawCmdRectSolid,
+			       draw_key(layer, 0, draw_rect_blend(color), 0));
+	if (cmd) {
+		cmd->dst = *rect;
+		cmd->color = *color;
+	}
+}
+
+void draw_list_text(draw_list_t* dl, draw_layer_t layer,
+		    SDL_Texture* texture, s32 x, s32 y, f32 scale,
+		    const char* text)
+{
+	const size_t len = strlen(text) + 1;
+	if (dl->text_size + len > dl->max_text)
+		return;
+
+	const u16 texture_id = draw_list_texture_id(dl, texture);
+	draw_cmd_t* cmd = draw_list_push(
+		dl, kDrawCmdText,
+		draw_key(layer, texture_id, kDrawBlendAlpha, 0));
+	if (cmd) {
+		cmd->texture = texture;
+		cmd->dst.x = x;
+		cmd->dst.y = y;
+		cmd->scale = scale;
+		cmd->text_offset = dl->text_size;
+		memcpy(&dl->text[dl->text_size], text, len);
+		dl->text_size += len;
+	}
+}
+
+// LSD radix sort of the command keys, 8 bits per pass. The sort is stable
+// and passes where every key has the same byte are skipped, so usually
+// only the layer, texture and depth bytes are visited.
+void draw_list_sort(draw_list_t* dl)
+{
+	const size_t n = dl->num_cmds;
+	u64* keys = dl->sort_keys;
+	u32* order = dl->sort_order;
+	u64* keys_tmp = dl->sort_keys_tmp;
+	u32* order_tmp = dl->sort_order_tmp;
+
+	size_t counts[8][256];
+	memset(counts, 0, sizeof(counts));
+	for (size_t i = 0; i < n; i++) {
+		const u64 key = dl->cmds[i].key;
+		keys[i] = key;
+		order[i] = (u32)i;
+		for (s32 pass = 0; pass < 8; pass++)
+			counts[pass][(key >> (pass * 8)) & 0xff]++;
+	}
+
+	for (s32 pass = 0; pass < 8; pass++) {
+		const s32 shift = pass * 8;
+		size_t* count = counts[pass];
+		if (n == 0 || count[(keys[0] >> shift) & 0xff] == n)
+			continue;
+
+		size_t offset = 0;
+		for (s32 b = 0; b < 256; b++) {
+			const size_t c = count[b];
+			count[b] = offset;
+			offset += c;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			const size_t dst = count[(keys[i] >> shift) & 0xff]++;
+			keys_tmp[dst] = keys[i];
+			order_tmp[dst] = order[i];
+		}
+
+		u64* swap_keys = keys;
+		keys = keys_tmp;
+		keys_tmp = swap_keys;
+		u32* swap_order = order;
+		order = order_tmp;
+		order_tmp = swap_order;
+	}
+
+	// leave the result in sort_order regardless of the number of passes
+	if (order != dl->sort_order)
+		memcpy(dl->sort_order, order, sizeof(u32) * n);
+}
+
+// Renderer state as last set by submit, used to skip redundant changes.
+typedef struct draw_state_s {
+	rgba_t color;
+	draw_blend_t blend;
+	bool valid;
+} draw_state_t;
+
+static void draw_state_set(SDL_Renderer* ren, draw_state_t* state,
+			   const rgba_t* color, draw_blend_t blend)
+{
+	if (!state->valid || state->color.r != color->r ||
+	    state->color.g != color->g || state->color.b != color->b ||
+	    state->color.a != color->a) {
+		SDL_SetRenderDrawColor(ren, color->r, color->g, color->b,
+				       color->a);
+		state->color = *color;
+	}
+	if (!state->valid || state->blend != blend) {
+		SDL_SetRenderDrawBlendMode(ren, blend == kDrawBlendAlpha
+							? SDL_BLENDMODE_BLEND
+							: SDL_BLENDMODE_NONE);
+		state->blend = blend;
+	}
+	state->valid = true;
+}
+
+void draw_list_submit(engine_t* eng, draw_list_t* dl)
+{
+	SDL_Renderer* ren = eng->renderer;
+	draw_state_t state = {0};
+
+	BM_PROFILE_SCOPE("draw_list_sort") {
+		draw_list_sort(dl);
+	}
+
+	for (size_t i = 0; i < dl->num_cmds; i++) {
+		const draw_cmd_t* cmd = &dl->cmds[dl->sort_order[i]];
+		switch (cmd->kind) {
+		case kDrawCmdClear:
+			draw_state_set(ren, &state, &cmd->color,
+				       kDrawBlendNone);
+			SDL_RenderClear(ren);
+			break;
+		case kDrawCmdTilemap:
+			tilemap_draw(&eng->tilemap, ren, &cmd->dst);
+			break;
+		case kDrawCmdTexture:
+			SDL_RenderCopyEx(ren, cmd->texture,
+					 (const SDL_Rect*)&cmd->src,
+					 (const SDL_Rect*)&cmd->dst, cmd->angle,
+					 NULL,
+					 cmd->flip ? SDL_FLIP_HORIZONTAL
+						   : SDL_FLIP_NONE);
+			break;
+		case kDrawCmdRectOutline:
+			draw_state_set(ren, &state, &cmd->color,
+				       draw_rect_blend(&cmd->color));
+			SDL_RenderDrawRect(ren, (const SDL_Rect*)&cmd->dst);
+			break;
+		case kDrawCmdRectSolid:
+			draw_state_set(ren, &state, &cmd->color,
+				       draw_rect_blend(&cmd->color));
+			SDL_RenderFillRect(ren, (const SDL_Rect*)&cmd->dst);
+			break;
+		case kDrawCmdText:
+			font_draw(&eng->font, ren, cmd->dst.x, cmd->dst.y,
+				  cmd->scale, &dl->text[cmd->text_offset]);
+			break;
+		}
+	}
+}
+
+bool draw_buffers_init(draw_buffers_t* db)
+{
+	for (s32 i = 0; i < NUM_DRAW_LISTS; i++) {
+		if (!draw_list_init(&db->lists[i], MAX_DRAW_CMDS,
+				    MAX_DRAW_TEXT)) {
+			logger(LOG_ERROR, "Error allocating draw list %d\n", i);
+			return false;
+		}
+	}
+
+	db->write_idx = 0;
+	db->read_idx = 1;
+	SDL_AtomicSet(&db->pending, 2);
+
+	db->ready = SDL_CreateSemaphore(0);
+	if (db->ready == NULL) {
+		logger(LOG_ERROR, "Error creating draw list semaphore: %s\n",
+		       SDL_GetError());
+		return false;
+	}
+
+	return true;
+}
+
+void draw_buffers_shutdown(draw_buffers_t* db)
+{
+	if (db->ready) {
+		SDL_DestroySemaphore(db->ready);
+		db->ready = NULL;
+	}
+}
+
+draw_list_t* draw_buffers_begin(draw_buffers_t* db)
+{
+	draw_list_t* dl = &db->lists[db->write_idx];
+	draw_list_reset(dl);
+
+	return dl;
+}
+
+// Hand the finished write list to the renderer and take whichever list it
+// is not currently reading. An unread list left in pending is recycled.
+void draw_buffers_publish(draw_buffers_t* db)
+{
+	const s32 prev = SDL_AtomicSet(&db->pending,
+				       db->write_idx | DRAW_LIST_NEW);
+	db->write_idx = prev & ~DRAW_LIST_NEW;
+	SDL_SemPost(db->ready);
+}
+
+// Returns the newest completed list, or NULL if none arrived within
+// timeout_ms. The list stays valid until the next acquire.
+draw_list_t* draw_buffers_acquire(draw_buffers_t* db, u32 timeout_ms)
+{
+	SDL_SemWaitTimeout(db->ready, timeout_ms);
+	// drain extra posts from frames that were skipped
+	while (SDL_SemTryWait(db->ready) == 0)
+		;
+
+	if (!(SDL_AtomicGet(&db->pending) & DRAW_LIST_NEW))
+		return NULL;
+
+	const s32 prev = SDL_AtomicSet(&db->pending, db->read_idx);
+	db->read_idx = prev & ~DRAW_LIST_NEW;
+
+	return &db->lists[db->read_idx];
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+#include "math/vec4.h"
+
+#include <SDL.h>
+
+typedef struct engine_s engine_t;
+
+#define MAX_DRAW_CMDS 4096
+#define MAX_DRAW_TEXT 16384 // bytes of text per draw list
+#define NUM_DRAW_LISTS 3
+#define MAX_DRAW_TEXTURES 256 // distinct textures per list with their own key
+
+// Layers are drawn back to front. Within a layer commands are grouped by
+// texture and blend mode, then ordered by depth. Commands with equal keys
+// keep the order they were recorded in. The UI layer isn't grouped at all,
+// so a panel recorded later always covers the UI drawn before it.
+typedef enum {
+	kDrawLayerBackground,
+	kDrawLayerWorld,
+	kDrawLayerDebug,
+	kDrawLayerUI,
+	kDrawLayerMax,
+} draw_layer_t;
+
+typedef enum {
+	kDrawBlendNone,
+	kDrawBlendAlpha,
+} draw_blend_t;
+
+typedef enum {
+	kDrawCmdClear,
+	kDrawCmdTilemap,
+	kDrawCmdTexture,
+	kDrawCmdRectOutline,
+	kDrawCmdRectSolid,
+	kDrawCmdText,
+} draw_cmd_kind_t;
+
+// One recorded render operation. The simulation records these and the
+// render thread replays them, so nothing in here may point at sim state
+// that changes between frames.
+typedef struct draw_cmd_s {
+	u64 key; // layer | texture | blend | depth
+	draw_cmd_kind_t kind;
+	rgba_t color;
+	rect_t dst; // camera rect for kDrawCmdTilemap
+	rect_t src;
+	SDL_Texture* texture;
+	f32 angle;
+	bool flip;
+	f32 scale;
+	size_t text_offset;
+} draw_cmd_t;
+
+typedef struct draw_list_s {
+	draw_cmd_t* cmds;
+	size_t num_cmds;
+	size_t max_cmds;
+	char* text;
+	size_t text_size;
+	size_t max_text;
+	SDL_Texture* textures[MAX_DRAW_TEXTURES]; // index + 1 is the sort key id
+	size_t num_textures;
+	// scratch for sorting, only touched by the render thread
+	u64* sort_keys;
+	u32* sort_order;
+	u64* sort_keys_tmp;
+	u32* sort_order_tmp;
+} draw_list_t;
+
+// Triple buffered draw lists. The sim always has a list to write into
+// and the renderer always has the most recently completed one, so
+// neither side waits on the other.
+typedef struct draw_buffers_s {
+	draw_list_t lists[NUM_DRAW_LISTS];
+	s32 write_idx; // owned by the sim thread
+	s32 read_idx;  // owned by the render thread
+	SDL_atomic_t pending; // completed list index | DRAW_LIST_NEW
+	SDL_sem* ready;
+} draw_buffers_t;
+
+bool draw_list_init(draw_list_t* dl, size_t max_cmds, size_t max_text);
+void draw_list_reset(draw_list_t* dl);
+void draw_list_clear(draw_list_t* dl, const rgba_t* color);
+void draw_list_tilemap(draw_list_t* dl, const rect_t* camera);
+void draw_list_texture(draw_list_t* dl, draw_layer_t layer, u32 depth,
+		       SDL_Texture* texture, const rect_t* src,
+		       const rect_t* dst, f32 angle, bool flip);
+void draw_list_rect_outline(draw_list_t* dl, draw_layer_t layer,
+			    const rect_t* rect, const rgba_t* color);
+void draw_list_rect_solid(draw_list_t* dl, draw_layer_t layer,
+			  const rect_t* rect, const rgba_t* color);
+void draw_list_text(draw_list_t* dl, draw_layer_t layer,
+		    SDL_Texture* texture, s32 x, s32 y, f32 scale,
+		    const char* text);
+void draw_list_sort(draw_list_t* dl);
+void draw_list_submit(engine_t* eng, draw_list_t* dl);
+
+bool draw_buffers_init(draw_buffers_t* db);
+void draw_buffers_shutdown(draw_buffers_t* db);
+draw_list_t* draw_buffers_begin(draw_buffers_t* db);
+void draw_buffers_publish(draw_buffers_t* db);
+draw_list_t* draw_buffers_acquire(draw_buffers_t* db, u32 timeout_ms);
@@ -21,8 +21,11 @@
 #include "input.h"
 #include "resource.h"
 
+#include "core/intern.h"
 #include "core/logger.h"
 #include "core/memory.h"
+#include "core/profiler.h"
+#include "core/task.h"
 #include "core/time_convert.h"
 #include "core/utils.h"
 #include "core/video.h"
@@ -40,6 +43,11 @@
 #include <SDL.h>
 #include <SDL_mixer.h>
 
+#define FRAME_STATS_CSV "frame_stats.csv"
+#define FRAME_GRAPH_DOT "frame_graph.dot"
+#define PROFILER_TRACE_JSON "profile.json"
+#define MEMORY_STATS_JSON "memory.json"
+
 #define SDL_FLAGS                                                             \
 	(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS | SDL_INIT_TIMER | \
 	 SDL_INIT_GAMECONTROLLER)
@@ -47,6 +55,8 @@
 engine_t* engine = NULL;
 
 static u64 engine_start_ticks = 0ULL;
+static u64 engine_frame_ns = 0ULL; // engine time at the current sim frame
+static eng_update_t engine_update = NULL;
 
 void eng_init_time(void)
 {
@@ -60,27 +70,58 @@ u64 eng_get_time_ns(void)
 
 f64 eng_get_time_sec(void)
 {
-	return nsec_to_sec_f64(eng_get_time_ns());
+	return nsec_to_sec_f64(engine_frame_ns);
+}
+
+resource_handle_t eng_get_resource_handle(engine_t* eng, const char* name)
+{
+	const str_id_t id = intern_find(name);
+	void* elem = NULL;
+	if (id == STR_ID_NONE ||
+	    !hashmap_find_int(&eng->resource_map, id, &elem))
+		return INVALID_RESOURCE_HANDLE;
+
+	return (resource_handle_t)(intptr_t)elem;
 }
 
 game_resource_t* eng_get_resource(engine_t* eng, const char* name)
 {
-	game_resource_t* rsrc = NULL;
-	for (size_t rdx = 0; rdx < MAX_GAME_RESOURCES; rdx++) {
-		if (!strcmp(eng->game_resources[rdx]->name, name)) {
-			rsrc = eng->game_resources[rdx];
-			break;
-		}
-	}
+	return eng_get_resource_by_handle(eng,
+					  eng_get_resource_handle(eng, name));
+}
+
+// Resolves the name into *handle on first use so later calls skip hashing.
+game_resource_t* eng_get_resource_cached(engine_t* eng,
+					 resource_handle_t* handle,
+					 const char* name)
+{
+	if (*handle == INVALID_RESOURCE_HANDLE)
+		*handle = eng_get_resource_handle(eng, name);
+
+	return eng_get_resource_by_handle(eng, *handle);
+}
 
-	return rsrc;
+static void eng_pass_commands(engine_t* eng, f64 dt)
+{
+	cmd_refresh(eng);
+}
+
+// Input is read and events are pumped on the main thread, the graph only
+// covers the sim side of the frame.
+static void eng_add_passes(frame_graph_t* graph)
+{
+	frame_graph_add_pass(graph, "cmd_refresh", eng_pass_commands,
+			     FRAME_RES(kFrameResInput),
+			     FRAME_RES(kFrameResEngine) |
+				     FRAME_RES(kFrameResInput));
+	ent_add_passes(graph);
 }
 
 bool eng_init(const char* name, s32 version, engine_t* eng)
 {
 	u64 init_start = os_get_time_ns();
 
-	eng->frame_count = 0;
+	SDL_AtomicSet(&eng->frame_count, 0);
 
 	// build window title
 	char ver_str[12];
@@ -281,7 +322,8 @@ bool eng_init(const char* name, s32 version, engine_t* eng)
 	exit(0);
 #endif
 	eng->renderer = SDL_CreateRenderer(eng->window, eng->adapter_index,
-					   SDL_RENDERER_ACCELERATED);
+					   SDL_RENDERER_ACCELERATED |
+						   SDL_RENDERER_TARGETTEXTURE);
 	if (eng->renderer == NULL) {
 		logger(LOG_ERROR, "error creating engine renderer: %s\n",
 		       SDL_GetError());
@@ -316,10 +358,18 @@ bool eng_init(const char* name, s32 version, engine_t* eng)
 		&g_mem_arena, sizeof(input_state_t), DEFAULT_ALIGNMENT);
 	memset(eng->inputs, 0, sizeof(input_state_t));
 
-	eng->audio = (audio_state_t*)arena_alloc(
-		&g_mem_arena, sizeof(audio_state_t), DEFAULT_ALIGNMENT);
+	eng->audio = (audio_state_t*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(audio_state_t), DEFAULT_ALIGNMENT,
+		kMemTagAudio);
 	memset(eng->audio, 0, sizeof(audio_state_t));
 
+	void* frame_buf = arena_alloc_tagged(&g_mem_arena, FRAME_ARENA_BYTES,
+					     DEFAULT_ALIGNMENT, kMemTagScratch);
+	if (frame_buf == NULL)
+		return false;
+	arena_init(&g_frame_arena, frame_buf, FRAME_ARENA_BYTES);
+	g_frame_arena.flags |= kArenaNested;
+
 	if (!audio_init(BM_NUM_AUDIO_CHANNELS, BM_AUDIO_SAMPLE_RATE,
 			BM_AUDIO_CHUNK_SIZE))
 		return false;
@@ -332,11 +382,28 @@ bool eng_init(const char* name, s32 version, engine_t* eng)
 		return false;
 	eng_init_time();
 
+	eng->input_lock = SDL_CreateMutex();
+	if (eng->input_lock == NULL) {
+		logger(LOG_ERROR, "error creating input lock: %s\n",
+		       SDL_GetError());
+		return false;
+	}
+	if (!draw_buffers_init(&eng->draw_buffers))
+		return false;
+	if (!frame_stats_init(&eng->frame_stats))
+		return false;
+	// the main and sim threads are busy every frame, workers get the rest
+	if (!task_system_init(TASK_WORKERS_AUTO))
+		return false;
+	eng_add_passes(&eng->frame_graph);
+	frame_graph_build(&eng->frame_graph);
+	eng->draw_list = draw_buffers_begin(&eng->draw_buffers);
+
 	eng->font.rsrc = eng_get_resource(eng, "font_7px");
 	eng->font.sprite = (sprite_t*)eng->font.rsrc->data;
 
 	eng->target_frametime = FRAME_TIME(eng->target_fps);
-	eng->mode = kEngineModeStartup;
+	SDL_AtomicSet(&eng->mode, kEngineModeStartup);
 
 	f64 init_end_msec = nsec_to_msec_f64(os_get_time_ns() - init_start);
 	logger(LOG_INFO, "eng_init OK [%fms]\n", init_end_msec);
@@ -344,26 +411,174 @@ bool eng_init(const char* name, s32 version, engine_t* eng)
 	return true;
 }
 
-void eng_refresh(engine_t* eng, f64 dt)
+// SDL only allows event pumping on the thread that created the window
+static void eng_pump_events(engine_t* eng)
 {
+	SDL_LockMutex(eng->input_lock);
+
 	inp_refresh_mouse(&eng->inputs->mouse, eng->render_scale.x,
 			  eng->render_scale.y);
 
 	SDL_Event event;
 	while (SDL_PollEvent(&event)) {
+		// render target contents are lost on device reset
+		if (event.type == SDL_RENDER_TARGETS_RESET ||
+		    event.type == SDL_RENDER_DEVICE_RESET)
+			tilemap_invalidate(&eng->tilemap);
 		inp_refresh_pressed(eng->inputs, &event);
 	}
 
-	cmd_refresh(eng);
-	ent_refresh(eng, dt);
+	SDL_UnlockMutex(eng->input_lock);
+}
+
+void eng_refresh(engine_t* eng, f64 dt)
+{
+	frame_graph_execute(&eng->frame_graph, eng, dt);
+}
+
+// Moves a frame thread onto the core the task system kept free for it
+static void eng_pin_thread(u32 slot, const char* name)
+{
+	const u64 cpus = task_reserved_cpus(slot);
+	if (cpus != 0 && !os_thread_set_affinity(cpus))
+		logger(LOG_DEBUG, "%s thread could not be pinned\n", name);
+}
+
+static int eng_sim_thread(void* data)
+{
+	engine_t* eng = (engine_t*)data;
+
+	BM_PROFILE_THREAD("sim");
+	eng_pin_thread(1, "sim");
+
+	// the frame arena was set up on the main thread, the sim owns it now
+	arena_set_owner(&g_frame_arena);
+	if (!arena_thread_init(THREAD_SCRATCH_BYTES))
+		logger(LOG_WARNING, "sim thread has no scratch arena\n");
+
+	f64 dt = 0.0;
+	frame_pacer_init(&eng->pacer);
+	while (SDL_AtomicGet(&eng->mode) != kEngineModeShutdown) {
+		const u64 frame_start_ns = os_get_time_ns();
+		engine_frame_ns = frame_start_ns - engine_start_ticks;
+
+		arena_free_all(&g_frame_arena);
+
+		BM_PROFILE_SCOPE("sim_update") {
+			SDL_LockMutex(eng->input_lock);
+			eng->draw_list = draw_buffers_begin(&eng->draw_buffers);
+			engine_update(eng, dt);
+			SDL_UnlockMutex(eng->input_lock);
+		}
+
+		draw_buffers_publish(&eng->draw_buffers);
+		const u64 sim_end_ns = os_get_time_ns();
+
+		const f64 target_frametime = eng->target_frametime;
+		BM_PROFILE_SCOPE("frame_pacer_wait") {
+			dt = frame_pacer_wait(&eng->pacer, target_frametime);
+		}
+		const u64 frame_end_ns = os_get_time_ns();
+
+		frame_stats_record(&eng->frame_stats,
+				   (u64)SDL_AtomicGet(&eng->frame_count),
+				   sim_end_ns - frame_start_ns,
+				   frame_end_ns - sim_end_ns,
+				   frame_end_ns - frame_start_ns,
+				   target_frametime);
+		SDL_AtomicAdd(&eng->frame_count, 1);
+	}
+
+	arena_thread_shutdown();
+	SDL_AtomicSet(&eng->sim_running, 0);
+	SDL_SemPost(eng->draw_buffers.ready);
+
+	return 0;
+}
+
+// Runs the simulation on its own thread while this (main) thread pumps
+// events and replays the newest completed draw list. Returns once the sim
+// reaches kEngineModeShutdown.
+bool eng_run(engine_t* eng, eng_update_t update)
+{
+	engine_update = update;
+	SDL_AtomicSet(&eng->sim_running, 1);
+	eng->sim_thread = SDL_CreateThread(eng_sim_thread, "sim", eng);
+	if (eng->sim_thread == NULL) {
+		logger(LOG_ERROR, "error creating sim thread: %s\n",
+		       SDL_GetError());
+		return false;
+	}
+
+	BM_PROFILE_THREAD("main");
+	eng_pin_thread(0, "main");
+
+	bool fullscreen = SDL_AtomicGet(&eng->fullscreen) != 0;
+	while (SDL_AtomicGet(&eng->sim_running)) {
+		u64 phase_start_ns = os_get_time_ns();
+		BM_PROFILE_SCOPE("eng_pump_events") {
+			eng_pump_events(eng);
+		}
+		frame_stats_set_phase(&eng->frame_stats, kFramePhaseInput,
+				      os_get_time_ns() - phase_start_ns);
+
+		if (fullscreen != (SDL_AtomicGet(&eng->fullscreen) != 0)) {
+			fullscreen = !fullscreen;
+			eng_toggle_fullscreen(eng, fullscreen);
+		}
+
+		draw_list_t* dl = draw_buffers_acquire(&eng->draw_buffers, 1);
+		if (dl != NULL) {
+			phase_start_ns = os_get_time_ns();
+			BM_PROFILE_SCOPE("draw_list_submit") {
+				draw_list_submit(eng, dl);
+			}
+			const u64 present_start_ns = os_get_time_ns();
+			BM_PROFILE_SCOPE("SDL_RenderPresent") {
+				SDL_RenderPresent(eng->renderer);
+			}
+			const u64 present_end_ns = os_get_time_ns();
+
+			frame_stats_set_phase(&eng->frame_stats,
+					      kFramePhaseRender,
+					      present_start_ns - phase_start_ns);
+			frame_stats_set_phase(&eng->frame_stats,
+					      kFramePhasePresent,
+					      present_end_ns - present_start_ns);
+		}
+	}
+
+	SDL_WaitThread(eng->sim_thread, NULL);
+	eng->sim_thread = NULL;
+
+	return true;
 }
 
 void eng_shutdown(engine_t* eng)
 {
+	task_system_shutdown();
+	frame_pacer_log_stats(&eng->pacer);
+	frame_stats_log(&eng->frame_stats);
+	frame_stats_write_csv(&eng->frame_stats, FRAME_STATS_CSV);
+	frame_graph_log(&eng->frame_graph);
+	frame_graph_write_dot(&eng->frame_graph, FRAME_GRAPH_DOT);
+	BM_PROFILE_DUMP(PROFILER_TRACE_JSON);
+	mem_log_stats();
+	mem_write_json(MEMORY_STATS_JSON);
+	BM_PROFILE_SHUTDOWN();
 	ent_shutdown(eng->ent_list);
 	cmd_shutdown();
 	inp_shutdown(eng->inputs);
 	audio_shutdown();
+	tilemap_shutdown(&eng->tilemap);
+	font_shutdown(&eng->font);
+	atlas_shutdown(&eng->atlas);
+	hashmap_destroy(&eng->resource_map);
+	draw_buffers_shutdown(&eng->draw_buffers);
+	if (eng->input_lock) {
+		SDL_DestroyMutex(eng->input_lock);
+		eng->input_lock = NULL;
+	}
 
 	// SDL_FreeSurface(eng->scr_surface);
 	// SDL_DestroyTexture(eng->scr_texture);
@@ -385,16 +600,14 @@ void eng_play_sound(engine_t* eng, const char* name, s32 volume)
 	if (resource != NULL) {
 		audio_chunk_t* sound_chunk = (audio_chunk_t*)resource->data;
 		if (resource->type == kAssetTypeSoundEffect) {
-			sound_chunk->volume = volume;
-			int play_ok =
-				Mix_PlayChannel(-1, (Mix_Chunk*)sound_chunk, 0);
-			if (play_ok < 0)
+			if (audio_play_sound(sound_chunk, volume) == NULL)
 				logger(LOG_ERROR, "Error playing sound: %s",
-				       resource->name);
+				       intern_str(resource->name));
 		} else if (resource->type == kAssetTypeMusic) {
 			if (eng->audio->music == NULL) {
 				eng->audio->music =
-					(Mix_Music*)Mix_LoadMUS(resource->path);
+					(Mix_Music*)Mix_LoadMUS(
+						intern_str(resource->path));
 			}
 			if (!eng->audio->music_playing) {
 				Mix_VolumeMusic(volume);
@@ -16,19 +16,28 @@
 
 #pragma once
 
+#include "atlas.h"
+#include "draw_list.h"
 #include "entity.h"
 #include "font.h"
+#include "frame_graph.h"
+#include "frame_pacer.h"
+#include "frame_stats.h"
+#include "resource.h"
 #include "sprite.h"
+#include "tilemap.h"
 
 #include "math/types.h"
+#include "core/hashmap.h"
 
 typedef struct SDL_Window SDL_Window;
 typedef struct SDL_Renderer SDL_Renderer;
 typedef struct SDL_Surface SDL_Surface;
 typedef struct SDL_Texture SDL_Texture;
+typedef struct SDL_Thread SDL_Thread;
+typedef struct SDL_mutex SDL_mutex;
 
 typedef struct input_state_s input_state_t;
-typedef struct game_resource_s game_resource_t;
 typedef struct audio_state_s audio_state_t;
 
 typedef enum {
@@ -48,7 +57,7 @@ struct engine_s {
 	s32 adapter_index;
 	char window_title[TEMP_STRING_MAX];
 	SDL_Window* window;
-	bool fullscreen;
+	SDL_atomic_t fullscreen; // set by the sim, applied on the main thread
 	SDL_Renderer* renderer;
 	// SDL_Surface* scr_surface;
 	// SDL_Texture* scr_texture;
@@ -58,30 +67,60 @@ struct engine_s {
 	vec2f_t render_scale;
 	f32 target_fps;
 	f64 target_frametime;
-	u64 frame_count;
+	frame_pacer_t pacer;
+	frame_stats_t frame_stats;
+	frame_graph_t frame_graph;
+	SDL_atomic_t frame_count;
 	f64 spawn_timer[MAX_SPAWN_TIMERS];
-	engine_mode_t mode;
+	SDL_atomic_t mode; // engine_mode_t
 	bool debug;
 	bool console;
 	rect_t console_bounds;
 	entity_t* ent_list;
 	game_resource_t** game_resources;
+	size_t num_game_resources;
+	hashmap_t resource_map;
+	texture_atlas_t atlas;
+	tilemap_t tilemap;
 	font_t font;
 	input_state_t* inputs;
 	audio_state_t* audio;
+	draw_buffers_t draw_buffers;
+	draw_list_t* draw_list; // list the sim is currently recording into
+	SDL_Thread* sim_thread;
+	SDL_mutex* input_lock; // held while pumping events and during a sim step
+	SDL_atomic_t sim_running;
 };
 
+// Per frame game logic, called on the sim thread with input_lock held.
+typedef void (*eng_update_t)(engine_t* eng, f64 dt);
+
 extern engine_t* engine;
 
 bool eng_init(const char* name, s32 version, engine_t* eng);
 void eng_refresh(engine_t* eng, f64 dt);
+bool eng_run(engine_t* eng, eng_update_t update);
 void eng_shutdown(engine_t* eng);
 
 void eng_init_time(void);
 u64 eng_get_time_ns(void);
+// Gameplay clock, sampled once at the start of each sim frame so every
+// pass sees the same time. Use eng_get_time_ns to measure.
 f64 eng_get_time_sec(void);
 
 game_resource_t* eng_get_resource(engine_t* eng, const char* name);
+resource_handle_t eng_get_resource_handle(engine_t* eng, const char* name);
+game_resource_t* eng_get_resource_cached(engine_t* eng,
+					 resource_handle_t* handle,
+					 const char* name);
+
+static inline game_resource_t*
+eng_get_resource_by_handle(engine_t* eng, resource_handle_t handle)
+{
+	if (handle < 0 || (size_t)handle >= eng->num_game_resources)
+		return NULL;
+	return eng->game_resources[handle];
+}
 
 void eng_play_sound(engine_t* eng, const char* name, s32 volume);
 void eng_stop_music(engine_t* eng);
@@ -16,14 +16,20 @@
 
 #include "audio.h"
 #include "command.h"
+#include "draw_list.h"
 #include "entity.h"
 #include "font.h"
+#include "frame_graph.h"
 #include "input.h"
 #include "render.h"
 #include "resource.h"
 
+#include "core/array.h"
+#include "core/intern.h"
 #include "core/logger.h"
 #include "core/memory.h"
+#include "core/pool.h"
+#include "core/profiler.h"
 #include "core/random.h"
 #include "core/rect.h"
 #include "core/time_convert.h"
@@ -35,6 +41,8 @@
 
 #include <SDL.h>
 
+#include <assert.h>
+
 static const s32 kPlayerCaps = (kEntityPlayer | kEntityMover | kEntityCollider |
 				kEntityShooter | kEntityRenderable);
 
@@ -54,26 +62,81 @@ static const f32 kGravity = 9.8f;
 
 static const f32 kBulletSpeedMultiplier = 24000.f;
 
+typedef struct ent_collision_s {
+	entity_t* a;
+	entity_t* b;
+} ent_collision_t;
+
+BM_ARRAY_DEFINE(ent_collision, ent_collision_t, 64)
+
+// intersecting collider pairs, written by the collide pass and consumed
+// by the resolve pass later in the same frame. The collide pass can run
+// on a worker, so spills go to the heap rather than the frame arena.
+static BM_ARRAY(ent_collision) ent_collisions;
+
+// Free slots in the entity list. A fresh pool hands slots out lowest index
+// first, which keeps the player in slot 0. After that the most recently
+// despawned slot is reused first.
+static pool_t ent_pool;
+
+// interned once so per-frame name checks are integer compares
+static str_id_t name_player = STR_ID_NONE;
+static str_id_t name_satellite = STR_ID_NONE;
+static str_id_t name_bullet = STR_ID_NONE;
+static str_id_t name_enemy = STR_ID_NONE;
+
+static entity_t* ent_by_name_id(entity_t* ent_list, str_id_t id)
+{
+	if (id == STR_ID_NONE)
+		return NULL;
+
+	for (size_t edx = 0; edx < MAX_ENTITIES; edx++) {
+		entity_t* e = &ent_list[edx];
+		if (ent_has_no_caps(e))
+			continue; // free slots hold the pool's free list
+		if (e->name == id)
+			return e;
+	}
+
+	return NULL;
+}
+
 bool ent_init(entity_t** ent_list, const s32 num_ents)
 {
 	if (ent_list == NULL)
 		return false;
 
 	const size_t sz_ent_list = sizeof(entity_t) * num_ents;
-	*ent_list = (entity_t*)arena_alloc(&g_mem_arena, sz_ent_list,
-					   DEFAULT_ALIGNMENT);
+	*ent_list = (entity_t*)arena_alloc_tagged(
+		&g_mem_arena, sz_ent_list, DEFAULT_ALIGNMENT, kMemTagEntities);
+	if (*ent_list == NULL)
+		return false;
 	memset(*ent_list, 0, sz_ent_list);
 
+	// Entities are walked as ent_list[i], so every pool slot has to be
+	// exactly one entity_t. Rounding the slot up to a larger alignment
+	// would shift slots off their list index.
+	if (!pool_init(&ent_pool, *ent_list, sz_ent_list, sizeof(entity_t),
+		       _Alignof(entity_t), kPoolFlagsNone))
+		return false;
+	assert(ent_pool.sz_slot == sizeof(entity_t) &&
+	       ent_pool.num_slots == (size_t)num_ents);
+
+	array_ent_collision_init(&ent_collisions,
+				 array_allocator_heap(kMemTagEntities));
+
+	name_player = intern("player");
+	name_satellite = intern("satellite");
+	name_bullet = intern("bullet");
+	name_enemy = intern("enemy");
+
 	logger(LOG_INFO, "ent_init OK\n");
 
 	return true;
 }
 
-void ent_refresh(engine_t* eng, const f64 dt)
+static void ent_pass_spawn(engine_t* eng, f64 dt)
 {
-	if (eng == NULL)
-		return;
-
 	entity_t* ent_list = eng->ent_list;
 
 	if (eng->spawn_timer[0] == 0.0)
@@ -84,40 +147,121 @@ void ent_refresh(engine_t* eng, const f64 dt)
 		eng->spawn_timer[0] = 0.0;
 	}
 
-	gActiveEntities = 0;
+	// An entity whose lifetime runs out here is despawned, and its slot
+	// goes back to the pool, which reuses it for the free list. It isn't
+	// counted as active, and the later passes skip it on its last frame
+	// rather than moving, colliding or drawing a freed slot.
+	s32 active = 0;
 	for (s32 edx = 0; edx < MAX_ENTITIES; edx++) {
 		entity_t* e = ent_by_index(ent_list, edx);
-
-		if (e == NULL)
+		if (e == NULL || ent_has_no_caps(e))
 			continue;
+		ent_lifetime_update(e);
+		if (!ent_has_no_caps(e))
+			active += 1;
+	}
+	gActiveEntities = active;
+}
 
-		if (ent_has_no_caps(e))
+static void ent_pass_move(engine_t* eng, f64 dt)
+{
+	for (s32 edx = 0; edx < MAX_ENTITIES; edx++) {
+		entity_t* e = ent_by_index(eng->ent_list, edx);
+		if (e == NULL || ent_has_no_caps(e))
 			continue;
-		else {
-			gActiveEntities += 1;
-			ent_lifetime_update(e);
-		}
 		ent_center_rect(e);
 		ent_refresh_movers(eng, e, dt);
+	}
+}
+
+static void ent_pass_collide(engine_t* eng, f64 dt)
+{
+	array_ent_collision_clear(&ent_collisions);
+	for (s32 edx = 0; edx < MAX_ENTITIES; edx++) {
+		entity_t* e = ent_by_index(eng->ent_list, edx);
+		if (e == NULL || ent_has_no_caps(e))
+			continue;
 		ent_refresh_colliders(eng, e, dt);
+	}
+}
+
+static void ent_pass_resolve(engine_t* eng, f64 dt)
+{
+	for (size_t i = 0; i < ent_collisions.num_elems; i++) {
+		entity_t* a = ent_collisions.data[i].a;
+		entity_t* b = ent_collisions.data[i].b;
+		if (a->name == name_bullet && b->name == name_enemy)
+			ent_despawn(eng->ent_list, b);
+		else if (a->name == name_enemy && b->name == name_bullet)
+			ent_despawn(eng->ent_list, a);
+	}
+	array_ent_collision_clear(&ent_collisions);
+}
+
+static void ent_pass_emit(engine_t* eng, f64 dt)
+{
+	for (s32 edx = 0; edx < MAX_ENTITIES; edx++) {
+		entity_t* e = ent_by_index(eng->ent_list, edx);
+		if (e == NULL || ent_has_no_caps(e))
+			continue;
 		ent_refresh_emitters(eng, e, dt);
+	}
+}
+
+static void ent_pass_draw(engine_t* eng, f64 dt)
+{
+	for (s32 edx = 0; edx < MAX_ENTITIES; edx++) {
+		entity_t* e = ent_by_index(eng->ent_list, edx);
+		if (e == NULL || ent_has_no_caps(e))
+			continue;
 		ent_refresh_renderables(eng, e, dt);
 	}
+}
 
-	// logger(LOG_INFO, "engine time: %f", eng_get_time_sec());
+// Pass order only matters between passes that touch the same resource.
+// Drawing is added ahead of resolve and emit so it overlaps collision
+// detection; despawns and new bullets show up on the next frame.
+void ent_add_passes(frame_graph_t* graph)
+{
+	frame_graph_add_pass(graph, "ent_spawn", ent_pass_spawn,
+			     FRAME_RES(kFrameResEngine),
+			     FRAME_RES(kFrameResEntities));
+	frame_graph_add_pass(graph, "ent_move", ent_pass_move,
+			     FRAME_RES(kFrameResEngine) |
+				     FRAME_RES(kFrameResInput) |
+				     FRAME_RES(kFrameResEntities),
+			     FRAME_RES(kFrameResTransforms));
+	frame_graph_add_pass(graph, "ent_collide", ent_pass_collide,
+			     FRAME_RES(kFrameResEntities) |
+				     FRAME_RES(kFrameResTransforms),
+			     FRAME_RES(kFrameResCollisions));
+	frame_graph_add_pass(graph, "ent_draw", ent_pass_draw,
+			     FRAME_RES(kFrameResEngine) |
+				     FRAME_RES(kFrameResInput) |
+				     FRAME_RES(kFrameResEntities) |
+				     FRAME_RES(kFrameResTransforms),
+			     FRAME_RES(kFrameResDrawList));
+	frame_graph_add_pass(graph, "ent_resolve", ent_pass_resolve,
+			     FRAME_RES(kFrameResCollisions),
+			     FRAME_RES(kFrameResEntities));
+	frame_graph_add_pass(graph, "ent_emit", ent_pass_emit,
+			     FRAME_RES(kFrameResInput) |
+				     FRAME_RES(kFrameResTransforms),
+			     FRAME_RES(kFrameResEntities) |
+				     FRAME_RES(kFrameResAudio));
 }
 
 void ent_refresh_movers(engine_t* eng, entity_t* e, f64 dt)
 {
 	if (ent_has_caps(e, kEntityMover)) {
 		entity_t* ent_list = eng->ent_list;
-		if (!strcmp(e->name, "player")) {
+		if (e->name == name_player) {
 			ent_move_player(e, eng, dt);
-		} else if (!strcmp(e->name, "satellite")) {
+		} else if (e->name == name_satellite) {
 			entity_t* player =
 				ent_by_index(ent_list, PLAYER_ENTITY_INDEX);
 			ent_move_satellite(e, player, eng, dt);
-		} else if (!strcmp(e->name, "bullet")) {
+		} else if (e->name == name_bullet) {
 			ent_move_bullet(e, eng, dt);
 		}
 		if (ent_has_caps(e, kEntityEnemy)) {
@@ -137,29 +281,26 @@ void ent_refresh_colliders(engine_t* eng, entity_t* e, f64 dt)
 {
 	if (ent_has_caps(e, kEntityCollider)) {
 		entity_t* ent_list = eng->ent_list;
-		for (s32 i = 0; i < MAX_ENTITIES; i++) {
+		// pairs are recorded once, from the lower index
+		for (s32 i = e->index + 1; i < MAX_ENTITIES; i++) {
 			entity_t* c = ent_by_index(ent_list, i);
-			if (e == c)
-				continue; // don't check against self
 			if (ent_has_caps(c, kEntityCollider)) {
 				if (bounds_intersects(&e->bbox, &c->bbox,
 						      EPSILON)) {
-					logger(LOG_DEBUG,
-					       "%s (min {%f, %f, %f} max {%f, %f, %f}) intersects %s (min {%f, %f, %f} max {%f, %f, %f})",
-					       e->name, e->bbox.min.x,
-					       e->bbox.min.y, e->bbox.min.z,
-					       e->bbox.max.x, e->bbox.max.y,
-					       e->bbox.max.z, c->name,
-					       c->bbox.min.x, c->bbox.min.y,
-					       c->bbox.min.z, c->bbox.max.x,
-					       c->bbox.max.y, c->bbox.max.z);
-					if (!strcmp(e->name, "bullet") &&
-					    !strcmp(c->name, "enemy")) {
-						ent_despawn(ent_list, c);
-					} else if (!strcmp(e->name, "enemy") &&
-						   !strcmp(c->name, "bullet")) {
-						ent_despawn(ent_list, e);
-					}
+					logger_ratelimited(
+						LOG_DEBUG, 10,
+						"%s (min {%f, %f, %f} max {%f, %f, %f}) intersects %s (min {%f, %f, %f} max {%f, %f, %f})",
+						intern_str(e->name), e->bbox.min.x,
+						e->bbox.min.y, e->bbox.min.z,
+						e->bbox.max.x, e->bbox.max.y,
+						e->bbox.max.z, intern_str(c->name),
+						c->bbox.min.x, c->bbox.min.y,
+						c->bbox.min.z, c->bbox.max.x,
+						c->bbox.max.y, c->bbox.max.z);
+					ent_collision_t pair = {e, c};
+					if (!array_ent_collision_push(
+						    &ent_collisions, pair))
+						return;
 				}
 			}
 		}
@@ -173,7 +314,7 @@ void ent_refresh_emitters(engine_t* eng, entity_t* e, f64 dt)
 		mouse_pos.x = (f32)eng->inputs->mouse.window_pos.x;
 		mouse_pos.y = (f32)eng->inputs->mouse.window_pos.y;
 		entity_t* ent_list = eng->ent_list;
-		if (!strcmp(e->name, "player")) {
+		if (e->name == name_player) {
 			static bool is_shooting = false;
 			if (cmd_get_state(eng->inputs,
 					  kCommandPlayerPrimaryFire) == true) {
@@ -187,14 +328,15 @@ void ent_refresh_emitters(engine_t* eng, entity_t* e, f64 dt)
 			}
 			if (cmd_get_state(eng->inputs, kCommandPlayerAltFire) ==
 			    true) {
-				logger(LOG_INFO,
-				       "eng_refresh - kCommandPlayerAltFire triggered!\n");
+				logger_ratelimited(
+					LOG_INFO, 1,
+					"eng_refresh - kCommandPlayerAltFire triggered!\n");
 			}
 
 			f32 fire_rate = 0.100f;
 			static f64 shot_time = 0.0;
-			if (is_shooting && os_get_time_sec() >= shot_time) {
-				shot_time = os_get_time_sec() + fire_rate;
+			if (is_shooting && eng_get_time_sec() >= shot_time) {
+				shot_time = eng_get_time_sec() + fire_rate;
 				entity_t* player = ent_by_index(
 					ent_list, PLAYER_ENTITY_INDEX);
 				vec2f_t bullet_org = player->org;
@@ -205,7 +347,19 @@ void ent_refresh_emitters(engine_t* eng, entity_t* e, f64 dt)
 					ent_list, "bullet", bullet_org,
 					bullet_size, &bullet_color, kBulletCaps,
 					(f64)BASIC_BULLET_LIFETIME);
-				ent_set_mouse_org(bullet, mouse_pos);
+				if (bullet != NULL) {
+					ent_set_mouse_org(bullet, mouse_pos);
+					// angle of rotation between mouse and
+					// bullet origins
+					vec2f_t mouse_to_bullet = {0.f, 0.f};
+					vec2f_sub(&mouse_to_bullet, mouse_pos,
+						  bullet->org);
+					vec2f_norm(&mouse_to_bullet,
+						   mouse_to_bullet);
+					bullet->angle = RAD_TO_DEG(
+						atan2f(mouse_to_bullet.y,
+						       mouse_to_bullet.x));
+				}
 
 				eng_play_sound(eng, "snd_primary_fire",
 					       DEFAULT_SFX_VOLUME);
@@ -220,9 +374,11 @@ void ent_refresh_renderables(engine_t* eng, entity_t* e, f64 dt)
 		vec2f_t mouse_pos = {0.f, 0.f};
 		mouse_pos.x = (f32)eng->inputs->mouse.window_pos.x;
 		mouse_pos.y = (f32)eng->inputs->mouse.window_pos.y;
-		if (!strcmp(e->name, "player")) {
-			game_resource_t* resource =
-				eng_get_resource(eng, "player");
+		if (e->name == name_player) {
+			static resource_handle_t player_handle =
+				INVALID_RESOURCE_HANDLE;
+			game_resource_t* resource = eng_get_resource_cached(
+				eng, &player_handle, "player");
 			sprite_sheet_t* sprite_sheet =
 				(sprite_sheet_t*)resource->data;
 
@@ -239,47 +395,47 @@ void ent_refresh_renderables(engine_t* eng, entity_t* e, f64 dt)
 			vec2f_t vel_tmp = {0.f, 0.f};
 			vec2f_fabsf(&vel_tmp, e->vel);
 			frame_scale = MAX(vel_tmp.x, vel_tmp.y);
-			draw_sprite_sheet(eng->renderer, sprite_sheet, &e->org,
+			draw_sprite_sheet(eng->draw_list, sprite_sheet, &e->org,
 					  frame_scale, e->angle, flip);
-		} else if (!strcmp(e->name, "satellite")) {
-			game_resource_t* resource = eng_get_resource(eng, "roboid");
+		} else if (e->name == name_satellite) {
+			static resource_handle_t roboid_handle =
+				INVALID_RESOURCE_HANDLE;
+			game_resource_t* resource = eng_get_resource_cached(
+				eng, &roboid_handle, "roboid");
 			sprite_sheet_t* sprite_sheet = (sprite_sheet_t*)resource->data;
-			entity_t* player = ent_by_name(eng->ent_list, "player");
-			vec2f_t sat_to_player = { 0.f, 0.f };
-			vec2f_sub(&sat_to_player, e->org, player->org);
-			vec2f_norm(&sat_to_player, sat_to_player);
+			entity_t* player =
+				ent_by_name_id(eng->ent_list, name_player);
 			bool flip = false;
-			if (sat_to_player.x > 0.f)
-				flip = true;
+			if (player != NULL) {
+				vec2f_t sat_to_player = {0.f, 0.f};
+				vec2f_sub(&sat_to_player, e->org, player->org);
+				vec2f_norm(&sat_to_player, sat_to_player);
+				flip = sat_to_player.x > 0.f;
+			}
 			f64 frame_scale = 1.0;
-			draw_sprite_sheet(eng->renderer, sprite_sheet, &e->org, frame_scale, e->angle, flip);
+			draw_sprite_sheet(eng->draw_list, sprite_sheet, &e->org, frame_scale, e->angle, flip);
 			// rect_t sat_rect = {(s32)e->bbox.min.x,
 			// 		   (s32)e->bbox.min.y, e->size.x,
 			// 		   e->size.y};
 			// draw_rect_solid(eng->renderer, &sat_rect, &e->color);
-		} else if (!strcmp(e->name, "bullet")) {
-			//TODO(paulh): Need a game_resource_t method for get_resource_by_name
-			game_resource_t* resource =
-				eng_get_resource(eng, "bullet");
+		} else if (e->name == name_bullet) {
+			static resource_handle_t bullet_handle =
+				INVALID_RESOURCE_HANDLE;
+			game_resource_t* resource = eng_get_resource_cached(
+				eng, &bullet_handle, "bullet");
 			sprite_t* sprite = (sprite_t*)resource->data;
-			SDL_Rect dst = {e->bbox.min.x, e->bbox.min.y,
-					sprite->surface->clip_rect.w,
-					sprite->surface->clip_rect.h};
-			// calculate angle of rotation between mouse and bullet origins
-			if (e->angle == 0.f) {
-				vec2f_t mouse_to_bullet = {0.f, 0.f};
-				vec2f_sub(&mouse_to_bullet, e->mouse_org,
-					  e->org);
-				vec2f_norm(&mouse_to_bullet, mouse_to_bullet);
-				e->angle = RAD_TO_DEG(atan2f(
-					mouse_to_bullet.y, mouse_to_bullet.x));
-			}
-			SDL_RenderCopyEx(eng->renderer, sprite->texture, NULL,
-					 &dst, e->angle, NULL, SDL_FLIP_NONE);
+			rect_t dst = {e->bbox.min.x, e->bbox.min.y,
+				      sprite->surface->clip_rect.w,
+				      sprite->surface->clip_rect.h};
+			draw_list_texture(eng->draw_list, kDrawLayerWorld,
+					  (u32)MAX(dst.y + dst.h, 0),
+					  sprite->texture, &sprite->atlas_rect,
+					  &dst, e->angle, false);
 		} else {
 			rect_t r = {(s32)e->bbox.min.x, (s32)e->bbox.min.y,
 				    e->size.x, e->size.y};
-			draw_rect_solid(eng->renderer, &r, &e->color);
+			draw_list_rect_solid(eng->draw_list, kDrawLayerWorld,
+					     &r, &e->color);
 		}
 
 		// Draw debug overlays
@@ -296,10 +452,9 @@ void ent_refresh_renderables(engine_t* eng, entity_t* e, f64 dt)
 				.w = e->size.x,
 				.h = e->size.y,
 			};
-			draw_rect_outline(eng->renderer, &debug_rect,
-					  &debug_outline_color);
-			SDL_SetRenderDrawColor(eng->renderer, 0xff, 0xff, 0xff,
-					       0xff);
+			draw_list_rect_outline(eng->draw_list, kDrawLayerDebug,
+					       &debug_rect,
+					       &debug_outline_color);
 			// f32 rad = radius_of_circle_in_rect(e->rect);
 			// draw_circle(eng->renderer, (f32)e->org.x, (f32)e->org.y, rad);
 		}
@@ -308,29 +463,21 @@ void ent_refresh_renderables(engine_t* eng, entity_t* e, f64 dt)
 
 void ent_shutdown(entity_t* ent_list)
 {
+	array_ent_collision_free(&ent_collisions);
+	pool_log_stats(&ent_pool, "entities");
 	logger(LOG_INFO, "ent_shutdown OK\n");
 }
 
 entity_t* ent_new(entity_t* ent_list)
 {
-	entity_t* e = NULL;
-
-	// search entity list for first slot with no caps set
-	for (s32 edx = 0; edx < MAX_ENTITIES; edx++) {
-		e = ent_by_index(ent_list, edx);
-		if (e == NULL) {
-			logger(LOG_WARNING, "Entity slot %d is NULL!\n", edx);
-			continue;
-		}
-
-		if (ent_has_no_caps(e)) {
-			logger(LOG_INFO,
+	entity_t* e = pool_alloc_type(&ent_pool, entity_t);
+	if (e != NULL) {
+		const s32 edx = (s32)pool_index(&ent_pool, e);
+		logger_sampled(LOG_INFO, 16, 256,
 			       "ent_new: found empty slot %d for entity\n",
 			       edx);
-			memset(e, 0, sizeof(entity_t));
-			e->index = edx;
-			break;
-		}
+		memset(e, 0, sizeof(entity_t));
+		e->index = edx;
 	}
 
 	return e;
@@ -349,14 +496,7 @@ entity_t* ent_by_index(entity_t* ent_list, const s32 idx)
 
 entity_t* ent_by_name(entity_t* ent_list, const char* name)
 {
-	entity_t* e = NULL;
-	for (size_t edx = 0; edx < MAX_ENTITIES; edx++) {
-		e = &ent_list[edx];
-		if (!strcmp(e->name, name))
-			break;
-	}
-
-	return e;
+	return ent_by_name_id(ent_list, intern_find(name));
 }
 
 entity_t* ent_spawn_v2(entity_t* ents, const char* name, vec3f_t* org,
@@ -407,27 +547,36 @@ entity_t* ent_spawn(entity_t* ent_list, const char* name, const vec2f_t org,
 		else
 			e->lifetime = e->timestamp + lifetime;
 
-		logger(LOG_INFO, "ent_spawn: (%f) \"%s\" with caps %d\n",
-		       e->timestamp, e->name, caps);
+		logger_sampled(LOG_INFO, 16, 256,
+			       "ent_spawn: (%f) \"%s\" with caps %d\n",
+			       e->timestamp, intern_str(e->name), caps);
 	} else
-		logger(LOG_WARNING,
-		       "ent_spawn: no slots found to spawn entity %s\n", name);
+		logger_ratelimited(LOG_WARNING, 1,
+				   "ent_spawn: no slots found to spawn entity %s\n",
+				   name);
 
 	return e;
 }
 
 void ent_despawn(entity_t* ent_list, entity_t* ent)
 {
+	// an entity can be hit by several colliders in the same frame
+	if (ent_has_no_caps(ent))
+		return;
+
 	ent->caps = 0;
 	ent_set_name(ent, NULL);
+	pool_free(&ent_pool, ent);
 }
 
 void ent_lifetime_update(entity_t* e)
 {
 	// kill entities that have a fixed lifetime
 	if (e->lifetime > 0.0 && (eng_get_time_sec() >= e->lifetime)) {
-		logger(LOG_INFO, "Entity %s lifetime expired\n", e->name);
-		e->caps = 0;
+		logger_sampled(LOG_INFO, 16, 256,
+			       "Entity %s lifetime expired\n",
+			       intern_str(e->name));
+		ent_despawn(NULL, e);
 	}
 }
 
@@ -453,9 +602,7 @@ void ent_center_rect(entity_t* e)
 
 void ent_set_name(entity_t* e, const char* name)
 {
-	memset(e->name, 0, TEMP_STRING_MAX);
-	if (name != NULL && strlen(name) + 1 <= TEMP_STRING_MAX)
-		strcpy((char*)e->name, name);
+	e->name = intern(name);
 }
 
 void ent_add_caps(entity_t* e, const entity_caps_t caps)
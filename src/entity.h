@@ -16,11 +16,13 @@
 
 #pragma once
 
+#include "core/intern.h"
 #include "core/types.h"
 
 #include "math/types.h"
 
 typedef struct engine_s engine_t;
+typedef struct frame_graph_s frame_graph_t;
 
 #define FOREVER 0.0
 #define BASIC_BULLET_LIFETIME 5.f
@@ -57,7 +59,7 @@ typedef enum {
 
 typedef struct entity_s {
 	s32 index;
-	char name[TEMP_STRING_MAX];
+	str_id_t name;
 	entity_caps_t caps;
 	s32 flags;
 
@@ -81,7 +83,7 @@ extern s32 gActiveEntities;
 extern s32 gLastEntity;
 
 bool ent_init(entity_t** ent_list, const s32 num_ents);
-void ent_refresh(engine_t* eng, const f64 dt);
+void ent_add_passes(frame_graph_t* graph);
 void ent_refresh_movers(engine_t* eng, entity_t* e, f64 dt);
 void ent_refresh_colliders(engine_t* eng, entity_t* e, f64 dt);
 void ent_refresh_emitters(engine_t* eng, entity_t* e, f64 dt);
@@ -14,8 +14,13 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "draw_list.h"
 #include "font.h"
 #include "engine.h"
+#include "sprite.h"
+
+#include "core/hashmap.h"
+#include "core/memory.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
@@ -30,35 +35,195 @@
 #define FONT_NUM_COLS 16
 #define FONT_NUM_ROWS 6
 
+static bool is_printable(char c)
+{
+	return c >= ASCII_BASE && c < ASCII_NULL;
+}
+
+static void glyph_run_free(glyph_run_t* run)
+{
+	bm_free(run->text);
+	bm_free(run->verts);
+	bm_free(run->indices);
+	memset(run, 0, sizeof(glyph_run_t));
+}
+
+// Grow the run's buffers, keeping them when an evicted run is reused.
+static void glyph_run_reserve(glyph_run_t* run, size_t len, s32 num_glyphs)
+{
+	if (run->text_cap < len + 1) {
+		bm_free(run->text);
+		run->text_cap = len + 1;
+		run->text = (char*)bm_malloc_tagged(run->text_cap,
+						    kMemTagRender);
+	}
+	if (run->glyph_cap < num_glyphs) {
+		bm_free(run->verts);
+		bm_free(run->indices);
+		run->glyph_cap = num_glyphs;
+		run->verts = (SDL_Vertex*)bm_malloc_tagged(
+			sizeof(SDL_Vertex) * 4 * num_glyphs, kMemTagRender);
+		run->indices = (s32*)bm_malloc_tagged(
+			sizeof(s32) * 6 * num_glyphs, kMemTagRender);
+	}
+}
+
+static void glyph_run_layout(glyph_run_t* run, const sprite_t* sprite)
+{
+	s32 tex_w = 1, tex_h = 1;
+	SDL_QueryTexture(sprite->texture, NULL, NULL, &tex_w, &tex_h);
+	const f32 inv_w = 1.f / (f32)tex_w;
+	const f32 inv_h = 1.f / (f32)tex_h;
+	const f32 cel = FONT_CEL_SIZE_PX * run->scale;
+	const SDL_Color white = {255, 255, 255, 255};
+
+	f32 x = (f32)run->x;
+	const f32 y = (f32)run->y;
+	s32 g = 0;
+	for (const char* c = run->text; *c != '\0'; c++) {
+		if (!is_printable(*c))
+			continue;
+		const s32 fx = *c - ASCII_BASE;
+		const f32 u0 = (f32)(sprite->atlas_rect.x +
+				     (fx % FONT_NUM_COLS) * FONT_CEL_SIZE_PX) *
+			       inv_w;
+		const f32 v0 = (f32)(sprite->atlas_rect.y +
+				     (fx / FONT_NUM_COLS) * FONT_CEL_SIZE_PX) *
+			       inv_h;
+		const f32 u1 = u0 + FONT_CEL_SIZE_PX * inv_w;
+		const f32 v1 = v0 + FONT_CEL_SIZE_PX * inv_h;
+
+		SDL_Vertex* v = &run->verts[g * 4];
+		v[0] = (SDL_Vertex){{x, y}, white, {u0, v0}};
+		v[1] = (SDL_Vertex){{x + cel, y}, white, {u1, v0}};
+		v[2] = (SDL_Vertex){{x + cel, y + cel}, white, {u1, v1}};
+		v[3] = (SDL_Vertex){{x, y + cel}, white, {u0, v1}};
+
+		s32* idx = &run->indices[g * 6];
+		idx[0] = g * 4 + 0;
+		idx[1] = g * 4 + 1;
+		idx[2] = g * 4 + 2;
+		idx[3] = g * 4 + 0;
+		idx[4] = g * 4 + 2;
+		idx[5] = g * 4 + 3;
+
+		x += cel;
+		g++;
+	}
+	run->num_glyphs = g;
+}
+
+static void glyph_run_move(glyph_run_t* run, s32 x, s32 y)
+{
+	const f32 dx = (f32)(x - run->x);
+	const f32 dy = (f32)(y - run->y);
+	for (s32 i = 0; i < run->num_glyphs * 4; i++) {
+		run->verts[i].position.x += dx;
+		run->verts[i].position.y += dy;
+	}
+	run->x = x;
+	run->y = y;
+}
+
+static glyph_run_t* glyph_run_get(font_t* font, s32 x, s32 y, f32 scale,
+				  const char* text)
+{
+	const u32 hash = hashmap_hash_string(text);
+
+	font->tick++;
+	glyph_run_t* lru = &font->runs[0];
+	for (s32 i = 0; i < FONT_MAX_GLYPH_RUNS; i++) {
+		glyph_run_t* run = &font->runs[i];
+		if (run->hash == hash && run->scale == scale &&
+		    !strcmp(run->text, text)) {
+			if (run->x != x || run->y != y)
+				glyph_run_move(run, x, y);
+			run->last_used = font->tick;
+			return run;
+		}
+		if (run->hash == 0 || run->last_used < lru->last_used)
+			lru = run;
+		if (run->hash == 0)
+			break;
+	}
+
+	const size_t len = strlen(text);
+	s32 num_glyphs = 0;
+	for (size_t c = 0; c < len; c++) {
+		if (is_printable(text[c]))
+			num_glyphs++;
+	}
+
+	glyph_run_reserve(lru, len, num_glyphs);
+	memcpy(lru->text, text, len + 1);
+	lru->hash = hash;
+	lru->scale = scale;
+	lru->x = x;
+	lru->y = y;
+	lru->last_used = font->tick;
+	glyph_run_layout(lru, font->sprite);
+
+	return lru;
+}
+
+void font_shutdown(font_t* font)
+{
+	for (s32 i = 0; i < FONT_MAX_GLYPH_RUNS; i++)
+		glyph_run_free(&font->runs[i]);
+}
+
 void font_print(engine_t* eng, s32 x, s32 y, f32 scale, const char* str, ...)
 {
 	va_list args;
-	char text[TEMP_STRING_MAX];
-	s32 c = 0;
-	s32 fx, tu, tv;
 
 	if (str == NULL)
 		return;
 	if (*str == '\0')
 		return;
 
+	// The draw list copies the text, so scratch memory is enough. The
+	// thread's own scratch keeps this safe from frame graph passes.
+	arena_t* scratch = arena_thread_scratch();
+	if (scratch == NULL)
+		scratch = &g_frame_arena;
+	arena_temp_t temp = arena_temp_begin(scratch);
 	va_start(args, str);
-	vsprintf(text, str, args);
+	char* text = arena_vprintf(scratch, str, args);
 	va_end(args);
+	if (text == NULL) {
+		arena_temp_end(temp);
+		return;
+	}
+
+	draw_list_text(eng->draw_list, kDrawLayerUI, eng->font.sprite->texture,
+		       x, y, scale, text);
+	arena_temp_end(temp);
+}
+
+void font_draw(font_t* font, SDL_Renderer* ren, s32 x, s32 y, f32 scale,
+	       const char* text)
+{
+	glyph_run_t* run = glyph_run_get(font, x, y, scale, text);
+	if (run->num_glyphs == 0)
+		return;
+
+	SDL_RenderGeometry(ren, font->sprite->texture, run->verts,
+			   run->num_glyphs * 4, run->indices,
+			   run->num_glyphs * 6);
+}
 
-	while (text[c] != '\0') {
-		if (text[c] >= ASCII_BASE && text[c] < ASCII_NULL) {
-			fx = text[c] - ASCII_BASE;
-			tu = (f32)(fx % FONT_NUM_COLS) * FONT_CEL_SIZE_PX;
-			tv = (f32)(fx / FONT_NUM_COLS) * FONT_CEL_SIZE_PX;
-			SDL_Rect src = {tu, tv, FONT_CEL_SIZE_PX,
-					FONT_CEL_SIZE_PX};
-			SDL_Rect dst = {x, y, FONT_CEL_SIZE_PX * scale,
-					FONT_CEL_SIZE_PX * scale};
-			SDL_RenderCopy((SDL_Renderer*)eng->renderer,
-				       eng->font.sprite->texture, &src, &dst);
-			x += FONT_CEL_SIZE_PX * scale;
+void font_measure(const char* text, f32 scale, s32* w, s32* h)
+{
+	s32 num_glyphs = 0;
+	if (text != NULL) {
+		for (const char* c = text; *c != '\0'; c++) {
+			if (is_printable(*c))
+				num_glyphs++;
 		}
-		c++;
 	}
+
+	if (w)
+		*w = (s32)(num_glyphs * FONT_CEL_SIZE_PX * scale);
+	if (h)
+		*h = num_glyphs ? (s32)(FONT_CEL_SIZE_PX * scale) : 0;
 }
@@ -23,10 +23,35 @@ typedef struct game_resource_s game_resource_t;
 typedef struct sprite_s sprite_t;
 
 typedef struct SDL_Renderer SDL_Renderer;
+typedef struct SDL_Vertex SDL_Vertex;
+
+#define FONT_MAX_GLYPH_RUNS 64
+
+// Laid out quads for one string, submitted as a single geometry batch.
+// Runs are keyed on text + scale and reused until evicted (LRU).
+typedef struct glyph_run_s {
+	u32 hash; // 0 = unused
+	f32 scale;
+	s32 x;
+	s32 y;
+	char* text;
+	size_t text_cap;
+	SDL_Vertex* verts;
+	s32* indices;
+	s32 num_glyphs;
+	s32 glyph_cap;
+	u64 last_used;
+} glyph_run_t;
 
 typedef struct font_s {
 	game_resource_t* rsrc;
 	sprite_t* sprite;
+	glyph_run_t runs[FONT_MAX_GLYPH_RUNS];
+	u64 tick; // bumped on every run lookup, drives LRU eviction
 } font_t;
 
+void font_shutdown(font_t* font);
 void font_print(engine_t* eng, s32 x, s32 y, f32 scale, const char* str, ...);
+void font_draw(font_t* font, SDL_Renderer* ren, s32 x, s32 y, f32 scale,
+	       const char* text);
+void font_measure(const char* text, f32 scale, s32* w, s32* h);
@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "frame_graph.h"
+
+#include "core/logger.h"
+#include "core/profiler.h"
+
+#include "math/utils.h"
+
+#include "platform/platform.h"
+
+#include <string.h>
+
+static const char* resource_names[kFrameResMax] = {
+	"engine",     "input",     "entities", "transforms",
+	"collisions", "draw_list", "audio",
+};
+
+// Resources that force a before b when a was added first
+static u32 frame_graph_hazards(const frame_pass_t* a, const frame_pass_t* b)
+{
+	return (a->writes & (b->reads | b->writes)) | (a->reads & b->writes);
+}
+
+static f64 ns_to_ms(u64 ns)
+{
+	return (f64)ns / 1000000.0;
+}
+
+bool frame_graph_add_pass(frame_graph_t* graph, const char* name,
+			  frame_pass_func_t func, u32 reads, u32 writes)
+{
+	if (graph->num_passes >= FRAME_GRAPH_MAX_PASSES) {
+		logger(LOG_ERROR, "frame_graph: no room for pass %s\n", name);
+		return false;
+	}
+
+	frame_pass_t* pass = &graph->passes[graph->num_passes++];
+	memset(pass, 0, sizeof(frame_pass_t));
+	pass->name = name;
+	pass->func = func;
+	pass->reads = reads;
+	pass->writes = writes;
+	pass->graph = graph;
+	pass->worker = -1;
+	graph->built = false;
+
+	return true;
+}
+
+void frame_graph_build(frame_graph_t* graph)
+{
+	u32 ancestors[FRAME_GRAPH_MAX_PASSES];
+	u32 num_edges = 0;
+
+	graph->num_levels = 0;
+	for (u32 j = 0; j < graph->num_passes; j++) {
+		frame_pass_t* pass = &graph->passes[j];
+		u32 deps = 0;
+		for (u32 i = 0; i < j; i++) {
+			if (frame_graph_hazards(&graph->passes[i], pass))
+				deps |= 1u << i;
+		}
+
+		// drop edges already implied through another dependency
+		u32 implied = 0;
+		for (u32 i = 0; i < j; i++) {
+			if (deps & (1u << i))
+				implied |= ancestors[i];
+		}
+		ancestors[j] = deps | implied;
+
+		pass->deps = deps & ~implied;
+		pass->dependents = 0;
+		pass->num_deps = 0;
+		pass->level = 0;
+		for (u32 i = 0; i < j; i++) {
+			if (!(pass->deps & (1u << i)))
+				continue;
+			frame_pass_t* dep = &graph->passes[i];
+			dep->dependents |= 1u << j;
+			pass->num_deps++;
+			pass->level = MAX(pass->level, dep->level + 1);
+		}
+		graph->num_levels = MAX(graph->num_levels, pass->level + 1);
+		num_edges += pass->num_deps;
+	}
+
+	graph->built = true;
+	logger(LOG_INFO, "frame_graph: %u passes, %u edges, %u levels\n",
+	       graph->num_passes, num_edges, graph->num_levels);
+}
+
+static void frame_graph_run_pass(void* param)
+{
+	frame_pass_t* pass = (frame_pass_t*)param;
+	frame_graph_t* graph = pass->graph;
+
+	const u64 start_ns = os_get_time_ns();
+	BM_PROFILE_SCOPE(pass->name) {
+		pass->func(graph->eng, graph->dt);
+	}
+	const u64 elapsed_ns = os_get_time_ns() - start_ns;
+
+	pass->worker = task_worker_index();
+	pass->last_ns = elapsed_ns;
+	pass->total_ns += elapsed_ns;
+	pass->max_ns = MAX(pass->max_ns, elapsed_ns);
+	pass->runs++;
+
+	// queue dependents that were only waiting on this pass
+	task_decl_t ready[FRAME_GRAPH_MAX_PASSES];
+	u32 num_ready = 0;
+	for (u32 d = 0; d < graph->num_passes; d++) {
+		if (!(pass->dependents & (1u << d)))
+			continue;
+		frame_pass_t* next = &graph->passes[d];
+		if (os_atomic_add_s32(&next->deps_left, -1) == 0) {
+			ready[num_ready].func = frame_graph_run_pass;
+			ready[num_ready].param = next;
+			num_ready++;
+		}
+	}
+	if (num_ready > 0)
+		task_run(ready, num_ready, graph->done);
+}
+
+void frame_graph_execute(frame_graph_t* graph, engine_t* eng, f64 dt)
+{
+	if (!graph->built)
+		frame_graph_build(graph);
+
+	const u64 start_ns = os_get_time_ns();
+	task_counter_t done = {0};
+	graph->eng = eng;
+	graph->dt = dt;
+	graph->done = &done;
+
+	task_decl_t roots[FRAME_GRAPH_MAX_PASSES];
+	u32 num_roots = 0;
+	for (u32 p = 0; p < graph->num_passes; p++) {
+		frame_pass_t* pass = &graph->passes[p];
+		os_atomic_store_s32(&pass->deps_left, (s32)pass->num_deps);
+		if (pass->num_deps == 0) {
+			roots[num_roots].func = frame_graph_run_pass;
+			roots[num_roots].param = pass;
+			num_roots++;
+		}
+	}
+	task_run(roots, num_roots, &done);
+	task_wait(&done, 0);
+	graph->done = NULL;
+
+	const u64 elapsed_ns = os_get_time_ns() - start_ns;
+	graph->last_ns = elapsed_ns;
+	graph->total_ns += elapsed_ns;
+	graph->max_ns = MAX(graph->max_ns, elapsed_ns);
+	graph->frames++;
+}
+
+void frame_graph_log(const frame_graph_t* graph)
+{
+	if (graph->frames == 0)
+		return;
+
+	logger(LOG_INFO,
+	       "frame graph: avg %.3fms, max %.3fms over %llu frames\n",
+	       ns_to_ms(graph->total_ns / graph->frames),
+	       ns_to_ms(graph->max_ns), (unsigned long long)graph->frames);
+	for (u32 p = 0; p < graph->num_passes; p++) {
+		const frame_pass_t* pass = &graph->passes[p];
+		const u64 avg_ns = pass->runs ? pass->total_ns / pass->runs : 0;
+		logger(LOG_INFO,
+		       "  %-20s level %u, avg %.3fms, max %.3fms, %u deps\n",
+		       pass->name, pass->level, ns_to_ms(avg_ns),
+		       ns_to_ms(pass->max_ns), pass->num_deps);
+	}
+}
+
+// Graphviz dot, render with: dot -Tsvg frame_graph.dot -o frame_graph.svg
+bool frame_graph_write_dot(const frame_graph_t* graph, const char* path)
+{
+	FILE* file = os_fopen(path, "w");
+	if (file == NULL) {
+		logger(LOG_ERROR, "Error opening frame graph file %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "digraph frame_graph {\n");
+	fprintf(file, "\trankdir=LR;\n\tnode [shape=box];\n");
+	for (u32 p = 0; p < graph->num_passes; p++) {
+		const frame_pass_t* pass = &graph->passes[p];
+		const u64 avg_ns = pass->runs ? pass->total_ns / pass->runs : 0;
+		fprintf(file,
+			"\tp%u [label=\"%s\\navg %.3fms max %.3fms\"];\n", p,
+			pass->name, ns_to_ms(avg_ns), ns_to_ms(pass->max_ns));
+	}
+	for (u32 p = 0; p < graph->num_passes; p++) {
+		const frame_pass_t* pass = &graph->passes[p];
+		for (u32 d = 0; d < p; d++) {
+			if (!(pass->deps & (1u << d)))
+				continue;
+			const u32 hazards =
+				frame_graph_hazards(&graph->passes[d], pass);
+			fprintf(file, "\tp%u -> p%u [label=\"", d, p);
+			const char* sep = "";
+			for (s32 r = 0; r < kFrameResMax; r++) {
+				if (hazards & FRAME_RES(r)) {
+					fprintf(file, "%s%s", sep,
+						resource_names[r]);
+					sep = ",";
+				}
+			}
+			fprintf(file, "\"];\n");
+		}
+	}
+	fprintf(file, "}\n");
+
+	fclose(file);
+	logger(LOG_INFO, "Wrote frame graph with %u passes to %s\n",
+	       graph->num_passes, path);
+
+	return true;
+}
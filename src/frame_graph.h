@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/task.h"
+#include "core/types.h"
+
+typedef struct engine_s engine_t;
+
+#define FRAME_GRAPH_MAX_PASSES 32
+
+// Shared frame state a pass reads or writes. Two passes that touch the same
+// resource, where at least one of them writes it, run in the order they
+// were added. Everything else is free to run in parallel.
+typedef enum {
+	kFrameResEngine, // mode, debug flags, frame rate, camera rect
+	kFrameResInput,
+	kFrameResEntities, // entity list slots and spawn timers
+	kFrameResTransforms, // entity origin, velocity, bbox and angle
+	kFrameResCollisions,
+	kFrameResDrawList,
+	kFrameResAudio,
+	kFrameResMax,
+} frame_resource_t;
+
+#define FRAME_RES(res) (1u << (res))
+
+typedef void (*frame_pass_func_t)(engine_t* eng, f64 dt);
+
+typedef struct frame_graph_s frame_graph_t;
+
+typedef struct frame_pass_s {
+	const char* name; // string literal, also used as the profiler scope
+	frame_pass_func_t func;
+	u32 reads;
+	u32 writes;
+	u32 deps; // mask of passes that must finish first
+	u32 dependents; // mask of passes waiting on this one
+	u32 num_deps;
+	u32 level; // longest dependency chain leading to this pass
+	volatile s32 deps_left;
+	frame_graph_t* graph;
+	s32 worker; // worker that last ran the pass, -1 outside the system
+	u64 last_ns;
+	u64 total_ns;
+	u64 max_ns;
+	u64 runs;
+} frame_pass_t;
+
+// Per frame simulation passes with declared resource access. Dependencies
+// are derived from the read and write sets when the graph is built, and
+// execute hands each pass to the task system as soon as the passes it
+// depends on have finished. Passes can run on any worker, so they must
+// not touch thread local state such as the frame arena.
+struct frame_graph_s {
+	frame_pass_t passes[FRAME_GRAPH_MAX_PASSES];
+	u32 num_passes;
+	u32 num_levels;
+	bool built;
+	engine_t* eng;
+	f64 dt;
+	task_counter_t* done;
+	u64 last_ns;
+	u64 total_ns;
+	u64 max_ns;
+	u64 frames;
+};
+
+bool frame_graph_add_pass(frame_graph_t* graph, const char* name,
+			  frame_pass_func_t func, u32 reads, u32 writes);
+void frame_graph_build(frame_graph_t* graph);
+void frame_graph_execute(frame_graph_t* graph, engine_t* eng, f64 dt);
+void frame_graph_log(const frame_graph_t* graph);
+bool frame_graph_write_dot(const frame_graph_t* graph, const char* path);
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "frame_pacer.h"
+
+#include "core/logger.h"
+#include "core/time_convert.h"
+#include "core/video.h"
+
+#include "platform/platform.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+	defined(__i386__)
+#include <immintrin.h>
+#define cpu_relax() _mm_pause()
+#else
+#define cpu_relax()
+#endif
+
+#define MAX_SLEEP_OVERSHOOT_NS 4000000ULL
+
+void frame_pacer_init(frame_pacer_t* fp)
+{
+	memset(fp, 0, sizeof(frame_pacer_t));
+	fp->last_wake_ns = os_get_time_ns();
+	fp->sleep_overshoot_ns = FRAME_PACER_SPIN_NS;
+}
+
+// Blocks until the next frame deadline and returns the time since the
+// previous wait returned, in seconds.
+f64 frame_pacer_wait(frame_pacer_t* fp, f64 target_frametime)
+{
+	const u64 target_ns = sec_to_nsec_u64(target_frametime);
+	u64 now = os_get_time_ns();
+
+	// deadlines advance by a fixed step so rounding never drifts
+	if (fp->deadline_ns == 0)
+		fp->deadline_ns = fp->last_wake_ns + target_ns;
+
+	if (now >= fp->deadline_ns) {
+		const u64 miss = now - fp->deadline_ns;
+		fp->missed++;
+		fp->total_miss_ns += miss;
+		if (miss > fp->worst_miss_ns)
+			fp->worst_miss_ns = miss;
+	} else {
+		const u64 margin = FRAME_PACER_SPIN_NS + fp->sleep_overshoot_ns;
+		if (fp->deadline_ns - now > margin) {
+			const u64 wake_at = fp->deadline_ns - margin;
+			os_sleep_until_ns(wake_at);
+			now = os_get_time_ns();
+
+			// exponential moving average, 1/8 weight per sample
+			const u64 late = now > wake_at ? now - wake_at : 0;
+			fp->sleep_overshoot_ns =
+				(fp->sleep_overshoot_ns * 7 + late) / 8;
+			if (fp->sleep_overshoot_ns > MAX_SLEEP_OVERSHOOT_NS)
+				fp->sleep_overshoot_ns = MAX_SLEEP_OVERSHOOT_NS;
+		}
+
+		while ((now = os_get_time_ns()) < fp->deadline_ns)
+			cpu_relax();
+	}
+
+	fp->frames++;
+	fp->deadline_ns += target_ns;
+	// more than a frame behind, resync instead of rushing to catch up
+	if (fp->deadline_ns < now)
+		fp->deadline_ns = now + target_ns;
+
+	f64 dt = nsec_to_sec_f64(now - fp->last_wake_ns);
+	if (dt > FRAME_TIME(5))
+		dt = FRAME_TIME(5);
+	fp->last_wake_ns = now;
+
+	return dt;
+}
+
+void frame_pacer_log_stats(const frame_pacer_t* fp)
+{
+	const f64 avg_miss_ms =
+		fp->missed ? nsec_to_msec_f64(fp->total_miss_ns / fp->missed)
+			   : 0.0;
+	logger(LOG_INFO,
+	       "frame pacer: %llu frames, %llu missed deadlines (%.2f%%), "
+	       "avg miss %.3fms, worst miss %.3fms, sleep overshoot %.3fms\n",
+	       (unsigned long long)fp->frames,
+	       (unsigned long long)fp->missed,
+	       fp->frames ? 100.0 * (f64)fp->missed / (f64)fp->frames : 0.0,
+	       avg_miss_ms, nsec_to_msec_f64(fp->worst_miss_ns),
+	       nsec_to_msec_f64(fp->sleep_overshoot_ns));
+}
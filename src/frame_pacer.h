@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+#define FRAME_PACER_SPIN_NS 250000ULL // always spin the last 250us
+
+// Paces a loop to a fixed frame time. Waits sleep on a high resolution
+// timer until shortly before the deadline and spin the rest. Sleep
+// overshoot is measured every frame and folded into the wake up margin.
+typedef struct frame_pacer_s {
+	u64 deadline_ns;
+	u64 last_wake_ns;
+	u64 sleep_overshoot_ns; // running average of how late sleeps wake
+	u64 frames;
+	u64 missed;  // frames that finished after their deadline
+	u64 total_miss_ns;
+	u64 worst_miss_ns;
+} frame_pacer_t;
+
+void frame_pacer_init(frame_pacer_t* fp);
+f64 frame_pacer_wait(frame_pacer_t* fp, f64 target_frametime);
+void frame_pacer_log_stats(const frame_pacer_t* fp);
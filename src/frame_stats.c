@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "draw_list.h"
+#include "frame_stats.h"
+
+#include "core/logger.h"
+#include "core/memory.h"
+
+#include "math/utils.h"
+
+#include "platform/platform.h"
+
+#define HIST_SUB_BITS 4 // 16 linear sub-buckets per power of two, ~6% error
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define GRAPH_BAR_WIDTH 2
+#define GRAPH_HEIGHT 60
+#define GRAPH_US_PER_PX 500 // 30ms full scale
+
+static const char* phase_names[kFramePhaseMax] = {
+	"input", "sim", "render", "present", "wait",
+};
+
+static u32 ns_to_us(u64 ns)
+{
+	const u64 us = ns / 1000ULL;
+	return us > 0xffffffffULL ? 0xffffffff : (u32)us;
+}
+
+static s32 highest_bit(u32 v)
+{
+	s32 bit = -1;
+	while (v) {
+		v >>= 1;
+		bit++;
+	}
+	return bit;
+}
+
+// Values below 16us get exact buckets, above that each power of two is
+// split into 16 linear buckets.
+static s32 hist_bucket(u32 us)
+{
+	if (us < HIST_SUB_COUNT)
+		return (s32)us;
+
+	const s32 exp = highest_bit(us);
+	const s32 sub =
+		(s32)(us >> (exp - HIST_SUB_BITS)) & (HIST_SUB_COUNT - 1);
+	const s32 idx = (exp - HIST_SUB_BITS + 1) * HIST_SUB_COUNT + sub;
+
+	return idx < FRAME_STATS_HIST_BUCKETS ? idx
+					      : FRAME_STATS_HIST_BUCKETS - 1;
+}
+
+// upper bound of a bucket, so percentiles never under-report
+static u32 hist_bucket_value(s32 idx)
+{
+	if (idx < HIST_SUB_COUNT)
+		return (u32)idx;
+
+	const s32 exp = idx / HIST_SUB_COUNT + HIST_SUB_BITS - 1;
+	const u32 sub = (u32)(idx % HIST_SUB_COUNT);
+	const s32 shift = exp - HIST_SUB_BITS;
+
+	return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+bool frame_stats_init(frame_stats_t* fs)
+{
+	memset(fs, 0, sizeof(frame_stats_t));
+	fs->records = (frame_record_t*)arena_alloc(
+		&g_mem_arena, sizeof(frame_record_t) * FRAME_STATS_HISTORY,
+		DEFAULT_ALIGNMENT);
+	if (fs->records == NULL) {
+		logger(LOG_ERROR, "Error allocating frame stats history\n");
+		return false;
+	}
+
+	return true;
+}
+
+// Called from the render thread for the input, render and present phases.
+void frame_stats_set_phase(frame_stats_t* fs, frame_phase_t phase, u64 ns)
+{
+	const u32 us = MIN(ns_to_us(ns), 0x7fffffff);
+	SDL_AtomicSet(&fs->render_phase_us[phase], (int)us);
+}
+
+void frame_stats_record(frame_stats_t* fs, u64 frame, u64 sim_ns,
+			u64 wait_ns, u64 total_ns, f64 target_frametime)
+{
+	const int head = SDL_AtomicGet(&fs->head);
+	frame_record_t* rec = &fs->records[head % FRAME_STATS_HISTORY];
+
+	rec->frame = frame;
+	for (s32 p = 0; p < kFramePhaseMax; p++)
+		rec->phase_us[p] = (u32)SDL_AtomicGet(&fs->render_phase_us[p]);
+	rec->phase_us[kFramePhaseSim] = ns_to_us(sim_ns);
+	rec->phase_us[kFramePhaseWait] = ns_to_us(wait_ns);
+	rec->total_us = ns_to_us(total_ns);
+
+	const u32 hitch_us =
+		(u32)(target_frametime * FRAME_STATS_HITCH_FACTOR * 1000000.0);
+	rec->hitch = frame > 0 && rec->total_us > hitch_us;
+	if (rec->hitch) {
+		fs->num_hitches++;
+		logger(LOG_WARNING,
+		       "Hitch on frame %llu: %.2fms (input %.2f, sim %.2f, "
+		       "render %.2f, present %.2f, wait %.2f)\n",
+		       (unsigned long long)frame, rec->total_us / 1000.0,
+		       rec->phase_us[kFramePhaseInput] / 1000.0,
+		       rec->phase_us[kFramePhaseSim] / 1000.0,
+		       rec->phase_us[kFramePhaseRender] / 1000.0,
+		       rec->phase_us[kFramePhasePresent] / 1000.0,
+		       rec->phase_us[kFramePhaseWait] / 1000.0);
+	}
+
+	fs->histogram[hist_bucket(rec->total_us)]++;
+	fs->num_samples++;
+	if (rec->total_us > fs->max_us)
+		fs->max_us = rec->total_us;
+
+	// publish the record only once it is complete
+	SDL_AtomicSet(&fs->head, head + 1);
+}
+
+u32 frame_stats_percentile_us(const frame_stats_t* fs, f64 percentile)
+{
+	if (fs->num_samples == 0)
+		return 0;
+
+	const u64 target = (u64)((f64)fs->num_samples * percentile / 100.0);
+	u64 count = 0;
+	for (s32 i = 0; i < FRAME_STATS_HIST_BUCKETS; i++) {
+		count += fs->histogram[i];
+		if (count > target)
+			return MIN(hist_bucket_value(i), fs->max_us);
+	}
+
+	return fs->max_us;
+}
+
+// Bar graph of the most recent frames, hitches in red, with a line at the
+// target frame time.
+void frame_stats_draw(frame_stats_t* fs, draw_list_t* dl, s32 x, s32 y,
+		      f64 target_frametime)
+{
+	const rgba_t bg_color = {0x10, 0x10, 0x10, 0xc0};
+	const rgba_t ok_color = {0x40, 0xd0, 0x40, 0xff};
+	const rgba_t hitch_color = {0xe0, 0x30, 0x30, 0xff};
+	const rgba_t target_color = {0xe0, 0xe0, 0x40, 0xff};
+
+	const rect_t bg = {x, y, FRAME_STATS_GRAPH_FRAMES * GRAPH_BAR_WIDTH,
+			   GRAPH_HEIGHT};
+	draw_list_rect_solid(dl, kDrawLayerUI, &bg, &bg_color);
+
+	const int head = SDL_AtomicGet(&fs->head);
+	const int num_frames = MIN(head, FRAME_STATS_GRAPH_FRAMES);
+	for (int i = 0; i < num_frames; i++) {
+		const int idx = (head - num_frames + i) % FRAME_STATS_HISTORY;
+		const frame_record_t* rec = &fs->records[idx];
+		const s32 h = MIN((s32)(rec->total_us / GRAPH_US_PER_PX),
+				  GRAPH_HEIGHT);
+		const rect_t bar = {x + i * GRAPH_BAR_WIDTH,
+				    y + GRAPH_HEIGHT - h, GRAPH_BAR_WIDTH, h};
+		draw_list_rect_solid(dl, kDrawLayerUI, &bar,
+				     rec->hitch ? &hitch_color : &ok_color);
+	}
+
+	const s32 target_h =
+		MIN((s32)(target_frametime * 1000000.0 / GRAPH_US_PER_PX),
+		    GRAPH_HEIGHT);
+	const rect_t target = {x, y + GRAPH_HEIGHT - target_h, bg.w, 1};
+	draw_list_rect_solid(dl, kDrawLayerUI, &target, &target_color);
+}
+
+bool frame_stats_write_csv(frame_stats_t* fs, const char* path)
+{
+	FILE* file = os_fopen(path, "w");
+	if (file == NULL) {
+		logger(LOG_ERROR, "Error opening frame stats file %s\n", path);
+		return false;
+	}
+
+	fprintf(file, "frame");
+	for (s32 p = 0; p < kFramePhaseMax; p++)
+		fprintf(file, ",%s_us", phase_names[p]);
+	fprintf(file, ",total_us,hitch\n");
+
+	const int head = SDL_AtomicGet(&fs->head);
+	const int first = MAX(head - FRAME_STATS_HISTORY, 0);
+	for (int i = first; i < head; i++) {
+		const frame_record_t* rec =
+			&fs->records[i % FRAME_STATS_HISTORY];
+		fprintf(file, "%llu", (unsigned long long)rec->frame);
+		for (s32 p = 0; p < kFramePhaseMax; p++)
+			fprintf(file, ",%u", rec->phase_us[p]);
+		fprintf(file, ",%u,%d\n", rec->total_us, rec->hitch ? 1 : 0);
+	}
+
+	fclose(file);
+	logger(LOG_INFO, "Wrote frame stats for %d frames to %s\n",
+	       head - first, path);
+
+	return true;
+}
+
+void frame_stats_log(const frame_stats_t* fs)
+{
+	logger(LOG_INFO,
+	       "frame times: p50 %.2fms, p90 %.2fms, p99 %.2fms, p99.9 %.2fms, "
+	       "max %.2fms, %llu hitches in %llu frames\n",
+	       frame_stats_percentile_us(fs, 50.0) / 1000.0,
+	       frame_stats_percentile_us(fs, 90.0) / 1000.0,
+	       frame_stats_percentile_us(fs, 99.0) / 1000.0,
+	       frame_stats_percentile_us(fs, 99.9) / 1000.0,
+	       fs->max_us / 1000.0, (unsigned long long)fs->num_hitches,
+	       (unsigned long long)fs->num_samples);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+#include <SDL.h>
+
+typedef struct draw_list_s draw_list_t;
+
+#define FRAME_STATS_HISTORY 4096 // frames kept for the graph and CSV
+#define FRAME_STATS_GRAPH_FRAMES 128
+#define FRAME_STATS_HIST_BUCKETS 336
+#define FRAME_STATS_HITCH_FACTOR 2.0 // hitch = frame over 2x the target
+
+typedef enum {
+	kFramePhaseInput,
+	kFramePhaseSim,
+	kFramePhaseRender,
+	kFramePhasePresent,
+	kFramePhaseWait,
+	kFramePhaseMax,
+} frame_phase_t;
+
+typedef struct frame_record_s {
+	u64 frame;
+	u32 phase_us[kFramePhaseMax];
+	u32 total_us;
+	bool hitch;
+} frame_record_t;
+
+// Per frame phase timings. The sim thread is the only writer of the ring
+// and histogram. The render thread hands its phases over through atomics,
+// so render, present and input timings lag the sim by a frame.
+typedef struct frame_stats_s {
+	frame_record_t* records;
+	SDL_atomic_t head; // number of records written
+	SDL_atomic_t render_phase_us[kFramePhaseMax];
+	u64 histogram[FRAME_STATS_HIST_BUCKETS]; // log-linear, in microseconds
+	u64 num_samples;
+	u32 max_us;
+	u64 num_hitches;
+} frame_stats_t;
+
+bool frame_stats_init(frame_stats_t* fs);
+void frame_stats_set_phase(frame_stats_t* fs, frame_phase_t phase, u64 ns);
+void frame_stats_record(frame_stats_t* fs, u64 frame, u64 sim_ns,
+			u64 wait_ns, u64 total_ns, f64 target_frametime);
+u32 frame_stats_percentile_us(const frame_stats_t* fs, f64 percentile);
+void frame_stats_draw(frame_stats_t* fs, draw_list_t* dl, s32 x, s32 y,
+		      f64 target_frametime);
+bool frame_stats_write_csv(frame_stats_t* fs, const char* path);
+void frame_stats_log(const frame_stats_t* fs);
@@ -24,18 +24,21 @@
 #define APP_VER_REV 0
 #define APP_VER_KIND "dev"
 
+#include "core/array.h"
 #include "core/buffer.h"
+#include "core/intern.h"
 #include "core/logger.h"
 #include "core/memory.h"
+#include "core/profiler.h"
 #include "core/string.h"
 #include "core/time_convert.h"
 #include "core/utils.h"
-#include "core/vector.h"
 
 #include "math/vec2.h"
 
 #include "platform/platform.h"
 
+#include "draw_list.h"
 #include "entity.h"
 #include "font.h"
 #include "sprite.h"
@@ -43,6 +46,7 @@
 #include "engine.h"
 #include "resource.h"
 #include "render.h"
+#include "tilemap.h"
 
 #include <SDL.h>
 
@@ -85,80 +89,34 @@ static u8 world_map[WORLD_TILES_WIDTH * WORLD_TILES_HEIGHT] = {
 	1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
 };
 
-static sprite_t* tilemap_sprite = NULL;
-
-void generate_tilemap(u32 width, u32 height)
+static bool init_tilemap(engine_t* engine)
 {
-	// world_map = (u8*)malloc(width * height);
-	// for (size_t i = 0; i < width * width; i++) {
-	// 	world_map[i] = rand() % 2;
-	// }
-	tilemap_sprite = (sprite_t*)malloc(sizeof(sprite_t));
-	tilemap_sprite->type = IMG_TYPE_TARGA;
-	tilemap_sprite->has_alpha = false;
-	tilemap_sprite->pix_fmt = RGB24;
-	tilemap_sprite->surface = NULL;
-}
+	if (!tilemap_init(&engine->tilemap, WORLD_TILES_WIDTH,
+			  WORLD_TILES_HEIGHT, TILE_WIDTH, TILE_HEIGHT,
+			  world_map))
+		return false;
 
-sprite_t* world_map_tile_index(engine_t* engine, rect_t* tile_rect, rect_t* camera)
-{
-	s32 index = tile_rect->x + (tile_rect->y * WORLD_TILES_WIDTH);
-	sprite_t* tile = NULL;
-	game_resource_t* resource = NULL;
-	switch (world_map[index]) {
-	case 0:
-		resource = eng_get_resource(engine, "tiled_wall_64x64");
-		tile = (sprite_t*)resource->data;
-		break;
-	case 1:
-		resource = eng_get_resource(engine, "machines_floor_64x64");
-		tile = (sprite_t*)resource->data;
-		break;
-		// case 2:
-		// 	resource = eng_get_resource(engine, "shadowy_wall_16x16");
-		// 	break;
-		// case 3:
-		// 	resource = eng_get_resource(engine, "grass_dirt_block");
-		// 	tile = (sprite_t *)resource->data;
-		// 	break;
-	}
+	// resolve tile resources once, not per tile per frame
+	game_resource_t* wall = eng_get_resource(engine, "tiled_wall_64x64");
+	game_resource_t* floor = eng_get_resource(engine, "machines_floor_64x64");
+	if (wall == NULL || floor == NULL)
+		return false;
 
-	tile->surface->clip_rect.x = tile_rect->x * tile_rect->w;// - camera->x;
-	tile->surface->clip_rect.y = tile_rect->y * tile_rect->h;// - camera->y;
+	tilemap_set_tile_sprite(&engine->tilemap, 0, (sprite_t*)wall->data);
+	tilemap_set_tile_sprite(&engine->tilemap, 1, (sprite_t*)floor->data);
 
-	return tile;
-}
-
-void update_tilemap(engine_t* engine, rect_t* camera)
-{
-	for (s32 y = 0; y < WORLD_TILES_HEIGHT; y++) {
-		for (s32 x = 0; x < WORLD_TILES_WIDTH; x++) {
-			rect_t tile_rect = { 
-				.x = x,
-				.y = y,
-				.w = TILE_WIDTH,
-				.h = TILE_HEIGHT,
-			};
-			sprite_t* tile =
-				world_map_tile_index(engine, &tile_rect, camera);
-
-			SDL_RenderCopyEx(engine->renderer, tile->texture, NULL,
-					 &tile->surface->clip_rect, 0.0, NULL,
-					 SDL_FLIP_NONE);
-		}
-	}
+	return true;
 }
 
 void print_debug_info(engine_t* engine, f64 dt)
 {
 	if (engine) {
-		s8 r, g, b, a;
-		SDL_GetRenderDrawColor(engine->renderer, &r, &g, &b, &a);
-		SDL_SetRenderDrawColor(engine->renderer, 0x00, 0xdf, 0x00, 0xdd);
-		SDL_RenderDrawRect(engine->renderer, (const SDL_Rect*)&engine->cam_inset);
-		SDL_SetRenderDrawColor(engine->renderer, 0x0bb, 0xdf, 0x40, 0xdd);
-		SDL_RenderDrawRect(engine->renderer, (const SDL_Rect*)&engine->cam_rect);
-		SDL_SetRenderDrawColor(engine->renderer, r, g, b, a);
+		rgba_t inset_color = {0x00, 0xdf, 0x00, 0xdd};
+		rgba_t cam_color = {0xbb, 0xdf, 0x40, 0xdd};
+		draw_list_rect_outline(engine->draw_list, kDrawLayerDebug,
+				       &engine->cam_inset, &inset_color);
+		draw_list_rect_outline(engine->draw_list, kDrawLayerDebug,
+				       &engine->cam_rect, &cam_color);
 		entity_t* player_ent = ent_by_name(engine->ent_list, "player");
 		char time_buf[TEMP_STRING_MAX];
 #if defined BM_WINDOWS
@@ -177,22 +135,113 @@ void print_debug_info(engine_t* engine, f64 dt)
 			   eng_get_time_sec());
 		font_print(engine, 10, 50, 1.5, "Frame Time: %f", dt);
 		font_print(engine, 10, 70, 1.5, "Frame Count: %d",
-			   engine->frame_count);
+			   SDL_AtomicGet(&engine->frame_count));
 		font_print(engine, 10, 90, 1.5, "Active Ents: %d",
 			   gActiveEntities);
 		font_print(engine, 10, 110, 1.5, "Mouse X,Y (%d, %d)",
 			   engine->inputs->mouse.window_pos.x,
 			   engine->inputs->mouse.window_pos.y);
-		font_print(engine, 10, 130, 1.5, "Player Origin (%.2f, %.2f)",
-			   player_ent->org.x, player_ent->org.y);
-		font_print(engine, 10, 150, 1.5, "Player Velocity (%.2f, %.2f)",
-			   player_ent->vel.x, player_ent->vel.y);
+		if (player_ent != NULL) {
+			font_print(engine, 10, 130, 1.5,
+				   "Player Origin (%.2f, %.2f)",
+				   player_ent->org.x, player_ent->org.y);
+			font_print(engine, 10, 150, 1.5,
+				   "Player Velocity (%.2f, %.2f)",
+				   player_ent->vel.x, player_ent->vel.y);
+		}
 		font_print(engine, 10, 170, 1.5,
 			   "Left Stick (%d, %d) | Right Stick (%d, %d}",
 			   engine->inputs->gamepads[0].axes[0].value,
 			   engine->inputs->gamepads[0].axes[1].value,
 			   engine->inputs->gamepads[0].axes[2].value,
 			   engine->inputs->gamepads[0].axes[3].value);
+		font_print(engine, 10, 190, 1.5, "Missed Frames: %llu / %llu",
+			   (unsigned long long)engine->pacer.missed,
+			   (unsigned long long)engine->pacer.frames);
+		font_print(engine, 10, 210, 1.5,
+			   "Frame p50 %.2fms | p99 %.2fms | Hitches %llu",
+			   frame_stats_percentile_us(&engine->frame_stats, 50.0) /
+				   1000.0,
+			   frame_stats_percentile_us(&engine->frame_stats, 99.0) /
+				   1000.0,
+			   (unsigned long long)engine->frame_stats.num_hitches);
+		for (s32 t = 0; t < kMemTagCount; t++) {
+			mem_tag_stats_t mem;
+			mem_get_tag_stats((mem_tag_t)t, &mem);
+			font_print(engine, 10, 230 + t * 20, 1.5,
+				   "Mem %-8s %8.1f KiB | peak %8.1f KiB",
+				   mem_tag_name((mem_tag_t)t),
+				   (mem.heap_bytes + mem.arena_bytes) / 1024.0,
+				   (mem.heap_peak + mem.arena_peak) / 1024.0);
+		}
+		frame_stats_draw(&engine->frame_stats, engine->draw_list, 10,
+				 engine->cam_rect.h - 70,
+				 engine->target_frametime);
+	}
+}
+
+static rect_t con_start;
+static rect_t con_end;
+
+static void game_update(engine_t* engine, f64 dt)
+{
+	switch (SDL_AtomicGet(&engine->mode)) {
+	case kEngineModeStartup: {
+		ent_spawn_player_and_satellite(engine->ent_list,
+					       engine->cam_rect.w,
+					       engine->cam_rect.h);
+		eng_play_sound(engine, "theme_music", DEFAULT_MUSIC_VOLUME);
+		SDL_AtomicSet(&engine->mode, kEngineModePlay);
+		break;
+	}
+	case kEngineModePlay:
+	case kEngineModeConsole: {
+		rgba_t clear_color = {0x20, 0x20, 0x20, 0xFF};
+		draw_list_clear(engine->draw_list, &clear_color);
+		draw_list_tilemap(engine->draw_list, &engine->cam_rect);
+
+		if (engine->debug) {
+			BM_PROFILE_SCOPE("print_debug_info") {
+				print_debug_info(engine, dt);
+			}
+		}
+
+		BM_PROFILE_SCOPE("eng_refresh") {
+			eng_refresh(engine, dt);
+		}
+
+		if (SDL_AtomicGet(&engine->mode) == kEngineModeConsole) {
+			rgba_t con_color = {0x3d, 0x3a, 0x36, 0xff};
+			if (engine->console) {
+				if (engine->console_bounds.y < con_end.y)
+					engine->console_bounds.y +=
+						CONSOLE_SPEED;
+			} else {
+				if (engine->console_bounds.y > con_start.y)
+					engine->console_bounds.y -=
+						CONSOLE_SPEED;
+				else {
+					SDL_AtomicSet(&engine->mode,
+						      kEngineModePlay);
+					engine->inputs->mode = kInputModeGame;
+				}
+			}
+			draw_list_rect_solid(engine->draw_list, kDrawLayerUI,
+					     &engine->console_bounds,
+					     &con_color);
+			font_print(engine, engine->console_bounds.x + 8,
+				   engine->console_bounds.y +
+					   engine->console_bounds.h - 20,
+				   1.5, "> hello, world!");
+		}
+		break;
+	}
+	default:
+	case kEngineModeQuit: {
+		eng_stop_music(engine);
+		SDL_AtomicSet(&engine->mode, kEngineModeShutdown);
+		break;
+	}
 	}
 }
 
@@ -201,26 +250,36 @@ struct vec_elem {
 	float val;
 };
 
+BM_ARRAY_DEFINE(vec_elem, struct vec_elem, 4)
+
 int main(int argc, char** argv)
 {
-	struct vector v;
-	vector_create(&v);
+	logger_init();
+	if (!intern_init()) {
+		logger(LOG_ERROR, "Error initializing string intern table!\n");
+		return -1;
+	}
+
+	BM_ARRAY(vec_elem) v;
+	array_vec_elem_init(&v, array_allocator_heap(kMemTagGeneral));
 	struct vec_elem e1 = { .id = 5, .val = 3.14f };
 	struct vec_elem e2 = { .id = 6, .val = 6.28f };
-	vector_push_back(&v, &e1, sizeof(struct vec_elem));
-	vector_push_back(&v, &e2, sizeof(struct vec_elem));
-	struct vec_elem* e3 = (struct vec_elem*)vector_elem(&v, sizeof(struct vec_elem), 0);
-	struct vec_elem* e4 = (struct vec_elem*)vector_elem(&v, sizeof(struct vec_elem), 1);
+	array_vec_elem_push(&v, e1);
+	array_vec_elem_push(&v, e2);
+	struct vec_elem* e3 = array_vec_elem_at(&v, 0);
+	struct vec_elem* e4 = array_vec_elem_at(&v, 1);
+	array_vec_elem_free(&v);
 	
 	char s[26] = "\"Main screen turn on...\"";
 	str_upper_no_copy(s, 0);
 	logger(LOG_INFO, "%s\n", s);
 
-	generate_tilemap(WORLD_TILES_WIDTH, WORLD_TILES_HEIGHT);
-
-	// Allocate memory arena - 8MiB
-	arena_buf = (u8*)malloc(ARENA_TOTAL_BYTES);
-	arena_init(&g_mem_arena, (void*)arena_buf, (size_t)ARENA_TOTAL_BYTES);
+	// Reserve the memory arena, pages are committed as it grows
+	if (!arena_init_virtual(&g_mem_arena, ARENA_RESERVE_BYTES,
+				kArenaFlagsNone)) {
+		logger(LOG_ERROR, "Error reserving memory arena!\n");
+		return -1;
+	}
 
 	size_t sz_engine = sizeof(engine_t);
 	engine = (engine_t*)arena_alloc(&g_mem_arena, sz_engine,
@@ -250,7 +309,7 @@ int main(int argc, char** argv)
 #else
 	engine->debug = false;
 #endif
-	engine->fullscreen = false;
+	SDL_AtomicSet(&engine->fullscreen, false);
 	engine->console = false;
 
 	s32 con_height = engine->cam_rect.h / 3;
@@ -259,12 +318,8 @@ int main(int argc, char** argv)
 	engine->console_bounds.w = engine->cam_rect.w;
 	engine->console_bounds.h = con_height;
 
-	rect_t con_start = {
-		engine->console_bounds.x, engine->console_bounds.y,
-		engine->console_bounds.w, engine->console_bounds.h
-	};
-
-	rect_t con_end = {
+	con_start = engine->console_bounds;
+	con_end = (rect_t){
 		0, 0,
 		engine->cam_rect.w, con_height
 	};
@@ -277,91 +332,22 @@ int main(int argc, char** argv)
 		return -1;
 	}
 
-	// main loop
-	f64 dt = 0.0;
-	while (engine->mode != kEngineModeShutdown) {
-		u64 frame_start_ns = os_get_time_ns();
-
-		switch (engine->mode) {
-		case kEngineModeStartup: {
-			ent_spawn_player_and_satellite(engine->ent_list,
-						       engine->cam_rect.w,
-						       engine->cam_rect.h);
-			eng_play_sound(engine, "theme_music",
-				       DEFAULT_MUSIC_VOLUME);
-			engine->mode = kEngineModePlay;
-			break;
-		}
-		case kEngineModePlay:
-		case kEngineModeConsole: {
-			SDL_SetRenderDrawColor(engine->renderer, 0x20, 0x20,
-					       0x20, 0xFF);
-			SDL_RenderClear(engine->renderer);
-			entity_t* player = ent_by_index(engine->ent_list, 0);
-			rect_t tilemap_cam = { (u32)player->org.x - TILE_WIDTH, (u32)player->org.y - TILE_HEIGHT, 0, 0};
-			update_tilemap(engine, &tilemap_cam);
-				// engine->cam_rect.w / 2 - TILE_WIDTH,
-				// engine->cam_rect.y / 2 - TILE_HEIGHT);
-				// (u32)player->org.x - TILE_WIDTH,
-				// (u32)player->org.y - TILE_HEIGHT);
-
-			if (engine->debug)
-				print_debug_info(engine, dt);
-
-			eng_refresh(engine, dt);
-
-			if (engine->mode == kEngineModeConsole) {
-				u8 r, g, b, a;
-				SDL_GetRenderDrawColor(engine->renderer, &r, &g, &b, &a);
-				rgba_t con_color = {0x3d, 0x3a, 0x36, 0xff};
-				if (engine->console) {
-					if (engine->console_bounds.y < con_end.y)
-						engine->console_bounds.y +=
-							CONSOLE_SPEED;
-				} else {
-					if (engine->console_bounds.y > con_start.y)
-						engine->console_bounds.y -=
-							CONSOLE_SPEED;
-					else {
-						engine->mode = kEngineModePlay;
-						engine->inputs->mode =
-							kInputModeGame;
-					}
-				}
-				draw_rect_solid(engine->renderer,
-						&engine->console_bounds,
-						&con_color);
-				SDL_SetRenderDrawColor(engine->renderer, r, g, b, a); // restore color
-				font_print(engine, 
-					engine->console_bounds.x + 8,
-					engine->console_bounds.y +
-					engine->console_bounds.h -
-					20, 1.5, "> hello, world!");
-			}
-			break;
-		}
-		default:
-		case kEngineModeQuit: {
-			eng_stop_music(engine);
-			engine->mode = kEngineModeShutdown;
-			break;
-		}
-		}
-
-		do {
-			dt = nsec_to_sec_f64(os_get_time_ns() - frame_start_ns);
-			if (dt > FRAME_TIME(5)) {
-				dt = FRAME_TIME(5);
-			}
-		} while (dt < engine->target_frametime);
-		//printf("%f\n", dt);
+	if (!init_tilemap(engine)) {
+		logger(LOG_ERROR, "Error initializing tilemap!\n");
+		return -1;
+	}
 
-		SDL_RenderPresent(engine->renderer);
-		engine->frame_count++;
+	// sim runs on its own thread, this thread renders
+	if (!eng_run(engine, game_update)) {
+		logger(LOG_ERROR, "Something went wrong!\n");
+		return -1;
 	}
 
 	eng_shutdown(engine);
 
 	engine = NULL;
+	intern_shutdown();
+	arena_release(&g_mem_arena);
+	logger_shutdown();
 	return 0;
 }
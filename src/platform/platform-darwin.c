@@ -18,9 +18,134 @@
 
 #include "platform/platform.h"
 
+#include <errno.h>
+#include <pthread.h>
+#include <sys/sysctl.h>
 #include <time.h>
 
 u64 os_get_time_ns(void)
 {
 	return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
 }
+
+// no clock_nanosleep on macOS, sleep for the remaining duration instead
+void os_sleep_until_ns(const u64 deadline)
+{
+	const u64 now = os_get_time_ns();
+	if (deadline > now)
+		os_sleep_ns(deadline - now);
+}
+
+void os_thread_set_name(const char* name)
+{
+	// macOS can only name the calling thread
+	pthread_setname_np(name);
+}
+
+// thread_policy_set affinity tags are only a placement hint
+bool os_thread_set_affinity(u64 mask)
+{
+	(void)mask;
+	return false;
+}
+
+static s32 sysctl_s32(const char* name)
+{
+	s32 val = 0;
+	size_t size = sizeof(val);
+	if (sysctlbyname(name, &val, &size, NULL, 0) != 0)
+		return 0;
+	return val;
+}
+
+bool os_read_tsc_rate(u64* cycles_per_sec)
+{
+	return false;
+}
+
+// macOS only reports counts. Logical CPUs of a core are numbered next to
+// each other; caches and NUMA are left to the generic fallback.
+bool os_read_cpu_topology(os_cpu_topology_t* topo)
+{
+	const s32 logical = sysctl_s32("hw.logicalcpu");
+	const s32 physical = sysctl_s32("hw.physicalcpu");
+	if (logical <= 0)
+		return false;
+
+	const u32 count = (u32)(logical < OS_CPU_MAX ? logical : OS_CPU_MAX);
+	topo->cpu_mask = count == OS_CPU_MAX ? ~0ULL : (1ULL << count) - 1;
+	if (physical <= 0 || logical % physical != 0)
+		return false;
+
+	const u32 per_core = (u32)(logical / physical);
+	const u64 core_mask = (1ULL << per_core) - 1;
+	for (u32 c = 0; c < count; c++)
+		topo->cpus[c].core = core_mask << (c - c % per_core);
+
+	return true;
+}
+
+// There is no public futex on macOS. Waiters park on one of a fixed set of
+// mutex/condvar buckets picked by address; a wake broadcasts the bucket
+// and waiters that weren't meant to wake recheck their value.
+#define FUTEX_BUCKETS 64
+
+typedef struct futex_bucket_s {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} futex_bucket_t;
+
+static futex_bucket_t futex_buckets[FUTEX_BUCKETS];
+static pthread_once_t futex_once = PTHREAD_ONCE_INIT;
+
+static void futex_init_buckets(void)
+{
+	for (int i = 0; i < FUTEX_BUCKETS; i++) {
+		pthread_mutex_init(&futex_buckets[i].lock, NULL);
+		pthread_cond_init(&futex_buckets[i].cond, NULL);
+	}
+}
+
+static futex_bucket_t* futex_bucket(volatile s32* addr)
+{
+	pthread_once(&futex_once, futex_init_buckets);
+	const uintptr_t key = (uintptr_t)addr >> 2;
+	return &futex_buckets[(key ^ (key >> 6)) & (FUTEX_BUCKETS - 1)];
+}
+
+bool os_futex_wait(volatile s32* addr, s32 expected, u64 timeout_ns)
+{
+	futex_bucket_t* bucket = futex_bucket(addr);
+	bool woken = true;
+	pthread_mutex_lock(&bucket->lock);
+	if (os_atomic_load_s32(addr) == expected) {
+		if (timeout_ns == OS_WAIT_INFINITE) {
+			pthread_cond_wait(&bucket->cond, &bucket->lock);
+		} else {
+			struct timespec ts = {
+				.tv_sec = (time_t)(timeout_ns / 1000000000ULL),
+				.tv_nsec = (long)(timeout_ns % 1000000000ULL),
+			};
+			woken = pthread_cond_timedwait_relative_np(
+					&bucket->cond, &bucket->lock, &ts) !=
+				ETIMEDOUT;
+		}
+	}
+	pthread_mutex_unlock(&bucket->lock);
+
+	return woken;
+}
+
+void os_futex_wake_one(volatile s32* addr)
+{
+	// the bucket is shared, waking only one could pick the wrong waiter
+	os_futex_wake_all(addr);
+}
+
+void os_futex_wake_all(volatile s32* addr)
+{
+	futex_bucket_t* bucket = futex_bucket(addr);
+	pthread_mutex_lock(&bucket->lock);
+	pthread_cond_broadcast(&bucket->cond);
+	pthread_mutex_unlock(&bucket->lock);
+}
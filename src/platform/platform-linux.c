@@ -0,0 +1,328 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// pthread_setaffinity_np, pthread_setname_np and the CPU_* macros
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "platform/platform.h"
+
+#include "math/utils.h"
+
+#include <errno.h>
+#include <limits.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static u64 monotonic_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + (u64)ts.tv_nsec;
+}
+
+#if defined(__x86_64__)
+// Reads go to CLOCK_MONOTONIC until the TSC rate has been measured over
+// TSC_CALIBRATE_NS of run time, then the TSC is scaled from that point
+// on. Only used when the kernel picked the TSC as its own clocksource,
+// which means it is invariant and synchronized across cores.
+#define TSC_CALIBRATE_NS 250000000ULL // 250ms
+#define TSC_CLOCKSOURCE "/sys/devices/system/clocksource/clocksource0/" \
+			"current_clocksource"
+
+typedef enum {
+	kTscOff,
+	kTscCalibrating,
+	kTscScaling, // one thread is computing the rate
+	kTscOn,
+} tsc_state_t;
+
+typedef struct tsc_clock_s {
+	volatile s32 state;
+	u64 start_tsc;
+	u64 start_ns;
+	u64 base_tsc;
+	u64 base_ns;
+	u64 mult; // ns per tick, 32.32 fixed point
+} tsc_clock_t;
+
+static tsc_clock_t tsc_clock;
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+static bool tsc_trusted(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) ||
+	    !(edx & (1u << 8)))
+		return false; // not invariant
+
+	FILE* file = fopen(TSC_CLOCKSOURCE, "r");
+	if (file == NULL)
+		return false;
+	char source[32];
+	const bool trusted = fgets(source, sizeof(source), file) != NULL &&
+			     strncmp(source, "tsc", 3) == 0;
+	fclose(file);
+
+	return trusted;
+}
+
+static void tsc_clock_init(void)
+{
+	if (!tsc_trusted())
+		return;
+
+	tsc_clock.start_ns = monotonic_ns();
+	tsc_clock.start_tsc = __rdtsc();
+	os_atomic_store_s32(&tsc_clock.state, kTscCalibrating);
+}
+
+u64 os_get_time_ns(void)
+{
+	pthread_once(&tsc_once, tsc_clock_init);
+	const s32 state = os_atomic_load_s32(&tsc_clock.state);
+	if (state == kTscOn) {
+		// Another core's TSC can read a little behind the one that
+		// calibrated, clamp rather than wrap the unsigned difference
+		const s64 ticks = (s64)(__rdtsc() - tsc_clock.base_tsc);
+		if (ticks <= 0)
+			return tsc_clock.base_ns;
+		return tsc_clock.base_ns +
+		       (u64)(((unsigned __int128)ticks * tsc_clock.mult) >> 32);
+	}
+
+	const u64 now = monotonic_ns();
+	if (state == kTscCalibrating &&
+	    now - tsc_clock.start_ns >= TSC_CALIBRATE_NS &&
+	    os_atomic_compare_swap_s32(&tsc_clock.state, kTscCalibrating,
+				       kTscScaling)) {
+		// the TSC takes over from here, so there's no jump
+		const u64 tsc = __rdtsc();
+		const u64 ns = monotonic_ns();
+		const unsigned __int128 elapsed_ns = ns - tsc_clock.start_ns;
+		tsc_clock.mult = (u64)((elapsed_ns << 32) /
+				       (tsc - tsc_clock.start_tsc));
+		tsc_clock.base_tsc = tsc;
+		tsc_clock.base_ns = ns;
+		os_atomic_store_s32(&tsc_clock.state, kTscOn);
+	}
+
+	return now;
+}
+
+// Inverts the clock's calibration instead of measuring again
+bool os_read_tsc_rate(u64* cycles_per_sec)
+{
+	if (os_atomic_load_s32(&tsc_clock.state) != kTscOn)
+		return false;
+
+	*cycles_per_sec = (u64)(((unsigned __int128)1000000000ULL << 32) /
+				tsc_clock.mult);
+	return true;
+}
+#else
+u64 os_get_time_ns(void)
+{
+	return monotonic_ns();
+}
+
+bool os_read_tsc_rate(u64* cycles_per_sec)
+{
+	return false;
+}
+#endif
+
+// The deadline is on the os_get_time_ns clock, which may be the scaled
+// TSC, so sleep out the remaining time on CLOCK_MONOTONIC.
+void os_sleep_until_ns(const u64 deadline)
+{
+	const u64 now = os_get_time_ns();
+	if (deadline <= now)
+		return;
+
+	const u64 target = monotonic_ns() + (deadline - now);
+	struct timespec ts = {
+		.tv_sec = (time_t)(target / 1000000000ULL),
+		.tv_nsec = (long)(target % 1000000000ULL),
+	};
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+void os_thread_set_name(const char* name)
+{
+	// the kernel limit is 16 bytes including the terminator
+	char short_name[16];
+	strncpy(short_name, name, sizeof(short_name) - 1);
+	short_name[sizeof(short_name) - 1] = '\0';
+	pthread_setname_np(pthread_self(), short_name);
+}
+
+bool os_thread_set_affinity(u64 mask)
+{
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+		if (mask & (1ULL << cpu))
+			CPU_SET(cpu, &set);
+	}
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_CACHE SYSFS_CPU "/cpu%u/cache/index%u/"
+#define SYSFS_NODE "/sys/devices/system/node"
+#define SYSFS_MAX_CACHES 8
+
+// sysfs CPU lists look like "0-3,8-11"
+static u64 sysfs_read_cpu_list(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return 0;
+
+	u64 mask = 0;
+	char buf[256];
+	if (fgets(buf, sizeof(buf), file) != NULL) {
+		char* s = buf;
+		for (;;) {
+			char* end = NULL;
+			const unsigned long first = strtoul(s, &end, 10);
+			if (end == s)
+				break;
+			unsigned long last = first;
+			if (*end == '-')
+				last = strtoul(end + 1, &end, 10);
+			last = MIN(last, OS_CPU_MAX - 1);
+			for (unsigned long c = first; c <= last; c++)
+				mask |= 1ULL << c;
+			if (*end != ',')
+				break;
+			s = end + 1;
+		}
+	}
+	fclose(file);
+
+	return mask;
+}
+
+static s32 sysfs_read_s32(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+
+	s32 val = -1;
+	if (fscanf(file, "%d", &val) != 1)
+		val = -1;
+	fclose(file);
+
+	return val;
+}
+
+bool os_read_cpu_topology(os_cpu_topology_t* topo)
+{
+	topo->cpu_mask = sysfs_read_cpu_list(SYSFS_CPU "/online");
+	if (topo->cpu_mask == 0) {
+		const long count = sysconf(_SC_NPROCESSORS_ONLN);
+		if (count >= OS_CPU_MAX)
+			topo->cpu_mask = ~0ULL;
+		else if (count > 0)
+			topo->cpu_mask = (1ULL << count) - 1;
+		return false;
+	}
+
+	char path[128];
+	for (u32 c = 0; c < OS_CPU_MAX; c++) {
+		if (!(topo->cpu_mask & (1ULL << c)))
+			continue;
+
+		os_cpu_info_t* cpu = &topo->cpus[c];
+		snprintf(path, sizeof(path),
+			 SYSFS_CPU "/cpu%u/topology/thread_siblings_list", c);
+		cpu->core = sysfs_read_cpu_list(path);
+		snprintf(path, sizeof(path),
+			 SYSFS_CPU "/cpu%u/topology/core_siblings_list", c);
+		cpu->package = sysfs_read_cpu_list(path);
+
+		for (u32 i = 0; i < SYSFS_MAX_CACHES; i++) {
+			snprintf(path, sizeof(path), SYSFS_CACHE "level", c, i);
+			const s32 level = sysfs_read_s32(path);
+			if (level < 0)
+				break;
+			if (level != 2 && level != 3)
+				continue;
+			snprintf(path, sizeof(path),
+				 SYSFS_CACHE "shared_cpu_list", c, i);
+			if (level == 2)
+				cpu->l2 = sysfs_read_cpu_list(path);
+			else
+				cpu->l3 = sysfs_read_cpu_list(path);
+		}
+	}
+
+	// node ids can have gaps, so probe all of them
+	for (u32 n = 0; n < OS_CPU_MAX; n++) {
+		snprintf(path, sizeof(path), SYSFS_NODE "/node%u/cpulist", n);
+		const u64 node = sysfs_read_cpu_list(path);
+		for (u32 c = 0; c < OS_CPU_MAX; c++) {
+			if (node & (1ULL << c))
+				topo->cpus[c].numa_node = node;
+		}
+	}
+
+	return true;
+}
+
+bool os_futex_wait(volatile s32* addr, s32 expected, u64 timeout_ns)
+{
+	struct timespec ts;
+	struct timespec* timeout = NULL;
+	if (timeout_ns != OS_WAIT_INFINITE) {
+		ts.tv_sec = (time_t)(timeout_ns / 1000000000ULL);
+		ts.tv_nsec = (long)(timeout_ns % 1000000000ULL);
+		timeout = &ts;
+	}
+
+	// FUTEX_WAIT takes a relative timeout on the monotonic clock
+	const long rc = syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected,
+				timeout, NULL, 0);
+	return !(rc == -1 && errno == ETIMEDOUT);
+}
+
+void os_futex_wake_one(volatile s32* addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+void os_futex_wake_all(volatile s32* addr)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
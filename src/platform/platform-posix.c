@@ -16,16 +16,661 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#if defined(__APPLE__)
+// ucontext is only declared with _XOPEN_SOURCE on macOS
+#define _XOPEN_SOURCE 600
+#define _DARWIN_C_SOURCE
+#endif
+
 #include "platform/platform.h"
 
+#include "core/logger.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
+// x86-64 Linux switches fibers with a few instructions of asm; everything
+// else uses ucontext, which also saves the signal mask with a syscall.
+#if defined(__linux__) && defined(__x86_64__)
+#define OS_FIBER_ASM 1
+#else
+#include <ucontext.h>
+#endif
+
+struct os_thread_s {
+	pthread_t handle;
+	os_thread_func_t func;
+	void* param;
+	s32 result;
+};
+
+struct os_mutex_s {
+	pthread_mutex_t handle;
+};
+
+struct os_cond_s {
+	pthread_cond_t handle;
+};
+
+struct os_sem_s {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	u32 count;
+};
+
+struct os_fiber_s {
+#ifdef OS_FIBER_ASM
+	void* sp;
+#else
+	ucontext_t context;
+#endif
+	u8* stack; // NULL for a thread converted to a fiber
+	size_t sz_stack;
+	os_fiber_func_t func;
+	void* param;
+};
+
 void os_sleep_ms(const u32 duration)
 {
 	usleep(duration * 1000);
 }
 
+void os_sleep_ns(const u64 duration)
+{
+	struct timespec req = {
+		.tv_sec = (time_t)(duration / 1000000000ULL),
+		.tv_nsec = (long)(duration % 1000000000ULL),
+	};
+	struct timespec rem;
+	while (nanosleep(&req, &rem) == -1 && errno == EINTR)
+		req = rem;
+}
+
 bool os_file_exists(const char* path)
 {
 	return access(path, F_OK) == 0;
 }
+
+void* os_dlopen(const char* path)
+{
+	if (!path)
+		return NULL;
+
+	void* module = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (!module) {
+		logger(LOG_INFO, "dlopen error %s: %s\n", path, dlerror());
+		return NULL;
+	}
+
+	return module;
+}
+
+void* os_dlsym(void* module, const char* func)
+{
+	return dlsym(module, func);
+}
+
+void os_dlclose(void* module)
+{
+	if (module)
+		dlclose(module);
+}
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+size_t os_get_page_size(void)
+{
+	return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+void* os_mem_reserve(size_t size, bool huge_pages)
+{
+	// transparent huge pages only back 2MiB aligned ranges, so over
+	// reserve and trim to an aligned base
+	const size_t slack = huge_pages ? OS_HUGE_PAGE_BYTES : 0;
+	u8* addr = (u8*)mmap(NULL, size + slack, PROT_NONE,
+			     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1,
+			     0);
+	if (addr == (u8*)MAP_FAILED)
+		return NULL;
+	if (slack == 0)
+		return addr;
+
+	const uintptr_t mask = OS_HUGE_PAGE_BYTES - 1;
+	u8* base = (u8*)(((uintptr_t)addr + mask) & ~mask);
+	const size_t head = (size_t)(base - addr);
+	if (head > 0)
+		munmap(addr, head);
+	if (slack - head > 0)
+		munmap(base + size, slack - head);
+
+	return base;
+}
+
+bool os_mem_commit(void* addr, size_t size, bool huge_pages)
+{
+	if (mprotect(addr, size, PROT_READ | PROT_WRITE) != 0)
+		return false;
+#ifdef MADV_HUGEPAGE
+	// transparent huge pages are a hint, failure is not an error
+	if (huge_pages)
+		madvise(addr, size, MADV_HUGEPAGE);
+#else
+	(void)huge_pages;
+#endif
+	return true;
+}
+
+void os_mem_decommit(void* addr, size_t size)
+{
+	// remapping over the range drops the pages and their contents
+	mmap(addr, size, PROT_NONE,
+	     MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+}
+
+void os_mem_release(void* addr, size_t size)
+{
+	munmap(addr, size);
+}
+
+long os_atomic_inc_long(volatile long* val)
+{
+	return __atomic_add_fetch(val, 1, __ATOMIC_SEQ_CST);
+}
+
+long os_atomic_dec_long(volatile long* val)
+{
+	return __atomic_sub_fetch(val, 1, __ATOMIC_SEQ_CST);
+}
+
+long os_atomic_add_long(volatile long* val, long amount)
+{
+	return __atomic_add_fetch(val, amount, __ATOMIC_SEQ_CST);
+}
+
+long os_atomic_set_long(volatile long* ptr, long val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+long os_atomic_exchange_long(volatile long* ptr, long val)
+{
+	return os_atomic_set_long(ptr, val);
+}
+
+long os_atomic_load_long(const volatile long* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+bool os_atomic_compare_swap_long(volatile long* ptr, long old_val,
+				 long new_val)
+{
+	return __atomic_compare_exchange_n(ptr, &old_val, new_val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+s32 os_atomic_load_s32(const volatile s32* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+void os_atomic_store_s32(volatile s32* ptr, s32 val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+s32 os_atomic_add_s32(volatile s32* ptr, s32 amount)
+{
+	return __atomic_add_fetch(ptr, amount, __ATOMIC_SEQ_CST);
+}
+
+s32 os_atomic_exchange_s32(volatile s32* ptr, s32 val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+bool os_atomic_compare_swap_s32(volatile s32* ptr, s32 old_val, s32 new_val)
+{
+	return __atomic_compare_exchange_n(ptr, &old_val, new_val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+s64 os_atomic_load_s64(const volatile s64* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+void os_atomic_store_s64(volatile s64* ptr, s64 val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+s64 os_atomic_add_s64(volatile s64* ptr, s64 amount)
+{
+	return __atomic_add_fetch(ptr, amount, __ATOMIC_SEQ_CST);
+}
+
+s64 os_atomic_exchange_s64(volatile s64* ptr, s64 val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+bool os_atomic_compare_swap_s64(volatile s64* ptr, s64 old_val, s64 new_val)
+{
+	return __atomic_compare_exchange_n(ptr, &old_val, new_val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void* os_atomic_load_ptr(void* const volatile* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+void os_atomic_store_ptr(void* volatile* ptr, void* val)
+{
+	__atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+void* os_atomic_exchange_ptr(void* volatile* ptr, void* val)
+{
+	return __atomic_exchange_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+bool os_atomic_compare_swap_ptr(void* volatile* ptr, void* old_val,
+				void* new_val)
+{
+	return __atomic_compare_exchange_n(ptr, &old_val, new_val, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static void* os_thread_start(void* param)
+{
+	os_thread_t* thread = (os_thread_t*)param;
+	thread->result = thread->func(thread->param);
+	return NULL;
+}
+
+os_thread_t* os_thread_create(os_thread_func_t func, void* param)
+{
+	os_thread_t* thread = (os_thread_t*)malloc(sizeof(os_thread_t));
+	if (thread == NULL)
+		return NULL;
+
+	thread->func = func;
+	thread->param = param;
+	thread->result = 0;
+	if (pthread_create(&thread->handle, NULL, os_thread_start, thread) !=
+	    0) {
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+s32 os_thread_join(os_thread_t* thread)
+{
+	pthread_join(thread->handle, NULL);
+	const s32 result = thread->result;
+	free(thread);
+
+	return result;
+}
+
+u64 os_thread_id(void)
+{
+	return (u64)(uintptr_t)pthread_self();
+}
+
+void os_thread_yield(void)
+{
+	sched_yield();
+}
+
+// Linux condition variables wait on the monotonic clock. macOS can't set
+// the clock but has a relative timed wait instead.
+static bool os_cond_init_handle(pthread_cond_t* cond)
+{
+#if defined(__APPLE__)
+	return pthread_cond_init(cond, NULL) == 0;
+#else
+	pthread_condattr_t attr;
+	if (pthread_condattr_init(&attr) != 0)
+		return false;
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	const bool ok = pthread_cond_init(cond, &attr) == 0;
+	pthread_condattr_destroy(&attr);
+	return ok;
+#endif
+}
+
+static bool os_cond_timed_wait(pthread_cond_t* cond, pthread_mutex_t* mutex,
+			       u64 timeout_ns)
+{
+	if (timeout_ns == OS_WAIT_INFINITE)
+		return pthread_cond_wait(cond, mutex) == 0;
+
+#if defined(__APPLE__)
+	struct timespec ts = {
+		.tv_sec = (time_t)(timeout_ns / 1000000000ULL),
+		.tv_nsec = (long)(timeout_ns % 1000000000ULL),
+	};
+	return pthread_cond_timedwait_relative_np(cond, mutex, &ts) !=
+	       ETIMEDOUT;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const u64 deadline = (u64)now.tv_sec * 1000000000ULL +
+			     (u64)now.tv_nsec + timeout_ns;
+	struct timespec ts = {
+		.tv_sec = (time_t)(deadline / 1000000000ULL),
+		.tv_nsec = (long)(deadline % 1000000000ULL),
+	};
+	return pthread_cond_timedwait(cond, mutex, &ts) != ETIMEDOUT;
+#endif
+}
+
+os_mutex_t* os_mutex_create(void)
+{
+	os_mutex_t* mutex = (os_mutex_t*)malloc(sizeof(os_mutex_t));
+	if (mutex == NULL)
+		return NULL;
+
+	if (pthread_mutex_init(&mutex->handle, NULL) != 0) {
+		free(mutex);
+		return NULL;
+	}
+
+	return mutex;
+}
+
+void os_mutex_destroy(os_mutex_t* mutex)
+{
+	if (mutex == NULL)
+		return;
+
+	pthread_mutex_destroy(&mutex->handle);
+	free(mutex);
+}
+
+void os_mutex_lock(os_mutex_t* mutex)
+{
+	pthread_mutex_lock(&mutex->handle);
+}
+
+bool os_mutex_try_lock(os_mutex_t* mutex)
+{
+	return pthread_mutex_trylock(&mutex->handle) == 0;
+}
+
+void os_mutex_unlock(os_mutex_t* mutex)
+{
+	pthread_mutex_unlock(&mutex->handle);
+}
+
+os_cond_t* os_cond_create(void)
+{
+	os_cond_t* cond = (os_cond_t*)malloc(sizeof(os_cond_t));
+	if (cond == NULL)
+		return NULL;
+
+	if (!os_cond_init_handle(&cond->handle)) {
+		free(cond);
+		return NULL;
+	}
+
+	return cond;
+}
+
+void os_cond_destroy(os_cond_t* cond)
+{
+	if (cond == NULL)
+		return;
+
+	pthread_cond_destroy(&cond->handle);
+	free(cond);
+}
+
+bool os_cond_wait(os_cond_t* cond, os_mutex_t* mutex, u64 timeout_ns)
+{
+	return os_cond_timed_wait(&cond->handle, &mutex->handle, timeout_ns);
+}
+
+void os_cond_signal(os_cond_t* cond)
+{
+	pthread_cond_signal(&cond->handle);
+}
+
+void os_cond_broadcast(os_cond_t* cond)
+{
+	pthread_cond_broadcast(&cond->handle);
+}
+
+// Unnamed POSIX semaphores don't exist on macOS, so build one from a
+// mutex and condition variable everywhere.
+os_sem_t* os_sem_create(u32 count)
+{
+	os_sem_t* sem = (os_sem_t*)malloc(sizeof(os_sem_t));
+	if (sem == NULL)
+		return NULL;
+
+	sem->count = count;
+	if (pthread_mutex_init(&sem->lock, NULL) != 0) {
+		free(sem);
+		return NULL;
+	}
+	if (!os_cond_init_handle(&sem->cond)) {
+		pthread_mutex_destroy(&sem->lock);
+		free(sem);
+		return NULL;
+	}
+
+	return sem;
+}
+
+void os_sem_destroy(os_sem_t* sem)
+{
+	if (sem == NULL)
+		return;
+
+	pthread_cond_destroy(&sem->cond);
+	pthread_mutex_destroy(&sem->lock);
+	free(sem);
+}
+
+void os_sem_post(os_sem_t* sem, u32 count)
+{
+	pthread_mutex_lock(&sem->lock);
+	sem->count += count;
+	if (count == 1)
+		pthread_cond_signal(&sem->cond);
+	else
+		pthread_cond_broadcast(&sem->cond);
+	pthread_mutex_unlock(&sem->lock);
+}
+
+bool os_sem_wait(os_sem_t* sem, u64 timeout_ns)
+{
+	const bool infinite = timeout_ns == OS_WAIT_INFINITE;
+	const u64 deadline = infinite ? 0 : os_get_time_ns() + timeout_ns;
+
+	pthread_mutex_lock(&sem->lock);
+	while (sem->count == 0) {
+		u64 wait_ns = OS_WAIT_INFINITE;
+		if (!infinite) {
+			const u64 now = os_get_time_ns();
+			if (now >= deadline) {
+				pthread_mutex_unlock(&sem->lock);
+				return false;
+			}
+			wait_ns = deadline - now;
+		}
+		os_cond_timed_wait(&sem->cond, &sem->lock, wait_ns);
+	}
+	sem->count--;
+	pthread_mutex_unlock(&sem->lock);
+
+	return true;
+}
+
+static void os_fiber_run(os_fiber_t* fiber)
+{
+	fiber->func(fiber->param);
+	logger(LOG_ERROR, "fiber function returned\n");
+	abort();
+}
+
+#ifdef OS_FIBER_ASM
+// Saves the callee-saved registers, MXCSR and the x87 control word on the
+// current stack, stores the stack pointer in *save_sp, then loads the
+// other fiber's stack and pops its state. A new fiber's stack is built to
+// "return" into os_fiber_start_asm with the fiber in r13.
+void os_fiber_swap_asm(void** save_sp, void* load_sp);
+void os_fiber_start_asm(void);
+__asm__(".text\n"
+	".globl os_fiber_swap_asm\n"
+	".hidden os_fiber_swap_asm\n"
+	".type os_fiber_swap_asm, @function\n"
+	"os_fiber_swap_asm:\n"
+	"\tpushq %rbp\n"
+	"\tpushq %rbx\n"
+	"\tpushq %r12\n"
+	"\tpushq %r13\n"
+	"\tpushq %r14\n"
+	"\tpushq %r15\n"
+	"\tsubq $8, %rsp\n"
+	"\tstmxcsr (%rsp)\n"
+	"\tfnstcw 4(%rsp)\n"
+	"\tmovq %rsp, (%rdi)\n"
+	"\tmovq %rsi, %rsp\n"
+	"\tldmxcsr (%rsp)\n"
+	"\tfldcw 4(%rsp)\n"
+	"\taddq $8, %rsp\n"
+	"\tpopq %r15\n"
+	"\tpopq %r14\n"
+	"\tpopq %r13\n"
+	"\tpopq %r12\n"
+	"\tpopq %rbx\n"
+	"\tpopq %rbp\n"
+	"\tret\n"
+	".size os_fiber_swap_asm, .-os_fiber_swap_asm\n"
+	".globl os_fiber_start_asm\n"
+	".hidden os_fiber_start_asm\n"
+	".type os_fiber_start_asm, @function\n"
+	"os_fiber_start_asm:\n"
+	"\tmovq %r13, %rdi\n"
+	"\tcallq *%r12\n"
+	"\tud2\n"
+	".size os_fiber_start_asm, .-os_fiber_start_asm\n");
+
+static bool os_fiber_init_context(os_fiber_t* fiber)
+{
+	// after the final ret of the first swap rsp must be 16 byte aligned
+	uintptr_t top = (uintptr_t)(fiber->stack + fiber->sz_stack);
+	u64* sp = (u64*)(top & ~(uintptr_t)15) - 10;
+	sp[0] = 0x1f80ULL | (0x037fULL << 32); // default MXCSR and x87 CW
+	sp[1] = 0; // r15
+	sp[2] = 0; // r14
+	sp[3] = (u64)(uintptr_t)fiber; // r13
+	sp[4] = (u64)(uintptr_t)os_fiber_run; // r12
+	sp[5] = 0; // rbx
+	sp[6] = 0; // rbp
+	sp[7] = (u64)(uintptr_t)os_fiber_start_asm; // return address
+	sp[8] = 0;
+	sp[9] = 0;
+	fiber->sp = sp;
+	return true;
+}
+#else
+// makecontext only passes int arguments, split the pointer in two
+static void os_fiber_start_ucontext(unsigned int lo, unsigned int hi)
+{
+	os_fiber_run((os_fiber_t*)(uintptr_t)(((u64)hi << 32) | (u64)lo));
+}
+
+static bool os_fiber_init_context(os_fiber_t* fiber)
+{
+	if (getcontext(&fiber->context) != 0)
+		return false;
+
+	const u64 ptr = (u64)(uintptr_t)fiber;
+	fiber->context.uc_stack.ss_sp = fiber->stack;
+	fiber->context.uc_stack.ss_size = fiber->sz_stack;
+	fiber->context.uc_link = NULL;
+	makecontext(&fiber->context, (void (*)(void))os_fiber_start_ucontext, 2,
+		    (unsigned int)(ptr & 0xffffffffu), (unsigned int)(ptr >> 32));
+	return true;
+}
+#endif
+
+os_fiber_t* os_fiber_from_thread(void)
+{
+	// the context is filled in by the first switch away
+	return (os_fiber_t*)calloc(1, sizeof(os_fiber_t));
+}
+
+void os_fiber_to_thread(os_fiber_t* fiber)
+{
+	free(fiber);
+}
+
+os_fiber_t* os_fiber_create(size_t sz_stack, os_fiber_func_t func,
+			    void* param)
+{
+	os_fiber_t* fiber = (os_fiber_t*)calloc(1, sizeof(os_fiber_t));
+	if (fiber == NULL)
+		return NULL;
+
+	// one inaccessible guard page below the stack catches overflows
+	const size_t page = os_get_page_size();
+	sz_stack = (sz_stack + page - 1) & ~(page - 1);
+	u8* base = (u8*)os_mem_reserve(sz_stack + page, false);
+	if (base == NULL || !os_mem_commit(base + page, sz_stack, false)) {
+		if (base)
+			os_mem_release(base, sz_stack + page);
+		free(fiber);
+		return NULL;
+	}
+
+	fiber->stack = base + page;
+	fiber->sz_stack = sz_stack;
+	fiber->func = func;
+	fiber->param = param;
+	if (!os_fiber_init_context(fiber)) {
+		os_mem_release(base, sz_stack + page);
+		free(fiber);
+		return NULL;
+	}
+
+	return fiber;
+}
+
+void os_fiber_destroy(os_fiber_t* fiber)
+{
+	if (fiber == NULL)
+		return;
+
+	if (fiber->stack) {
+		const size_t page = os_get_page_size();
+		os_mem_release(fiber->stack - page, fiber->sz_stack + page);
+	}
+	free(fiber);
+}
+
+void os_fiber_switch(os_fiber_t* from, os_fiber_t* to)
+{
+#ifdef OS_FIBER_ASM
+	os_fiber_swap_asm(&from->sp, to->sp);
+#else
+	swapcontext(&from->context, &to->context);
+#endif
+}
@@ -42,6 +42,36 @@ void os_sleep_ms(u32 duration)
 	Sleep(d);
 }
 
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+void os_sleep_ns(const u64 duration)
+{
+	// high resolution timers need Windows 10 1803+, else fall back to Sleep
+	HANDLE timer = CreateWaitableTimerExW(
+		NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+		TIMER_ALL_ACCESS);
+	if (timer == NULL) {
+		Sleep((DWORD)(duration / 1000000ULL));
+		return;
+	}
+
+	// negative due time is relative, in 100ns units
+	LARGE_INTEGER due_time;
+	due_time.QuadPart = -(LONGLONG)(duration / 100ULL);
+	if (SetWaitableTimer(timer, &due_time, 0, NULL, NULL, FALSE))
+		WaitForSingleObject(timer, INFINITE);
+	CloseHandle(timer);
+}
+
+void os_sleep_until_ns(const u64 deadline)
+{
+	const u64 now = os_get_time_ns();
+	if (deadline > now)
+		os_sleep_ns(deadline - now);
+}
+
 u64 os_get_time_ns(void)
 {
 	LARGE_INTEGER current_time;
@@ -55,6 +85,12 @@ u64 os_get_time_ns(void)
 	return (u64)time_val;
 }
 
+// QueryPerformanceCounter isn't guaranteed to tick at the TSC rate
+bool os_read_tsc_rate(u64* cycles_per_sec)
+{
+	return false;
+}
+
 bool os_file_exists(const char* path)
 {
 	WIN32_FIND_DATAW wfd;
@@ -72,6 +108,39 @@ bool os_file_exists(const char* path)
 	return hFind != INVALID_HANDLE_VALUE;
 }
 
+size_t os_get_page_size(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (size_t)info.dwPageSize;
+}
+
+void* os_mem_reserve(size_t size, bool huge_pages)
+{
+	// see os_mem_commit, large pages aren't used for reservations
+	(void)huge_pages;
+	return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool os_mem_commit(void* addr, size_t size, bool huge_pages)
+{
+	// large pages must be reserved and committed in one call and need
+	// SeLockMemoryPrivilege, so incremental commits use normal pages
+	(void)huge_pages;
+	return VirtualAlloc(addr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
+void os_mem_decommit(void* addr, size_t size)
+{
+	VirtualFree(addr, size, MEM_DECOMMIT);
+}
+
+void os_mem_release(void* addr, size_t size)
+{
+	(void)size;
+	VirtualFree(addr, 0, MEM_RELEASE);
+}
+
 void* os_dlopen(const char* path)
 {
 	if (!path)
@@ -113,6 +182,11 @@ long os_atomic_dec_long(volatile long *val)
 	return _InterlockedDecrement(val);
 }
 
+long os_atomic_add_long(volatile long* val, long amount)
+{
+	return (long)InterlockedExchangeAdd(val, amount) + amount;
+}
+
 long os_atomic_set_long(volatile long *ptr, long val)
 {
 	return _InterlockedExchange(ptr, val);
@@ -122,3 +196,465 @@ long os_atomic_exchange_long(volatile long *ptr, long val)
 {
 	return os_atomic_set_long(ptr, val);
 }
+
+long os_atomic_load_long(const volatile long* ptr)
+{
+	return _InterlockedOr((volatile long*)ptr, 0);
+}
+
+bool os_atomic_compare_swap_long(volatile long* ptr, long old_val,
+				 long new_val)
+{
+	return _InterlockedCompareExchange(ptr, new_val, old_val) == old_val;
+}
+
+// long is 32 bits on Windows, so the s32 forms reuse the long intrinsics
+s32 os_atomic_load_s32(const volatile s32* ptr)
+{
+	return (s32)_InterlockedOr((volatile long*)ptr, 0);
+}
+
+void os_atomic_store_s32(volatile s32* ptr, s32 val)
+{
+	_InterlockedExchange((volatile long*)ptr, (long)val);
+}
+
+s32 os_atomic_add_s32(volatile s32* ptr, s32 amount)
+{
+	return (s32)InterlockedExchangeAdd((volatile long*)ptr, amount) +
+	       amount;
+}
+
+s32 os_atomic_exchange_s32(volatile s32* ptr, s32 val)
+{
+	return (s32)_InterlockedExchange((volatile long*)ptr, (long)val);
+}
+
+bool os_atomic_compare_swap_s32(volatile s32* ptr, s32 old_val, s32 new_val)
+{
+	return _InterlockedCompareExchange((volatile long*)ptr, new_val,
+					   old_val) == old_val;
+}
+
+s64 os_atomic_load_s64(const volatile s64* ptr)
+{
+	return InterlockedCompareExchange64((volatile LONG64*)ptr, 0, 0);
+}
+
+void os_atomic_store_s64(volatile s64* ptr, s64 val)
+{
+	InterlockedExchange64((volatile LONG64*)ptr, val);
+}
+
+s64 os_atomic_add_s64(volatile s64* ptr, s64 amount)
+{
+	return InterlockedExchangeAdd64((volatile LONG64*)ptr, amount) +
+	       amount;
+}
+
+s64 os_atomic_exchange_s64(volatile s64* ptr, s64 val)
+{
+	return InterlockedExchange64((volatile LONG64*)ptr, val);
+}
+
+bool os_atomic_compare_swap_s64(volatile s64* ptr, s64 old_val, s64 new_val)
+{
+	return InterlockedCompareExchange64((volatile LONG64*)ptr, new_val,
+					    old_val) == old_val;
+}
+
+void* os_atomic_load_ptr(void* const volatile* ptr)
+{
+	return InterlockedCompareExchangePointer((PVOID volatile*)ptr, NULL,
+						 NULL);
+}
+
+void os_atomic_store_ptr(void* volatile* ptr, void* val)
+{
+	InterlockedExchangePointer(ptr, val);
+}
+
+void* os_atomic_exchange_ptr(void* volatile* ptr, void* val)
+{
+	return InterlockedExchangePointer(ptr, val);
+}
+
+bool os_atomic_compare_swap_ptr(void* volatile* ptr, void* old_val,
+				void* new_val)
+{
+	return InterlockedCompareExchangePointer(ptr, new_val, old_val) ==
+	       old_val;
+}
+
+struct os_thread_s {
+	HANDLE handle;
+	os_thread_func_t func;
+	void* param;
+};
+
+static DWORD WINAPI os_thread_start(LPVOID param)
+{
+	os_thread_t* thread = (os_thread_t*)param;
+	return (DWORD)thread->func(thread->param);
+}
+
+os_thread_t* os_thread_create(os_thread_func_t func, void* param)
+{
+	os_thread_t* thread = (os_thread_t*)malloc(sizeof(os_thread_t));
+	if (thread == NULL)
+		return NULL;
+
+	thread->func = func;
+	thread->param = param;
+	thread->handle = CreateThread(NULL, 0, os_thread_start, thread, 0, NULL);
+	if (thread->handle == NULL) {
+		free(thread);
+		return NULL;
+	}
+
+	return thread;
+}
+
+s32 os_thread_join(os_thread_t* thread)
+{
+	DWORD result = 0;
+	WaitForSingleObject(thread->handle, INFINITE);
+	GetExitCodeThread(thread->handle, &result);
+	CloseHandle(thread->handle);
+	free(thread);
+
+	return (s32)result;
+}
+
+u64 os_thread_id(void)
+{
+	return (u64)GetCurrentThreadId();
+}
+
+void os_thread_yield(void)
+{
+	SwitchToThread();
+}
+
+typedef HRESULT(WINAPI* set_thread_description_t)(HANDLE, PCWSTR);
+
+void os_thread_set_name(const char* name)
+{
+	// SetThreadDescription is Windows 10 1607+, look it up at runtime
+	static set_thread_description_t set_description = NULL;
+	static bool looked_up = false;
+	if (!looked_up) {
+		HMODULE kernel32 = GetModuleHandleW(L"kernel32.dll");
+		FARPROC proc = NULL;
+		if (kernel32)
+			proc = GetProcAddress(kernel32, "SetThreadDescription");
+		set_description = (set_thread_description_t)proc;
+		looked_up = true;
+	}
+	if (set_description == NULL)
+		return;
+
+	wchar_t wide_name[64];
+	if (os_utf8_to_wcs(name, 0, wide_name,
+			   sizeof(wide_name) / sizeof(wchar_t)) > 0)
+		set_description(GetCurrentThread(), wide_name);
+}
+
+bool os_thread_set_affinity(u64 mask)
+{
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)mask) != 0;
+}
+
+// Affinity masks only cover the calling thread's processor group, so only
+// group 0 is reported.
+static u64 group0_mask(const GROUP_AFFINITY* groups, WORD count)
+{
+	for (WORD i = 0; i < count; i++) {
+		if (groups[i].Group == 0)
+			return (u64)groups[i].Mask;
+	}
+	return 0;
+}
+
+static void cpu_set_shared(os_cpu_topology_t* topo, u64 mask,
+			   LOGICAL_PROCESSOR_RELATIONSHIP rel, BYTE level)
+{
+	for (u32 c = 0; c < OS_CPU_MAX; c++) {
+		if (!(mask & (1ULL << c)))
+			continue;
+		os_cpu_info_t* cpu = &topo->cpus[c];
+		if (rel == RelationProcessorCore)
+			cpu->core = mask;
+		else if (rel == RelationProcessorPackage)
+			cpu->package = mask;
+		else if (rel == RelationNumaNode)
+			cpu->numa_node = mask;
+		else if (level == 2)
+			cpu->l2 = mask;
+		else if (level == 3)
+			cpu->l3 = mask;
+	}
+}
+
+bool os_read_cpu_topology(os_cpu_topology_t* topo)
+{
+	DWORD len = 0;
+	GetLogicalProcessorInformationEx(RelationAll, NULL, &len);
+	u8* buf = (u8*)malloc(len);
+	if (buf == NULL ||
+	    !GetLogicalProcessorInformationEx(
+		    RelationAll, (SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*)buf,
+		    &len)) {
+		free(buf);
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		topo->cpu_mask = (u64)info.dwActiveProcessorMask;
+		return false;
+	}
+
+	for (DWORD off = 0; off < len;) {
+		const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX* info =
+			(const void*)(buf + off);
+		const PROCESSOR_RELATIONSHIP* proc = &info->Processor;
+		BYTE level = 0;
+		u64 mask = 0;
+		switch (info->Relationship) {
+		case RelationProcessorCore:
+		case RelationProcessorPackage:
+			mask = group0_mask(proc->GroupMask, proc->GroupCount);
+			break;
+		case RelationCache:
+			if (info->Cache.Type != CacheInstruction) {
+				mask = group0_mask(&info->Cache.GroupMask, 1);
+				level = info->Cache.Level;
+			}
+			break;
+		case RelationNumaNode:
+			mask = group0_mask(&info->NumaNode.GroupMask, 1);
+			break;
+		default:
+			break;
+		}
+		if (info->Relationship == RelationProcessorCore)
+			topo->cpu_mask |= mask;
+		cpu_set_shared(topo, mask, info->Relationship, level);
+		off += info->Size;
+	}
+	free(buf);
+
+	return true;
+}
+
+static DWORD os_timeout_ms(u64 timeout_ns)
+{
+	if (timeout_ns == OS_WAIT_INFINITE)
+		return INFINITE;
+
+	// round up so short waits don't become polls
+	const u64 ms = (timeout_ns + 999999ULL) / 1000000ULL;
+	return ms >= INFINITE ? INFINITE - 1 : (DWORD)ms;
+}
+
+struct os_mutex_s {
+	SRWLOCK lock;
+};
+
+struct os_cond_s {
+	CONDITION_VARIABLE cond;
+};
+
+struct os_sem_s {
+	HANDLE handle;
+};
+
+os_mutex_t* os_mutex_create(void)
+{
+	os_mutex_t* mutex = (os_mutex_t*)malloc(sizeof(os_mutex_t));
+	if (mutex == NULL)
+		return NULL;
+
+	InitializeSRWLock(&mutex->lock);
+
+	return mutex;
+}
+
+void os_mutex_destroy(os_mutex_t* mutex)
+{
+	free(mutex);
+}
+
+void os_mutex_lock(os_mutex_t* mutex)
+{
+	AcquireSRWLockExclusive(&mutex->lock);
+}
+
+bool os_mutex_try_lock(os_mutex_t* mutex)
+{
+	return TryAcquireSRWLockExclusive(&mutex->lock) != 0;
+}
+
+void os_mutex_unlock(os_mutex_t* mutex)
+{
+	ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+os_cond_t* os_cond_create(void)
+{
+	os_cond_t* cond = (os_cond_t*)malloc(sizeof(os_cond_t));
+	if (cond == NULL)
+		return NULL;
+
+	InitializeConditionVariable(&cond->cond);
+
+	return cond;
+}
+
+void os_cond_destroy(os_cond_t* cond)
+{
+	free(cond);
+}
+
+bool os_cond_wait(os_cond_t* cond, os_mutex_t* mutex, u64 timeout_ns)
+{
+	return SleepConditionVariableSRW(&cond->cond, &mutex->lock,
+					 os_timeout_ms(timeout_ns), 0) != 0;
+}
+
+void os_cond_signal(os_cond_t* cond)
+{
+	WakeConditionVariable(&cond->cond);
+}
+
+void os_cond_broadcast(os_cond_t* cond)
+{
+	WakeAllConditionVariable(&cond->cond);
+}
+
+os_sem_t* os_sem_create(u32 count)
+{
+	os_sem_t* sem = (os_sem_t*)malloc(sizeof(os_sem_t));
+	if (sem == NULL)
+		return NULL;
+
+	sem->handle = CreateSemaphoreW(NULL, (LONG)count, LONG_MAX, NULL);
+	if (sem->handle == NULL) {
+		free(sem);
+		return NULL;
+	}
+
+	return sem;
+}
+
+void os_sem_destroy(os_sem_t* sem)
+{
+	if (sem == NULL)
+		return;
+
+	CloseHandle(sem->handle);
+	free(sem);
+}
+
+void os_sem_post(os_sem_t* sem, u32 count)
+{
+	ReleaseSemaphore(sem->handle, (LONG)count, NULL);
+}
+
+bool os_sem_wait(os_sem_t* sem, u64 timeout_ns)
+{
+	return WaitForSingleObject(sem->handle, os_timeout_ms(timeout_ns)) ==
+	       WAIT_OBJECT_0;
+}
+
+// WaitOnAddress needs Windows 8+ and Synchronization.lib
+bool os_futex_wait(volatile s32* addr, s32 expected, u64 timeout_ns)
+{
+	return WaitOnAddress(addr, &expected, sizeof(s32),
+			     os_timeout_ms(timeout_ns)) != 0;
+}
+
+void os_futex_wake_one(volatile s32* addr)
+{
+	WakeByAddressSingle((PVOID)addr);
+}
+
+void os_futex_wake_all(volatile s32* addr)
+{
+	WakeByAddressAll((PVOID)addr);
+}
+
+struct os_fiber_s {
+	void* handle;
+	bool thread_fiber;
+	os_fiber_func_t func;
+	void* param;
+};
+
+static VOID WINAPI os_fiber_start(LPVOID param)
+{
+	os_fiber_t* fiber = (os_fiber_t*)param;
+	fiber->func(fiber->param);
+	logger(LOG_ERROR, "fiber function returned\n");
+	abort();
+}
+
+os_fiber_t* os_fiber_from_thread(void)
+{
+	os_fiber_t* fiber = (os_fiber_t*)calloc(1, sizeof(os_fiber_t));
+	if (fiber == NULL)
+		return NULL;
+
+	fiber->thread_fiber = true;
+	fiber->handle = IsThreadAFiber() ? GetCurrentFiber()
+					 : ConvertThreadToFiber(NULL);
+	if (fiber->handle == NULL) {
+		free(fiber);
+		return NULL;
+	}
+
+	return fiber;
+}
+
+void os_fiber_to_thread(os_fiber_t* fiber)
+{
+	if (fiber == NULL)
+		return;
+
+	ConvertFiberToThread();
+	free(fiber);
+}
+
+os_fiber_t* os_fiber_create(size_t sz_stack, os_fiber_func_t func,
+			    void* param)
+{
+	os_fiber_t* fiber = (os_fiber_t*)calloc(1, sizeof(os_fiber_t));
+	if (fiber == NULL)
+		return NULL;
+
+	fiber->func = func;
+	fiber->param = param;
+	// reserve the full stack, commit pages as it grows
+	fiber->handle = CreateFiberEx(0, sz_stack, FIBER_FLAG_FLOAT_SWITCH,
+				      os_fiber_start, fiber);
+	if (fiber->handle == NULL) {
+		free(fiber);
+		return NULL;
+	}
+
+	return fiber;
+}
+
+void os_fiber_destroy(os_fiber_t* fiber)
+{
+	if (fiber == NULL)
+		return;
+
+	if (!fiber->thread_fiber)
+		DeleteFiber(fiber->handle);
+	free(fiber);
+}
+
+void os_fiber_switch(os_fiber_t* from, os_fiber_t* to)
+{
+	(void)from;
+	SwitchToFiber(to->handle);
+}
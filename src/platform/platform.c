@@ -26,6 +26,16 @@
 #include <sys/errno.h>
 #endif
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define OS_CYCLES_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define OS_CYCLES_TSC
+#endif
+
+#define CYCLES_CALIBRATE_NS 20000000ULL // 20ms
+
 FILE* os_wfopen(const wchar_t* path, const char* mode)
 {
 	FILE* file = NULL;
@@ -301,3 +311,99 @@ f64 os_get_time_msec(void)
 {
 	return nsec_to_msec_f64(os_get_time_ns());
 }
+
+// Per platform backend. Sets cpu_mask and whichever sharing masks it can
+// read, leaving the rest zero.
+bool os_read_cpu_topology(os_cpu_topology_t* topo);
+
+// Lowest CPU of a sharing group stands for the whole group when counting
+static bool cpu_leads_group(u64 group, u64 bit)
+{
+	return (group & (~group + 1)) == bit;
+}
+
+bool os_get_cpu_topology(os_cpu_topology_t* topo)
+{
+	memset(topo, 0, sizeof(os_cpu_topology_t));
+	bool ok = os_read_cpu_topology(topo);
+	if (topo->cpu_mask == 0) {
+		topo->cpu_mask = 1;
+		ok = false;
+	}
+
+	const u64 all = topo->cpu_mask;
+	for (u32 c = 0; c < OS_CPU_MAX; c++) {
+		const u64 bit = 1ULL << c;
+		if (!(all & bit))
+			continue;
+
+		os_cpu_info_t* cpu = &topo->cpus[c];
+		cpu->core = (cpu->core & all) | bit;
+		cpu->package = (cpu->package & all) ? (cpu->package & all) | bit
+						    : all;
+		cpu->l2 = (cpu->l2 & all) ? (cpu->l2 & all) | bit : cpu->core;
+		cpu->l3 = (cpu->l3 & all) ? (cpu->l3 & all) | bit
+					  : cpu->package;
+		cpu->numa_node = (cpu->numa_node & all)
+					 ? (cpu->numa_node & all) | bit
+					 : all;
+
+		topo->num_logical++;
+		topo->num_cores += cpu_leads_group(cpu->core, bit);
+		topo->num_packages += cpu_leads_group(cpu->package, bit);
+		topo->num_l2_groups += cpu_leads_group(cpu->l2, bit);
+		topo->num_l3_groups += cpu_leads_group(cpu->l3, bit);
+		topo->num_numa_nodes += cpu_leads_group(cpu->numa_node, bit);
+	}
+
+	return ok;
+}
+
+// Per platform backend. Sets the TSC rate if the backend has already
+// measured it for its own clock.
+bool os_read_tsc_rate(u64* cycles_per_sec);
+
+u64 os_get_cycles(void)
+{
+#if defined(OS_CYCLES_TSC)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	u64 val;
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(val));
+	return val;
+#else
+	return os_get_time_ns();
+#endif
+}
+
+u64 os_get_cycles_per_sec(void)
+{
+#if defined(OS_CYCLES_TSC)
+	u64 tsc_rate = 0;
+	if (os_read_tsc_rate(&tsc_rate))
+		return tsc_rate;
+
+	// Fallback when the clock doesn't run on the TSC, or hasn't finished
+	// calibrating. Concurrent first callers each measure, any of the
+	// results will do.
+	static volatile s64 cycles_per_sec = 0;
+	s64 rate = os_atomic_load_s64(&cycles_per_sec);
+	if (rate == 0) {
+		const u64 start_ns = os_get_time_ns();
+		const u64 start = os_get_cycles();
+		os_sleep_ns(CYCLES_CALIBRATE_NS);
+		const u64 end_ns = os_get_time_ns();
+		const u64 end = os_get_cycles();
+		rate = (s64)((f64)(end - start) * 1000000000.0 /
+			     (f64)(end_ns - start_ns));
+		os_atomic_store_s64(&cycles_per_sec, rate);
+	}
+	return (u64)rate;
+#elif defined(__aarch64__)
+	u64 val;
+	__asm__ volatile("mrs %0, cntfrq_el0" : "=r"(val));
+	return val;
+#else
+	return 1000000000ULL;
+#endif
+}
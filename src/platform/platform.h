@@ -56,9 +56,20 @@ BM_EXPORT size_t os_wcs_to_utf8_ptr(const wchar_t* str, size_t len,
 					char** pstr);
 
 BM_EXPORT void os_sleep_ms(const u32 duration);
+BM_EXPORT void os_sleep_ns(const u64 duration);
+// Sleep until an absolute os_get_time_ns() timestamp
+BM_EXPORT void os_sleep_until_ns(const u64 deadline);
+// Monotonic clock. On x86-64 Linux it scales the invariant TSC once the
+// rate has been measured, otherwise it is the OS monotonic clock.
 BM_EXPORT u64 os_get_time_ns(void);
 BM_EXPORT f64 os_get_time_sec(void);
 BM_EXPORT f64 os_get_time_msec(void);
+// Raw CPU counter (TSC, or the ARM generic timer) for cheap timestamps.
+// Ticks are only comparable on one machine; convert with the rate below.
+// On x86 the rate comes from the TSC clock's calibration once it is on,
+// otherwise it is measured against os_get_time_ns on first use.
+BM_EXPORT u64 os_get_cycles(void);
+BM_EXPORT u64 os_get_cycles_per_sec(void);
 
 BM_EXPORT void* os_dlopen(const char* path);
 BM_EXPORT void* os_dlsym(void* module, const char* func);
@@ -66,10 +77,138 @@ BM_EXPORT void os_dlclose(void* module);
 
 BM_EXPORT bool os_file_exists(const char* path);
 
+// Virtual memory. Reserved address space is inaccessible until committed;
+// addresses and sizes passed to commit/decommit must be page aligned.
+// Reserving for huge pages aligns the base to OS_HUGE_PAGE_BYTES where
+// the platform backs them transparently.
+#define OS_HUGE_PAGE_BYTES 2097152 // 2MiB
+BM_EXPORT size_t os_get_page_size(void);
+BM_EXPORT void* os_mem_reserve(size_t size, bool huge_pages);
+BM_EXPORT bool os_mem_commit(void* addr, size_t size, bool huge_pages);
+BM_EXPORT void os_mem_decommit(void* addr, size_t size);
+BM_EXPORT void os_mem_release(void* addr, size_t size);
+
 BM_EXPORT long os_atomic_inc_long(volatile long* val);
 BM_EXPORT long os_atomic_dec_long(volatile long* val);
+BM_EXPORT long os_atomic_add_long(volatile long* val, long amount);
 BM_EXPORT long os_atomic_set_long(volatile long *ptr, long val);
 BM_EXPORT long os_atomic_exchange_long(volatile long *ptr, long val);
+BM_EXPORT long os_atomic_load_long(const volatile long* ptr);
+BM_EXPORT bool os_atomic_compare_swap_long(volatile long* ptr, long old_val,
+					   long new_val);
+
+// Fixed width and pointer atomics, sequentially consistent like the long
+// versions above. Arithmetic returns the new value, exchange the old one.
+BM_EXPORT s32 os_atomic_load_s32(const volatile s32* ptr);
+BM_EXPORT void os_atomic_store_s32(volatile s32* ptr, s32 val);
+BM_EXPORT s32 os_atomic_add_s32(volatile s32* ptr, s32 amount);
+BM_EXPORT s32 os_atomic_exchange_s32(volatile s32* ptr, s32 val);
+BM_EXPORT bool os_atomic_compare_swap_s32(volatile s32* ptr, s32 old_val,
+					  s32 new_val);
+BM_EXPORT s64 os_atomic_load_s64(const volatile s64* ptr);
+BM_EXPORT void os_atomic_store_s64(volatile s64* ptr, s64 val);
+BM_EXPORT s64 os_atomic_add_s64(volatile s64* ptr, s64 amount);
+BM_EXPORT s64 os_atomic_exchange_s64(volatile s64* ptr, s64 val);
+BM_EXPORT bool os_atomic_compare_swap_s64(volatile s64* ptr, s64 old_val,
+					  s64 new_val);
+BM_EXPORT void* os_atomic_load_ptr(void* const volatile* ptr);
+BM_EXPORT void os_atomic_store_ptr(void* volatile* ptr, void* val);
+BM_EXPORT void* os_atomic_exchange_ptr(void* volatile* ptr, void* val);
+BM_EXPORT bool os_atomic_compare_swap_ptr(void* volatile* ptr, void* old_val,
+					  void* new_val);
+
+typedef struct os_thread_s os_thread_t;
+typedef s32 (*os_thread_func_t)(void* param);
+
+BM_EXPORT os_thread_t* os_thread_create(os_thread_func_t func, void* param);
+BM_EXPORT s32 os_thread_join(os_thread_t* thread);
+// Identifier of the calling thread, never 0
+BM_EXPORT u64 os_thread_id(void);
+BM_EXPORT void os_thread_yield(void);
+// Names the calling thread for debuggers and profilers. Linux truncates
+// names to 15 characters.
+BM_EXPORT void os_thread_set_name(const char* name);
+// Pins the calling thread to the CPUs set in mask. Returns false if the
+// platform doesn't support it (macOS) or the mask is invalid.
+BM_EXPORT bool os_thread_set_affinity(u64 mask);
+
+#define OS_CPU_MAX 64 // one bit per logical CPU, matching affinity masks
+
+// Masks of the logical CPUs sharing each resource with a CPU, itself
+// included
+typedef struct os_cpu_info_s {
+	u64 core; // hyperthread siblings
+	u64 package;
+	u64 l2;
+	u64 l3;
+	u64 numa_node;
+} os_cpu_info_t;
+
+typedef struct os_cpu_topology_s {
+	u64 cpu_mask; // online logical CPUs
+	u32 num_logical;
+	u32 num_cores;
+	u32 num_packages;
+	u32 num_l2_groups;
+	u32 num_l3_groups;
+	u32 num_numa_nodes;
+	os_cpu_info_t cpus[OS_CPU_MAX];
+} os_cpu_topology_t;
+
+// Reads the layout of the first OS_CPU_MAX logical CPUs. Whatever the
+// platform can't report is filled in conservatively: a CPU is its own
+// core, its L2 is its core, its L3 is its package and there is a single
+// NUMA node. Returns false if only the CPU count could be read.
+BM_EXPORT bool os_get_cpu_topology(os_cpu_topology_t* topo);
+
+// Timeouts are relative, in nanoseconds. A wait returns false if it timed
+// out; a timeout of 0 polls.
+#define OS_WAIT_INFINITE ((u64)-1)
+
+typedef struct os_mutex_s os_mutex_t;
+typedef struct os_cond_s os_cond_t;
+typedef struct os_sem_s os_sem_t;
+
+BM_EXPORT os_mutex_t* os_mutex_create(void);
+BM_EXPORT void os_mutex_destroy(os_mutex_t* mutex);
+BM_EXPORT void os_mutex_lock(os_mutex_t* mutex);
+BM_EXPORT bool os_mutex_try_lock(os_mutex_t* mutex);
+BM_EXPORT void os_mutex_unlock(os_mutex_t* mutex);
+
+// Condition waits can wake spuriously, callers recheck their predicate
+BM_EXPORT os_cond_t* os_cond_create(void);
+BM_EXPORT void os_cond_destroy(os_cond_t* cond);
+BM_EXPORT bool os_cond_wait(os_cond_t* cond, os_mutex_t* mutex,
+			    u64 timeout_ns);
+BM_EXPORT void os_cond_signal(os_cond_t* cond);
+BM_EXPORT void os_cond_broadcast(os_cond_t* cond);
+
+BM_EXPORT os_sem_t* os_sem_create(u32 count);
+BM_EXPORT void os_sem_destroy(os_sem_t* sem);
+BM_EXPORT void os_sem_post(os_sem_t* sem, u32 count);
+BM_EXPORT bool os_sem_wait(os_sem_t* sem, u64 timeout_ns);
+
+// Futex style wait/wake. os_futex_wait sleeps only while *addr still
+// equals expected, so a wake between the caller's check and the wait is
+// never lost. It can return early; callers recheck the value.
+BM_EXPORT bool os_futex_wait(volatile s32* addr, s32 expected,
+			     u64 timeout_ns);
+BM_EXPORT void os_futex_wake_one(volatile s32* addr);
+BM_EXPORT void os_futex_wake_all(volatile s32* addr);
+
+// User mode fibers. A thread must become a fiber with os_fiber_from_thread
+// before it can switch to others. A fiber can be resumed on any thread
+// but only run on one at a time, and its function must never return.
+typedef struct os_fiber_s os_fiber_t;
+typedef void (*os_fiber_func_t)(void* param);
+
+BM_EXPORT os_fiber_t* os_fiber_from_thread(void);
+BM_EXPORT void os_fiber_to_thread(os_fiber_t* fiber);
+BM_EXPORT os_fiber_t* os_fiber_create(size_t sz_stack, os_fiber_func_t func,
+				      void* param);
+BM_EXPORT void os_fiber_destroy(os_fiber_t* fiber);
+// Saves the running fiber's context into from and resumes to
+BM_EXPORT void os_fiber_switch(os_fiber_t* from, os_fiber_t* to);
 
 #ifdef __cplusplus
 }
@@ -14,11 +14,14 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include "draw_list.h"
+#include "engine.h"
 #include "render.h"
 #include "sprite.h"
 
 #include "core/time_convert.h"
 
+#include "math/utils.h"
 #include "math/vec2.h"
 #include "math/vec4.h"
 
@@ -60,19 +63,21 @@ void draw_circle(SDL_Renderer* rend, f32 cx, f32 cy, f32 radius)
 	}
 }
 
-void draw_rect_outline(SDL_Renderer* rend, rect_t* rect, rgba_t* color)
+void draw_rect_outline(SDL_Renderer* rend, const rect_t* rect,
+		       const rgba_t* color)
 {
 	SDL_SetRenderDrawColor(rend, color->r, color->g, color->b, color->a);
 	SDL_RenderDrawRect(rend, (const SDL_Rect*)rect);
 }
 
-void draw_rect_solid(SDL_Renderer* rend, rect_t* rect, rgba_t* color)
+void draw_rect_solid(SDL_Renderer* rend, const rect_t* rect,
+		     const rgba_t* color)
 {
 	SDL_SetRenderDrawColor(rend, color->r, color->g, color->b, color->a);
 	SDL_RenderFillRect(rend, (const SDL_Rect*)rect);
 }
 
-void draw_sprite_sheet(SDL_Renderer* rend, sprite_sheet_t* sprite_sheet,
+void draw_sprite_sheet(draw_list_t* dl, sprite_sheet_t* sprite_sheet,
 		       vec2f_t* org, const f64 scale, const f32 angle,
 		       const bool flip)
 {
@@ -100,28 +105,30 @@ void draw_sprite_sheet(SDL_Renderer* rend, sprite_sheet_t* sprite_sheet,
 	// printf("frame_delay %f\n", frame_delay);
 	s32 scaled_width = current_frame->bbox.max.x * backing_sprite->scaling;
 	s32 scaled_height = current_frame->bbox.max.y * backing_sprite->scaling;
-	SDL_Rect dst = {
+	rect_t dst = {
 		(s32)(org->x) - scaled_width / 2,
 		(s32)(org->y) - scaled_height / 2,
 		scaled_width,
 		scaled_height,
 	};
 
-	SDL_RendererFlip sprite_flip = SDL_FLIP_NONE;
-	if (flip)
-		sprite_flip = SDL_FLIP_HORIZONTAL;
-
 	rect_t frame_rect = {
-		.x = (s32)current_frame->bbox.min.x,
-		.y = (s32)current_frame->bbox.min.y,
+		.x = backing_sprite->atlas_rect.x +
+		     (s32)current_frame->bbox.min.x,
+		.y = backing_sprite->atlas_rect.y +
+		     (s32)current_frame->bbox.min.y,
 		.w = (s32)current_frame->bbox.max.x,
 		.h = (s32)current_frame->bbox.max.y,
 	};
-	SDL_RenderCopyEx(rend, backing_sprite->texture, (SDL_Rect*)&frame_rect,
-			 &dst, angle, NULL, sprite_flip);
-
-	if (frame_delay > 0.0 && os_get_time_sec() >= frame_time) {
-		frame_time = os_get_time_sec() + frame_delay;
+	// y sort on the bottom edge so lower sprites draw in front
+	draw_list_texture(dl, kDrawLayerWorld, (u32)MAX(dst.y + dst.h, 0),
+			  backing_sprite->texture, &frame_rect, &dst, angle,
+			  flip);
+
+	// frame time, so every sheet in a frame advances against the same clock
+	const f64 now = eng_get_time_sec();
+	if (frame_delay > 0.0 && now >= frame_time) {
+		frame_time = now + frame_delay;
 		frame_num += 1;
 	}
 	if (frame_num > sprite_sheet->num_frames - 1)
@@ -58,9 +58,14 @@ bool game_res_init(engine_t* eng)
 	logger(LOG_INFO, "Found %d assets in game resources config.",
 	       num_assets);
 
-	eng->game_resources = arena_alloc(&g_mem_arena,
-					  sizeof(game_resource_t*) * num_assets,
-					  DEFAULT_ALIGNMENT);
+	eng->game_resources = arena_alloc_tagged(
+		&g_mem_arena, sizeof(game_resource_t*) * num_assets,
+		DEFAULT_ALIGNMENT, kMemTagAssets);
+	eng->num_game_resources = 0;
+	hashmap_init(&eng->resource_map, kHashmapKeyInt, NULL, kMemTagAssets);
+
+	// Sprites are packed into shared atlas textures once everything is loaded
+	atlas_init(&eng->atlas);
 
 	// Load the assets into game resource objects
 	bool attr_ok = false;
@@ -99,15 +104,24 @@ bool game_res_init(engine_t* eng)
 		const asset_type_t asset_type =
 			asset_type_from_string(asset_type_str);
 
-		eng->game_resources[asset_idx] = make_game_resource(
+		game_resource_t* resource = make_game_resource(
 			eng, asset_name, asset_path, asset_type);
+		if (resource == NULL) {
+			logger(LOG_ERROR, "Error loading game resource: %s\n",
+			       asset_name);
+			return false;
+		}
+
+		eng->game_resources[asset_idx] = resource;
+		eng->num_game_resources = asset_idx + 1;
+		hashmap_insert_int(&eng->resource_map, resource->name,
+				   (void*)(intptr_t)asset_idx);
 
 		if (asset_type == kAssetTypeSprite) {
 			s32 sprite_scale = 1;
 			if (!read_table_int32(asset, "scale", &sprite_scale))
 				sprite_scale = 1;
-			sprite_t* s =
-				(sprite_t*)eng->game_resources[asset_idx]->data;
+			sprite_t* s = (sprite_t*)resource->data;
 			s->scaling = sprite_scale;
 		}
 
@@ -127,6 +141,11 @@ bool game_res_init(engine_t* eng)
 	logger(LOG_INFO, "Successfully loaded %zu/%zu assets.\n",
 	       num_assets_loaded, num_assets);
 
+	if (!atlas_build(&eng->atlas, eng->renderer)) {
+		logger(LOG_ERROR, "Error building texture atlas!\n");
+		return false;
+	}
+
 	return true;
 }
 
@@ -146,12 +165,12 @@ game_resource_t* make_game_resource(engine_t* eng, const char* asset_name,
 	    asset_type == kAssetTypeSpriteFont) {
 		sprite_t* sprite = NULL;
 		if (sprite_load(asset_path, &sprite) &&
-		    sprite_create_texture(eng->renderer, sprite)) {
-			resource = arena_alloc(&g_mem_arena,
-					       sizeof(game_resource_t),
-					       DEFAULT_ALIGNMENT);
-			sprintf(resource->name, "%s", asset_name);
-			sprintf(resource->path, "%s", asset_path);
+		    atlas_add_sprite(&eng->atlas, sprite)) {
+			resource = arena_alloc_tagged(
+				&g_mem_arena, sizeof(game_resource_t),
+				DEFAULT_ALIGNMENT, kMemTagAssets);
+			resource->name = intern(asset_name);
+			resource->path = intern(asset_path);
 			resource->type = asset_type;
 			resource->data = sprite;
 		}
@@ -175,23 +194,24 @@ game_resource_t* make_game_resource(engine_t* eng, const char* asset_name,
 			const size_t num_frames =
 				(size_t)toml_array_nelem(frames);
 
-			sprite_sheet_t* sprite_sheet = arena_alloc(
-				&g_mem_arena, sizeof(sprite_sheet_t),
-				DEFAULT_ALIGNMENT);
-
 			//TODO(paulh): need a filesystem path string processor to get base dir of path
 			sprite_t* sprite = NULL;
-			sprite_load(sprite_path, &sprite);
-			sprite_create_texture(eng->renderer, sprite);
+			if (!sprite_load(sprite_path, &sprite) ||
+			    !atlas_add_sprite(&eng->atlas, sprite))
+				return NULL;
 			sprite->scaling = frame_scale_factor;
 
+			sprite_sheet_t* sprite_sheet = arena_alloc_tagged(
+				&g_mem_arena, sizeof(sprite_sheet_t),
+				DEFAULT_ALIGNMENT, kMemTagAssets);
+
 			sprite_sheet->width = sheet_width;
 			sprite_sheet->height = sheet_height;
 			sprite_sheet->backing_sprite = sprite;
 			sprite_sheet->num_frames = num_frames;
-			sprite_sheet->frames = (ss_frame_t*)arena_alloc(
+			sprite_sheet->frames = (ss_frame_t*)arena_alloc_tagged(
 				&g_mem_arena, sizeof(ss_frame_t) * num_frames,
-				DEFAULT_ALIGNMENT);
+				DEFAULT_ALIGNMENT, kMemTagAssets);
 
 			// Load frame array from sprite sheet asset file
 			for (size_t i = 0; i < num_frames; i++) {
@@ -218,12 +238,12 @@ game_resource_t* make_game_resource(engine_t* eng, const char* asset_name,
 				ss_frame->duration = (f32)duration;
 			}
 
-			resource = arena_alloc(&g_mem_arena,
-					       sizeof(game_resource_t),
-					       DEFAULT_ALIGNMENT);
+			resource = arena_alloc_tagged(
+				&g_mem_arena, sizeof(game_resource_t),
+				DEFAULT_ALIGNMENT, kMemTagAssets);
 
-			sprintf(resource->name, "%s", asset_name);
-			sprintf(resource->path, "%s", asset_path);
+			resource->name = intern(asset_name);
+			resource->path = intern(asset_path);
 			resource->type = asset_type;
 			resource->data = sprite_sheet;
 		}
@@ -231,12 +251,12 @@ game_resource_t* make_game_resource(engine_t* eng, const char* asset_name,
 		   asset_type == kAssetTypeMusic) {
 		audio_chunk_t* audio_chunk = NULL;
 		if (audio_load_sound(asset_path, &audio_chunk)) {
-			resource = arena_alloc(&g_mem_arena,
-					       sizeof(game_resource_t),
-					       DEFAULT_ALIGNMENT);
+			resource = arena_alloc_tagged(
+				&g_mem_arena, sizeof(game_resource_t),
+				DEFAULT_ALIGNMENT, kMemTagAssets);
 
-			sprintf(resource->name, "%s", asset_name);
-			sprintf(resource->path, "%s", asset_path);
+			resource->name = intern(asset_name);
+			resource->path = intern(asset_path);
 			resource->type = asset_type;
 			resource->data = (void*)audio_chunk;
 		}
@@ -16,10 +16,16 @@
 
 #pragma once
 
+#include "core/intern.h"
 #include "core/types.h"
 
 #define MAX_GAME_RESOURCES 256
 
+// Index into engine_t::game_resources. Resolve once by name with
+// eng_get_resource_handle, then look up directly on hot paths.
+typedef s32 resource_handle_t;
+#define INVALID_RESOURCE_HANDLE -1
+
 // forward decl
 typedef struct engine_s engine_t;
 typedef struct toml_table_t toml_table_t;
@@ -34,8 +40,8 @@ typedef enum {
 } asset_type_t;
 
 typedef struct game_resource_s {
-	char name[256];
-	char path[256];
+	str_id_t name;
+	str_id_t path;
 	asset_type_t type;
 	void* data;
 } game_resource_t;
@@ -56,8 +56,9 @@ bool sprite_load(const char* path, sprite_t** out)
 	// absolute most janky file extension comparison
 	const char* file_ext = file_extension(path);
 	if (strcmp(file_ext, "tga") == 0) {
-		img = (sprite_t*)arena_alloc(&g_mem_arena, sizeof(sprite_t),
-					     DEFAULT_ALIGNMENT);
+		img = (sprite_t*)arena_alloc_tagged(
+			&g_mem_arena, sizeof(sprite_t), DEFAULT_ALIGNMENT,
+			kMemTagAssets);
 		img->type = IMG_TYPE_TARGA;
 
 		file_ptr = fopen(path, "rb");
@@ -98,8 +99,9 @@ bool sprite_load(const char* path, sprite_t** out)
 		s32 stride = width * bytes_per_pixel;
 		size_t pixel_size = width * height * bytes_per_pixel;
 
-		img->data = (u8*)arena_alloc(&g_mem_arena, pixel_size,
-					     DEFAULT_ALIGNMENT);
+		img->data = (u8*)arena_alloc_tagged(&g_mem_arena, pixel_size,
+						    DEFAULT_ALIGNMENT,
+						    kMemTagAssets);
 
 		logger(LOG_INFO, "sprite_load - %s, %dx%d %d bytes per pixel\n",
 		       path, width, height, bytes_per_pixel);
@@ -132,6 +134,11 @@ bool sprite_load(const char* path, sprite_t** out)
 
 		img->surface = SDL_CreateRGBSurfaceWithFormatFrom(
 			img->data, width, height, header->bpp, stride, pix_fmt);
+		img->atlas_rect.x = 0;
+		img->atlas_rect.y = 0;
+		img->atlas_rect.w = width;
+		img->atlas_rect.h = height;
+		img->atlas_page = -1;
 
 		free(file_buf);
 		fclose(file_ptr);
@@ -147,15 +154,22 @@ bool sprite_load(const char* path, sprite_t** out)
 void sprite_create(u8* data, u32 w, u32 h, u32 bpp, u32 stride, u32 format,
 		   sprite_t** out)
 {
-	sprite_t* img = (sprite_t*)arena_alloc(&g_mem_arena, sizeof(sprite_t),
-					       DEFAULT_ALIGNMENT);
+	sprite_t* img = (sprite_t*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(sprite_t), DEFAULT_ALIGNMENT,
+		kMemTagAssets);
 	img->type = IMG_TYPE_RAW;
 	size_t pixel_size = w * h * (bpp / 8);
 	img->data =
-		(u8*)arena_alloc(&g_mem_arena, pixel_size, DEFAULT_ALIGNMENT);
+		(u8*)arena_alloc_tagged(&g_mem_arena, pixel_size,
+					DEFAULT_ALIGNMENT, kMemTagAssets);
 	memcpy(img->data, data, pixel_size);
 	img->surface = SDL_CreateRGBSurfaceWithFormatFrom(img->data, w, h, bpp,
 							  stride, format);
+	img->atlas_rect.x = 0;
+	img->atlas_rect.y = 0;
+	img->atlas_rect.w = (s32)w;
+	img->atlas_rect.h = (s32)h;
+	img->atlas_page = -1;
 
 	*out = img;
 }
@@ -181,6 +195,12 @@ bool sprite_create_texture(SDL_Renderer* ren, sprite_t* img)
 							? SDL_BLENDMODE_BLEND
 							: SDL_BLENDMODE_NONE);
 
+			img->atlas_rect.x = 0;
+			img->atlas_rect.y = 0;
+			img->atlas_rect.w = img->surface->w;
+			img->atlas_rect.h = img->surface->h;
+			img->atlas_page = -1;
+
 			res = true;
 		} else {
 			SDL_DestroyTexture(img->texture);
@@ -198,10 +218,10 @@ void sprite_shutdown(sprite_t* img)
 			SDL_FreeSurface(img->surface);
 			img->surface = NULL;
 		}
-		if (img->texture != NULL) {
+		// atlas pages are owned by the atlas
+		if (img->texture != NULL && img->atlas_page < 0)
 			SDL_DestroyTexture(img->texture);
-			img->texture = NULL;
-		}
+		img->texture = NULL;
 		logger(LOG_INFO, "imagefile_shutdown: OK!\n");
 	}
 }
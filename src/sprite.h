@@ -27,6 +27,8 @@ typedef struct sprite_s {
 	pix_fmt_t pix_fmt;
 	SDL_Surface* surface;
 	SDL_Texture* texture;
+	rect_t atlas_rect; // sub-rect of the sprite within texture
+	s32 atlas_page;    // -1 if the sprite owns its texture
 	s32 scaling;
 	bool has_alpha;
 } sprite_t;
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "tilemap.h"
+#include "sprite.h"
+
+#include "core/logger.h"
+#include "core/memory.h"
+
+bool tilemap_init(tilemap_t* tm, s32 width, s32 height, s32 tile_width,
+		  s32 tile_height, const u8* tiles)
+{
+	if (tm == NULL || width <= 0 || height <= 0)
+		return false;
+
+	memset(tm, 0, sizeof(tilemap_t));
+	tm->width = width;
+	tm->height = height;
+	tm->tile_width = tile_width;
+	tm->tile_height = tile_height;
+
+	const size_t num_tiles = (size_t)width * (size_t)height;
+	tm->tiles = (u8*)arena_alloc_tagged(&g_mem_arena, num_tiles,
+					    DEFAULT_ALIGNMENT, kMemTagAssets);
+	if (tm->tiles == NULL)
+		return false;
+	if (tiles != NULL)
+		memcpy(tm->tiles, tiles, num_tiles);
+
+	tm->chunks_x = (width + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+	tm->chunks_y = (height + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+	const size_t num_chunks = (size_t)tm->chunks_x * (size_t)tm->chunks_y;
+	tm->chunks = (tilemap_chunk_t*)arena_alloc_tagged(
+		&g_mem_arena, sizeof(tilemap_chunk_t) * num_chunks,
+		DEFAULT_ALIGNMENT, kMemTagAssets);
+	if (tm->chunks == NULL)
+		return false;
+
+	const s32 chunk_w = TILEMAP_CHUNK_TILES * tile_width;
+	const s32 chunk_h = TILEMAP_CHUNK_TILES * tile_height;
+	for (s32 cy = 0; cy < tm->chunks_y; cy++) {
+		for (s32 cx = 0; cx < tm->chunks_x; cx++) {
+			tilemap_chunk_t* chunk = &tm->chunks[cx + cy * tm->chunks_x];
+			chunk->texture = NULL;
+			chunk->bounds.x = cx * chunk_w;
+			chunk->bounds.y = cy * chunk_h;
+			chunk->bounds.w = chunk_w;
+			chunk->bounds.h = chunk_h;
+			chunk->dirty = true;
+		}
+	}
+
+	logger(LOG_INFO, "tilemap_init OK - %dx%d tiles in %dx%d chunks\n",
+	       width, height, tm->chunks_x, tm->chunks_y);
+
+	return true;
+}
+
+void tilemap_shutdown(tilemap_t* tm)
+{
+	if (tm == NULL || tm->chunks == NULL)
+		return;
+
+	const s32 num_chunks = tm->chunks_x * tm->chunks_y;
+	for (s32 i = 0; i < num_chunks; i++) {
+		if (tm->chunks[i].texture != NULL) {
+			SDL_DestroyTexture(tm->chunks[i].texture);
+			tm->chunks[i].texture = NULL;
+		}
+	}
+}
+
+void tilemap_set_tile_sprite(tilemap_t* tm, u8 kind, sprite_t* sprite)
+{
+	if (kind >= MAX_TILE_KINDS)
+		return;
+	tm->tile_sprites[kind] = sprite;
+	tilemap_invalidate(tm);
+}
+
+void tilemap_set_tile(tilemap_t* tm, s32 x, s32 y, u8 kind)
+{
+	if (x < 0 || y < 0 || x >= tm->width || y >= tm->height)
+		return;
+
+	u8* tile = &tm->tiles[x + y * tm->width];
+	if (*tile == kind)
+		return;
+
+	*tile = kind;
+	const s32 cx = x / TILEMAP_CHUNK_TILES;
+	const s32 cy = y / TILEMAP_CHUNK_TILES;
+	tm->chunks[cx + cy * tm->chunks_x].dirty = true;
+}
+
+u8 tilemap_get_tile(const tilemap_t* tm, s32 x, s32 y)
+{
+	if (x < 0 || y < 0 || x >= tm->width || y >= tm->height)
+		return 0;
+	return tm->tiles[x + y * tm->width];
+}
+
+void tilemap_invalidate(tilemap_t* tm)
+{
+	const s32 num_chunks = tm->chunks_x * tm->chunks_y;
+	for (s32 i = 0; i < num_chunks; i++)
+		tm->chunks[i].dirty = true;
+}
+
+static bool tilemap_chunk_redraw(tilemap_t* tm, tilemap_chunk_t* chunk,
+				 SDL_Renderer* ren)
+{
+	if (chunk->texture == NULL) {
+		chunk->texture = SDL_CreateTexture(ren, SDL_PIXELFORMAT_BGRA32,
+						   SDL_TEXTUREACCESS_TARGET,
+						   chunk->bounds.w,
+						   chunk->bounds.h);
+		if (chunk->texture == NULL) {
+			logger(LOG_ERROR,
+			       "tilemap - error creating chunk texture: %s\n",
+			       SDL_GetError());
+			return false;
+		}
+		SDL_SetTextureBlendMode(chunk->texture, SDL_BLENDMODE_BLEND);
+	}
+
+	SDL_Texture* prev_target = SDL_GetRenderTarget(ren);
+	if (SDL_SetRenderTarget(ren, chunk->texture) != 0)
+		return false;
+
+	u8 r, g, b, a;
+	SDL_GetRenderDrawColor(ren, &r, &g, &b, &a);
+	SDL_SetRenderDrawColor(ren, 0x00, 0x00, 0x00, 0x00);
+	SDL_RenderClear(ren);
+	SDL_SetRenderDrawColor(ren, r, g, b, a);
+
+	const s32 tx0 = chunk->bounds.x / tm->tile_width;
+	const s32 ty0 = chunk->bounds.y / tm->tile_height;
+	for (s32 ty = ty0; ty < ty0 + TILEMAP_CHUNK_TILES && ty < tm->height;
+	     ty++) {
+		for (s32 tx = tx0;
+		     tx < tx0 + TILEMAP_CHUNK_TILES && tx < tm->width; tx++) {
+			const u8 kind = tm->tiles[tx + ty * tm->width];
+			sprite_t* tile = kind < MAX_TILE_KINDS
+						 ? tm->tile_sprites[kind]
+						 : NULL;
+			if (tile == NULL || tile->texture == NULL)
+				continue;
+
+			// copy tile alpha straight into the chunk so the chunk
+			// blends over the scene the same way the tile would
+			SDL_BlendMode blend_mode = SDL_BLENDMODE_NONE;
+			SDL_GetTextureBlendMode(tile->texture, &blend_mode);
+			SDL_SetTextureBlendMode(tile->texture,
+						SDL_BLENDMODE_NONE);
+			SDL_Rect dst = {
+				(tx - tx0) * tm->tile_width,
+				(ty - ty0) * tm->tile_height,
+				tm->tile_width,
+				tm->tile_height,
+			};
+			SDL_RenderCopy(ren, tile->texture,
+				       (const SDL_Rect*)&tile->atlas_rect, &dst);
+			SDL_SetTextureBlendMode(tile->texture, blend_mode);
+		}
+	}
+
+	SDL_SetRenderTarget(ren, prev_target);
+	chunk->dirty = false;
+
+	return true;
+}
+
+void tilemap_draw(tilemap_t* tm, SDL_Renderer* ren, const rect_t* camera)
+{
+	if (tm == NULL || tm->chunks == NULL || camera == NULL)
+		return;
+
+	const s32 chunk_w = TILEMAP_CHUNK_TILES * tm->tile_width;
+	const s32 chunk_h = TILEMAP_CHUNK_TILES * tm->tile_height;
+
+	// only visit the chunks overlapping the camera
+	s32 cx0 = camera->x / chunk_w;
+	s32 cy0 = camera->y / chunk_h;
+	s32 cx1 = (camera->x + camera->w - 1) / chunk_w;
+	s32 cy1 = (camera->y + camera->h - 1) / chunk_h;
+	if (cx0 < 0)
+		cx0 = 0;
+	if (cy0 < 0)
+		cy0 = 0;
+	if (cx1 >= tm->chunks_x)
+		cx1 = tm->chunks_x - 1;
+	if (cy1 >= tm->chunks_y)
+		cy1 = tm->chunks_y - 1;
+
+	for (s32 cy = cy0; cy <= cy1; cy++) {
+		for (s32 cx = cx0; cx <= cx1; cx++) {
+			tilemap_chunk_t* chunk = &tm->chunks[cx + cy * tm->chunks_x];
+			if (chunk->dirty && !tilemap_chunk_redraw(tm, chunk, ren))
+				continue;
+
+			SDL_Rect dst = {
+				chunk->bounds.x - camera->x,
+				chunk->bounds.y - camera->y,
+				chunk->bounds.w,
+				chunk->bounds.h,
+			};
+			SDL_RenderCopy(ren, chunk->texture, NULL, &dst);
+		}
+	}
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Paul Hindt
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "core/types.h"
+
+#include <SDL.h>
+
+typedef struct sprite_s sprite_t;
+
+#define TILEMAP_CHUNK_TILES 8 // chunks are 8x8 tiles
+#define MAX_TILE_KINDS 16
+
+// A chunk of tiles pre-rendered into a render target texture. Chunks are
+// only redrawn when one of their tiles changes.
+typedef struct tilemap_chunk_s {
+	SDL_Texture* texture;
+	rect_t bounds; // world space, in pixels
+	bool dirty;
+} tilemap_chunk_t;
+
+typedef struct tilemap_s {
+	s32 width;  // in tiles
+	s32 height; // in tiles
+	s32 tile_width;
+	s32 tile_height;
+	u8* tiles;
+	sprite_t* tile_sprites[MAX_TILE_KINDS];
+	s32 chunks_x;
+	s32 chunks_y;
+	tilemap_chunk_t* chunks;
+} tilemap_t;
+
+bool tilemap_init(tilemap_t* tm, s32 width, s32 height, s32 tile_width,
+		  s32 tile_height, const u8* tiles);
+void tilemap_shutdown(tilemap_t* tm);
+
+void tilemap_set_tile_sprite(tilemap_t* tm, u8 kind, sprite_t* sprite);
+void tilemap_set_tile(tilemap_t* tm, s32 x, s32 y, u8 kind);
+u8 tilemap_get_tile(const tilemap_t* tm, s32 x, s32 y);
+void tilemap_invalidate(tilemap_t* tm);
+
+void tilemap_draw(tilemap_t* tm, SDL_Renderer* ren, const rect_t* camera);